@@ -0,0 +1,614 @@
+/**********************************************************************************************
+*
+*   Dynamic AABB tree, the broadphase for moving bodies
+*
+*   Copyright (c) 2022 creikey
+*
+**********************************************************************************************/
+
+#include "aabb_tree.h"
+#include "raymath.h"
+#include <math.h>
+#include <stdlib.h>
+
+#define NULL_NODE -1
+#define MIN_NODES_CAPACITY 16
+#define DISPLACEMENT_MULTIPLIER 4.0f    // how far ahead along its motion a reinserted box reaches
+#define QUERY_STACK_SIZE 256            // way deeper than a balanced tree of 2^20 leaves gets
+
+//----------------------------------------------------------------------------------
+// Types and Structures Definition
+//----------------------------------------------------------------------------------
+typedef struct AABBPair
+{
+    int proxyA;     // the lower numbered one
+    int proxyB;
+} AABBPair;
+
+//----------------------------------------------------------------------------------
+// Module Functions Definition (local)
+//----------------------------------------------------------------------------------
+static AABB Union(AABB a, AABB b)
+{
+    return (AABB){
+        .min = { fminf(a.min.x, b.min.x), fminf(a.min.y, b.min.y) },
+        .max = { fmaxf(a.max.x, b.max.x), fmaxf(a.max.y, b.max.y) },
+    };
+}
+
+static float Perimeter(AABB a)
+{
+    return 2.0f * ((a.max.x - a.min.x) + (a.max.y - a.min.y));
+}
+
+static bool Contains(AABB outer, AABB inner)
+{
+    return outer.min.x <= inner.min.x && outer.min.y <= inner.min.y && inner.max.x <= outer.max.x && inner.max.y <= outer.max.y;
+}
+
+static AABB Expand(AABB a, float amount)
+{
+    return (AABB){
+        .min = { a.min.x - amount, a.min.y - amount },
+        .max = { a.max.x + amount, a.max.y + amount },
+    };
+}
+
+static bool IsLeaf(const AABBTree *tree, int node)
+{
+    return tree->nodes[node].child1 == NULL_NODE;
+}
+
+static int AllocateNode(AABBTree *tree)
+{
+    if (tree->freeNode == NULL_NODE)
+    {
+        int newCapacity = (tree->nodesCapacity < MIN_NODES_CAPACITY) ? MIN_NODES_CAPACITY : tree->nodesCapacity * 2;
+        AABBTreeNode *newNodes = RL_REALLOC(tree->nodes, (size_t)newCapacity * sizeof(AABBTreeNode));
+        if (newNodes == NULL)
+        {
+            TraceLog(LOG_ERROR, "AABBTREE: Failed to grow to %i nodes", newCapacity);
+            return NULL_NODE;
+        }
+        tree->nodes = newNodes;
+        for (int i = tree->nodesCapacity; i < newCapacity; i++)
+        {
+            tree->nodes[i].parent = (i + 1 < newCapacity) ? i + 1 : NULL_NODE;
+            tree->nodes[i].height = -1;
+        }
+        tree->freeNode = tree->nodesCapacity;
+        tree->nodesCapacity = newCapacity;
+    }
+    int node = tree->freeNode;
+    tree->freeNode = tree->nodes[node].parent;
+    tree->nodes[node] = (AABBTreeNode){
+        .id = NULL_ID,
+        .parent = NULL_NODE,
+        .child1 = NULL_NODE,
+        .child2 = NULL_NODE,
+        .height = 0,
+    };
+    tree->nodesLen += 1;
+    return node;
+}
+
+static void FreeNode(AABBTree *tree, int node)
+{
+    tree->nodes[node].parent = tree->freeNode;
+    tree->nodes[node].height = -1;
+    tree->freeNode = node;
+    tree->nodesLen -= 1;
+}
+
+static void Refit(AABBTree *tree, int node)
+{
+    AABBTreeNode *n = &tree->nodes[node];
+    const AABBTreeNode *c1 = &tree->nodes[n->child1];
+    const AABBTreeNode *c2 = &tree->nodes[n->child2];
+    n->box = Union(c1->box, c2->box);
+    n->height = 1 + ((c1->height > c2->height) ? c1->height : c2->height);
+}
+
+// If a is imbalanced, rotate its taller child up. Returns the node now where a was
+static int Balance(AABBTree *tree, int iA)
+{
+    AABBTreeNode *nodes = tree->nodes;
+    AABBTreeNode *a = &nodes[iA];
+    if (IsLeaf(tree, iA) || a->height < 2)
+    {
+        return iA;
+    }
+
+    int iB = a->child1;
+    int iC = a->child2;
+    AABBTreeNode *b = &nodes[iB];
+    AABBTreeNode *c = &nodes[iC];
+    int balance = c->height - b->height;
+
+    if (balance > 1)
+    {
+        // rotate c up
+        int iF = c->child1;
+        int iG = c->child2;
+        AABBTreeNode *f = &nodes[iF];
+        AABBTreeNode *g = &nodes[iG];
+
+        c->child1 = iA;
+        c->parent = a->parent;
+        a->parent = iC;
+        if (c->parent != NULL_NODE)
+        {
+            if (nodes[c->parent].child1 == iA) nodes[c->parent].child1 = iC;
+            else nodes[c->parent].child2 = iC;
+        }
+        else
+        {
+            tree->root = iC;
+        }
+
+        if (f->height > g->height)
+        {
+            c->child2 = iF;
+            a->child2 = iG;
+            g->parent = iA;
+        }
+        else
+        {
+            c->child2 = iG;
+            a->child2 = iF;
+            f->parent = iA;
+        }
+        Refit(tree, iA);
+        Refit(tree, iC);
+        return iC;
+    }
+
+    if (balance < -1)
+    {
+        // rotate b up
+        int iD = b->child1;
+        int iE = b->child2;
+        AABBTreeNode *d = &nodes[iD];
+        AABBTreeNode *e = &nodes[iE];
+
+        b->child1 = iA;
+        b->parent = a->parent;
+        a->parent = iB;
+        if (b->parent != NULL_NODE)
+        {
+            if (nodes[b->parent].child1 == iA) nodes[b->parent].child1 = iB;
+            else nodes[b->parent].child2 = iB;
+        }
+        else
+        {
+            tree->root = iB;
+        }
+
+        if (d->height > e->height)
+        {
+            b->child2 = iD;
+            a->child1 = iE;
+            e->parent = iA;
+        }
+        else
+        {
+            b->child2 = iE;
+            a->child1 = iD;
+            d->parent = iA;
+        }
+        Refit(tree, iA);
+        Refit(tree, iB);
+        return iB;
+    }
+
+    return iA;
+}
+
+// walk up from node fixing boxes and heights, rebalancing on the way
+static void FixUpwards(AABBTree *tree, int node)
+{
+    while (node != NULL_NODE)
+    {
+        node = Balance(tree, node);
+        Refit(tree, node);
+        node = tree->nodes[node].parent;
+    }
+}
+
+static void InsertLeaf(AABBTree *tree, int leaf)
+{
+    if (tree->root == NULL_NODE)
+    {
+        tree->root = leaf;
+        tree->nodes[leaf].parent = NULL_NODE;
+        return;
+    }
+
+    // find the sibling that makes the tree's total perimeter grow the least
+    AABB leafBox = tree->nodes[leaf].box;
+    int index = tree->root;
+    while (!IsLeaf(tree, index))
+    {
+        const AABBTreeNode *n = &tree->nodes[index];
+        float area = Perimeter(n->box);
+        float combinedArea = Perimeter(Union(n->box, leafBox));
+        float cost = 2.0f * combinedArea;               // new parent for this node and the leaf
+        float inheritanceCost = 2.0f * (combinedArea - area); // pushing the leaf further down
+
+        float cost1 = Perimeter(Union(leafBox, tree->nodes[n->child1].box)) + inheritanceCost;
+        if (!IsLeaf(tree, n->child1)) cost1 -= Perimeter(tree->nodes[n->child1].box);
+        float cost2 = Perimeter(Union(leafBox, tree->nodes[n->child2].box)) + inheritanceCost;
+        if (!IsLeaf(tree, n->child2)) cost2 -= Perimeter(tree->nodes[n->child2].box);
+
+        if (cost < cost1 && cost < cost2)
+        {
+            break;
+        }
+        index = (cost1 < cost2) ? n->child1 : n->child2;
+    }
+    int sibling = index;
+
+    int newParent = AllocateNode(tree);
+    if (newParent == NULL_NODE)
+    {
+        return;
+    }
+    int oldParent = tree->nodes[sibling].parent;
+    tree->nodes[newParent].parent = oldParent;
+    tree->nodes[newParent].child1 = sibling;
+    tree->nodes[newParent].child2 = leaf;
+    tree->nodes[sibling].parent = newParent;
+    tree->nodes[leaf].parent = newParent;
+    if (oldParent != NULL_NODE)
+    {
+        if (tree->nodes[oldParent].child1 == sibling) tree->nodes[oldParent].child1 = newParent;
+        else tree->nodes[oldParent].child2 = newParent;
+    }
+    else
+    {
+        tree->root = newParent;
+    }
+
+    FixUpwards(tree, newParent);
+}
+
+static void RemoveLeaf(AABBTree *tree, int leaf)
+{
+    if (leaf == tree->root)
+    {
+        tree->root = NULL_NODE;
+        return;
+    }
+
+    int parent = tree->nodes[leaf].parent;
+    int grandParent = tree->nodes[parent].parent;
+    int sibling = (tree->nodes[parent].child1 == leaf) ? tree->nodes[parent].child2 : tree->nodes[parent].child1;
+
+    // the sibling takes the parent's place
+    tree->nodes[sibling].parent = grandParent;
+    FreeNode(tree, parent);
+    if (grandParent != NULL_NODE)
+    {
+        if (tree->nodes[grandParent].child1 == parent) tree->nodes[grandParent].child1 = sibling;
+        else tree->nodes[grandParent].child2 = sibling;
+        FixUpwards(tree, grandParent);
+    }
+    else
+    {
+        tree->root = sibling;
+    }
+}
+
+// does the segment from->from+(to-from)*maxFraction touch the box
+static bool GrowBuffer(void **buffer, int *capacity, int needed, size_t itemSize)
+{
+    if (needed <= *capacity)
+    {
+        return true;
+    }
+    int newCapacity = (*capacity < MIN_NODES_CAPACITY) ? MIN_NODES_CAPACITY : *capacity;
+    while (newCapacity < needed)
+    {
+        newCapacity *= 2;
+    }
+    void *newBuffer = RL_REALLOC(*buffer, (size_t)newCapacity*itemSize);
+    if (newBuffer == NULL)
+    {
+        TraceLog(LOG_ERROR, "AABBTREE: Failed to grow a buffer to %i items", newCapacity);
+        return false;
+    }
+    *buffer = newBuffer;
+    *capacity = newCapacity;
+    return true;
+}
+
+static void BufferMove(AABBTree *tree, int proxy)
+{
+    if (GrowBuffer((void **)&tree->moved, &tree->movedCapacity, tree->movedLen + 1, sizeof(int)))
+    {
+        tree->moved[tree->movedLen++] = proxy;
+    }
+}
+
+static int ComparePairs(const void *a, const void *b)
+{
+    const AABBPair *pairA = (const AABBPair *)a;
+    const AABBPair *pairB = (const AABBPair *)b;
+    if (pairA->proxyA != pairB->proxyA)
+    {
+        return (pairA->proxyA > pairB->proxyA) - (pairA->proxyA < pairB->proxyA);
+    }
+    return (pairA->proxyB > pairB->proxyB) - (pairA->proxyB < pairB->proxyB);
+}
+
+static bool SegmentHitsBox(Vector2 from, Vector2 to, float maxFraction, AABB box)
+{
+    float tMin = 0.0f;
+    float tMax = maxFraction;
+    float p[2] = { from.x, from.y };
+    float d[2] = { to.x - from.x, to.y - from.y };
+    float lo[2] = { box.min.x, box.min.y };
+    float hi[2] = { box.max.x, box.max.y };
+    for (int axis = 0; axis < 2; axis++)
+    {
+        if (fabsf(d[axis]) < 1e-8f)
+        {
+            if (p[axis] < lo[axis] || p[axis] > hi[axis])
+            {
+                return false;
+            }
+            continue;
+        }
+        float t1 = (lo[axis] - p[axis]) / d[axis];
+        float t2 = (hi[axis] - p[axis]) / d[axis];
+        if (t1 > t2)
+        {
+            float tmp = t1;
+            t1 = t2;
+            t2 = tmp;
+        }
+        tMin = fmaxf(tMin, t1);
+        tMax = fminf(tMax, t2);
+        if (tMin > tMax)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+//----------------------------------------------------------------------------------
+// AABB Tree Functions Definition
+//----------------------------------------------------------------------------------
+void InitAABBTree(AABBTree *tree, float margin)
+{
+    *tree = (AABBTree){
+        .nodes = NULL,
+        .nodesCapacity = 0,
+        .nodesLen = 0,
+        .root = NULL_NODE,
+        .freeNode = NULL_NODE,
+        .margin = margin,
+    };
+}
+
+void UnloadAABBTree(AABBTree *tree)
+{
+    RL_FREE(tree->nodes);
+    RL_FREE(tree->moved);
+    RL_FREE(tree->pairs);
+    InitAABBTree(tree, tree->margin);
+}
+
+void ClearAABBTree(AABBTree *tree)
+{
+    for (int i = 0; i < tree->nodesCapacity; i++)
+    {
+        tree->nodes[i].parent = (i + 1 < tree->nodesCapacity) ? i + 1 : NULL_NODE;
+        tree->nodes[i].height = -1;
+    }
+    tree->freeNode = (tree->nodesCapacity > 0) ? 0 : NULL_NODE;
+    tree->nodesLen = 0;
+    tree->root = NULL_NODE;
+    tree->movedLen = 0;
+}
+
+int CreateAABBProxy(AABBTree *tree, AABB box, ID id)
+{
+    int proxy = AllocateNode(tree);
+    if (proxy == NULL_NODE)
+    {
+        return NULL_NODE;
+    }
+    tree->nodes[proxy].box = Expand(box, tree->margin);
+    tree->nodes[proxy].id = id;
+    InsertLeaf(tree, proxy);
+    BufferMove(tree, proxy);
+    return proxy;
+}
+
+void DestroyAABBProxy(AABBTree *tree, int proxy)
+{
+    for (int i = 0; i < tree->movedLen; i++)
+    {
+        if (tree->moved[i] == proxy)
+        {
+            tree->moved[i] = NULL_NODE;
+        }
+    }
+    RemoveLeaf(tree, proxy);
+    FreeNode(tree, proxy);
+}
+
+bool MoveAABBProxy(AABBTree *tree, int proxy, AABB box, Vector2 displacement)
+{
+    AABB fat = Expand(box, tree->margin);
+    Vector2 d = Vector2Scale(displacement, DISPLACEMENT_MULTIPLIER);
+    if (d.x < 0.0f) fat.min.x += d.x;
+    else fat.max.x += d.x;
+    if (d.y < 0.0f) fat.min.y += d.y;
+    else fat.max.y += d.y;
+
+    BufferMove(tree, proxy);
+    AABB treeBox = tree->nodes[proxy].box;
+    if (Contains(treeBox, box))
+    {
+        // still inside, unless the stored box has grown huge compared to what's needed
+        // (it was stretched by a fast throw and the body has since slowed down)
+        if (Contains(Expand(fat, 4.0f * tree->margin), treeBox))
+        {
+            return false;
+        }
+    }
+
+    RemoveLeaf(tree, proxy);
+    tree->nodes[proxy].box = fat;
+    InsertLeaf(tree, proxy);
+    return true;
+}
+
+ID GetAABBProxyID(const AABBTree *tree, int proxy)
+{
+    return tree->nodes[proxy].id;
+}
+
+AABB GetFatAABB(const AABBTree *tree, int proxy)
+{
+    return tree->nodes[proxy].box;
+}
+
+void QueryAABBTree(const AABBTree *tree, AABB box, AABBTreeQueryCallback callback, void *context)
+{
+    int stack[QUERY_STACK_SIZE];
+    int stackLen = 0;
+    if (tree->root != NULL_NODE)
+    {
+        stack[stackLen++] = tree->root;
+    }
+    while (stackLen > 0)
+    {
+        int node = stack[--stackLen];
+        const AABBTreeNode *n = &tree->nodes[node];
+        if (!AABBOverlaps(n->box, box))
+        {
+            continue;
+        }
+        if (n->child1 == NULL_NODE)
+        {
+            if (!callback(node, context))
+            {
+                return;
+            }
+        }
+        else if (stackLen + 2 <= QUERY_STACK_SIZE)
+        {
+            stack[stackLen++] = n->child1;
+            stack[stackLen++] = n->child2;
+        }
+    }
+}
+
+void RaycastAABBTree(const AABBTree *tree, Vector2 from, Vector2 to, AABBTreeRayCallback callback, void *context)
+{
+    float maxFraction = 1.0f;
+    int stack[QUERY_STACK_SIZE];
+    int stackLen = 0;
+    if (tree->root != NULL_NODE)
+    {
+        stack[stackLen++] = tree->root;
+    }
+    while (stackLen > 0)
+    {
+        int node = stack[--stackLen];
+        const AABBTreeNode *n = &tree->nodes[node];
+        if (!SegmentHitsBox(from, to, maxFraction, n->box))
+        {
+            continue;
+        }
+        if (n->child1 == NULL_NODE)
+        {
+            Vector2 clippedTo = Vector2Lerp(from, to, maxFraction);
+            float fraction = callback(node, from, clippedTo, context);
+            if (fraction == 0.0f)
+            {
+                return;
+            }
+            if (fraction > 0.0f && fraction < 1.0f)
+            {
+                maxFraction *= fraction;
+            }
+        }
+        else if (stackLen + 2 <= QUERY_STACK_SIZE)
+        {
+            stack[stackLen++] = n->child1;
+            stack[stackLen++] = n->child2;
+        }
+    }
+}
+
+void QueryAABBTreePairs(AABBTree *tree, AABBTreePairCallback callback, void *context)
+{
+    int stack[QUERY_STACK_SIZE];
+    int pairsLen = 0;
+    for (int i = 0; i < tree->movedLen; i++)
+    {
+        int moved = tree->moved[i];
+        if (moved == NULL_NODE)
+        {
+            continue;
+        }
+        AABB box = tree->nodes[moved].box;
+        int stackLen = 0;
+        stack[stackLen++] = tree->root;
+        while (stackLen > 0)
+        {
+            int node = stack[--stackLen];
+            const AABBTreeNode *n = &tree->nodes[node];
+            if (!AABBOverlaps(n->box, box))
+            {
+                continue;
+            }
+            if (n->child1 == NULL_NODE)
+            {
+                if ((node != moved) && GrowBuffer((void **)&tree->pairs, &tree->pairsCapacity, pairsLen + 1, sizeof(AABBPair)))
+                {
+                    tree->pairs[pairsLen++] = (AABBPair){ .proxyA = (node < moved) ? node : moved, .proxyB = (node < moved) ? moved : node };
+                }
+            }
+            else if (stackLen + 2 <= QUERY_STACK_SIZE)
+            {
+                stack[stackLen++] = n->child1;
+                stack[stackLen++] = n->child2;
+            }
+        }
+    }
+    tree->movedLen = 0;
+
+    // two moved proxies find each other twice. Sorted, each pair once and in an order that
+    // doesn't depend on the order they moved in
+    if (pairsLen > 1)
+    {
+        qsort(tree->pairs, (size_t)pairsLen, sizeof(AABBPair), ComparePairs);
+    }
+    for (int i = 0; i < pairsLen; i++)
+    {
+        if ((i > 0) && (ComparePairs(&tree->pairs[i], &tree->pairs[i - 1]) == 0))
+        {
+            continue;
+        }
+        callback(tree->pairs[i].proxyA, tree->pairs[i].proxyB, context);
+    }
+}
+
+AABB AABBFromCircle(Vector2 center, float radius)
+{
+    return (AABB){
+        .min = { center.x - radius, center.y - radius },
+        .max = { center.x + radius, center.y + radius },
+    };
+}
+
+bool AABBOverlaps(AABB a, AABB b)
+{
+    return a.min.x <= b.max.x && b.min.x <= a.max.x && a.min.y <= b.max.y && b.min.y <= a.max.y;
+}
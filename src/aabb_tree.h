@@ -0,0 +1,98 @@
+/**********************************************************************************************
+*
+*   Dynamic AABB tree, the broadphase for moving bodies (extinguishers)
+*
+*   Each proxy stores a fattened box so small movements don't touch the tree at all. When a
+*   body leaves its fat box it's reinserted with a new one stretched along its displacement.
+*   Leaves are inserted next to the sibling that grows the tree's total perimeter the least
+*   and the tree is kept balanced with rotations, so queries stay O(log n).
+*
+*   Proxies that are created or moved go in a move buffer, and QueryAABBTreePairs only looks
+*   for pairs involving those. Bodies nobody moves (asleep, or far from everything) cost
+*   nothing per step. There's no pair cache, so a body has to be moved, even by zero, every
+*   step it should keep colliding.
+*
+*   Based on the dynamic tree from Box2D by Erin Catto.
+*
+*   Copyright (c) 2022 creikey
+*
+**********************************************************************************************/
+
+#ifndef AABB_TREE_H
+#define AABB_TREE_H
+
+#include "raylib.h"
+#include "entities.h"
+
+//----------------------------------------------------------------------------------
+// Types and Structures Definition
+//----------------------------------------------------------------------------------
+typedef struct AABB
+{
+    Vector2 min;
+    Vector2 max;
+} AABB;
+
+typedef struct AABBTreeNode
+{
+    AABB box;       // fat box for leaves, union of the children otherwise
+    ID id;          // leaves only
+    int parent;     // next free node when the node is free
+    int child1;     // -1 for leaves
+    int child2;
+    int height;     // 0 for leaves, -1 when free
+} AABBTreeNode;
+
+typedef struct AABBTree
+{
+    AABBTreeNode *nodes;
+    int nodesCapacity;
+    int nodesLen;   // in use
+    int root;       // -1 when empty
+    int freeNode;
+    float margin;   // how much leaf boxes are fattened by
+    int *moved;     // proxies created or moved since the last pair query
+    int movedLen;
+    int movedCapacity;
+    struct AABBPair *pairs; // scratch for the pair query
+    int pairsCapacity;
+} AABBTree;
+
+// Return false to stop the query early
+typedef bool (*AABBTreeQueryCallback)(int proxy, void *context);
+// Called for each proxy whose box the ray crosses. Return the fraction along from->to where
+// the body was actually hit (to clip the ray), or a value >= 1 to keep going unclipped, or
+// 0 to stop
+typedef float (*AABBTreeRayCallback)(int proxy, Vector2 from, Vector2 to, void *context);
+// Called once per pair of proxies whose fat boxes overlap
+typedef void (*AABBTreePairCallback)(int proxyA, int proxyB, void *context);
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//----------------------------------------------------------------------------------
+// AABB Tree Functions Declaration
+//----------------------------------------------------------------------------------
+void InitAABBTree(AABBTree *tree, float margin);
+void UnloadAABBTree(AABBTree *tree);
+void ClearAABBTree(AABBTree *tree);     // drops every proxy, keeps the memory
+
+int CreateAABBProxy(AABBTree *tree, AABB box, ID id);
+void DestroyAABBProxy(AABBTree *tree, int proxy);
+bool MoveAABBProxy(AABBTree *tree, int proxy, AABB box, Vector2 displacement); // true if it was reinserted. Buffers it for the pair query either way
+ID GetAABBProxyID(const AABBTree *tree, int proxy);
+AABB GetFatAABB(const AABBTree *tree, int proxy);
+
+void QueryAABBTree(const AABBTree *tree, AABB box, AABBTreeQueryCallback callback, void *context);
+void RaycastAABBTree(const AABBTree *tree, Vector2 from, Vector2 to, AABBTreeRayCallback callback, void *context);
+void QueryAABBTreePairs(AABBTree *tree, AABBTreePairCallback callback, void *context);  // pairs with a buffered proxy in them, then empties the buffer
+
+AABB AABBFromCircle(Vector2 center, float radius);
+bool AABBOverlaps(AABB a, AABB b);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // AABB_TREE_H
@@ -0,0 +1,279 @@
+/**********************************************************************************************
+*
+*   Asset loader: files read and decoded on a worker thread, handed to the GPU and audio
+*   device on the main thread a few at a time
+*
+*   Copyright (c) 2022 creikey
+*
+**********************************************************************************************/
+
+#include "asset_loader.h"
+#include "worker_thread.h"
+#include <string.h>
+
+#define ASSET_MAX_PATH 256
+#define FONT_FIRST_CHAR 32      // what LoadFont uses for image fonts
+
+//----------------------------------------------------------------------------------
+// Types and Structures Definition
+//----------------------------------------------------------------------------------
+typedef enum AssetKind
+{
+    TextureAsset,
+    FontAsset,
+    SoundAsset,
+    LevelAsset,
+} AssetKind;
+
+typedef struct AssetLoad
+{
+    AssetKind kind;
+    char path[ASSET_MAX_PATH];
+    void *destination;      // a Texture, Font, Sound or LevelImage, by kind
+
+    // the worker's side, read by the main thread once decodedLen is past it
+    bool decoded;           // false if it couldn't be read
+    Image image;
+    Wave wave;
+    LevelImage level;
+} AssetLoad;
+
+//----------------------------------------------------------------------------------
+// Global Variables Definition
+//----------------------------------------------------------------------------------
+// Requests go on the end and the worker follows behind, so the only things shared are the
+// counts. An AssetLoad is the main thread's until it's below loadsLen, then the worker's
+// until it's below decodedLen, then the main thread's again
+static AssetLoad loads[MAX_ASSET_LOADS] = { 0 };
+static int loadsLen = 0;        // requested, stored by the main thread
+static int decodedLen = 0;      // stored by the worker
+static int uploadedLen = 0;     // main thread only
+static int workerDone = 0;      // the worker saw nothing left and returned
+static int cancelled = 0;       // the worker should stop at the next load
+static WorkerThread worker = { 0 };
+static bool workerRunning = false;
+
+//----------------------------------------------------------------------------------
+// Module Functions Definition (local)
+//----------------------------------------------------------------------------------
+// Runs on the worker. raylib's loaders only read files and decode into memory they
+// allocate, nothing that the main thread is using at the same time
+static void DecodeLoads(void *context)
+{
+    (void)context;
+    int i = decodedLen;
+    while ((i < LoadAcquire(&loadsLen)) && !LoadAcquire(&cancelled))
+    {
+        AssetLoad *load = &loads[i];
+        switch (load->kind)
+        {
+            case TextureAsset:
+            case FontAsset:
+            {
+                load->image = LoadImage(load->path);
+                load->decoded = load->image.data != NULL;
+            } break;
+            case SoundAsset:
+            {
+                load->wave = LoadWave(load->path);
+                load->decoded = load->wave.data != NULL;
+            } break;
+            case LevelAsset:
+            {
+                load->decoded = OpenLevelImage(load->path, &load->level);
+            } break;
+            default: break;
+        }
+        i += 1;
+        StoreRelease(&decodedLen, i);
+    }
+    StoreRelease(&workerDone, 1);
+}
+
+static void StartDecoding(void)
+{
+    StoreRelease(&workerDone, 0);
+    workerRunning = true;
+    if (!StartWorkerThread(&worker, DecodeLoads, NULL))
+    {
+        TraceLog(LOG_WARNING, "ASSETS: Failed to start the loader thread, loading on this one");
+        DecodeLoads(NULL);
+    }
+}
+
+// what the worker decoded, made into what was asked for
+static void HandOver(AssetLoad *load)
+{
+    if (!load->decoded)
+    {
+        TraceLog(LOG_WARNING, "ASSETS: [%s] Failed to load", load->path);
+        if (load->kind == FontAsset)
+        {
+            *(Font *)load->destination = GetFontDefault();
+        }
+        return;
+    }
+
+    switch (load->kind)
+    {
+        case TextureAsset:
+        {
+            *(Texture *)load->destination = LoadTextureFromImage(load->image);
+            UnloadImage(load->image);
+        } break;
+        case FontAsset:
+        {
+            Font font = LoadFontFromImage(load->image, MAGENTA, FONT_FIRST_CHAR);
+            UnloadImage(load->image);
+            *(Font *)load->destination = (font.texture.id != 0) ? font : GetFontDefault();
+        } break;
+        case SoundAsset:
+        {
+            *(Sound *)load->destination = LoadSoundFromWave(load->wave);
+            UnloadWave(load->wave);
+        } break;
+        case LevelAsset:
+        {
+            *(LevelImage *)load->destination = load->level;
+        } break;
+        default: break;
+    }
+}
+
+static void Discard(AssetLoad *load)
+{
+    if (!load->decoded)
+    {
+        return;
+    }
+    switch (load->kind)
+    {
+        case TextureAsset:
+        case FontAsset: UnloadImage(load->image); break;
+        case SoundAsset: UnloadWave(load->wave); break;
+        case LevelAsset: CloseLevelImage(&load->level); break;
+        default: break;
+    }
+}
+
+static bool Request(AssetKind kind, const char *path, void *destination)
+{
+    if (loadsLen == MAX_ASSET_LOADS)
+    {
+        TraceLog(LOG_WARNING, "ASSETS: [%s] Can't queue more than %i loads", path, MAX_ASSET_LOADS);
+        return false;
+    }
+    int len = (int)strlen(path);
+    if (len >= ASSET_MAX_PATH)
+    {
+        TraceLog(LOG_WARNING, "ASSETS: [%s] Path is too long to queue", path);
+        return false;
+    }
+
+    AssetLoad *load = &loads[loadsLen];
+    *load = (AssetLoad){ .kind = kind, .destination = destination };
+    memcpy(load->path, path, len + 1);
+    StoreRelease(&loadsLen, loadsLen + 1);
+
+    // a running worker picks it up. If it had already looked and is on its way out,
+    // UpdateAssetLoading starts it again once it's gone
+    if (!workerRunning)
+    {
+        StartDecoding();
+    }
+    return true;
+}
+
+//----------------------------------------------------------------------------------
+// Asset Loader Functions Definition
+//----------------------------------------------------------------------------------
+bool RequestTexture(const char *path, Texture *texture)
+{
+    return Request(TextureAsset, path, texture);
+}
+
+bool RequestFont(const char *path, Font *font)
+{
+    return Request(FontAsset, path, font);
+}
+
+bool RequestSound(const char *path, Sound *sound)
+{
+    return Request(SoundAsset, path, sound);
+}
+
+bool RequestLevelImage(const char *path, LevelImage *image)
+{
+    return Request(LevelAsset, path, image);
+}
+
+void UpdateAssetLoading(double budget)
+{
+    if (workerRunning && LoadAcquire(&workerDone))
+    {
+        JoinWorkerThread(&worker);
+        workerRunning = false;
+    }
+    int decoded = LoadAcquire(&decodedLen);
+    if (!workerRunning && (decoded < loadsLen))
+    {
+        StartDecoding();
+    }
+
+    double start = GetTime();
+    while (uploadedLen < decoded)
+    {
+        HandOver(&loads[uploadedLen]);
+        uploadedLen += 1;
+        if (GetTime() - start >= budget)
+        {
+            break;
+        }
+    }
+
+    if (!workerRunning && (uploadedLen == loadsLen))
+    {
+        loadsLen = 0;
+        decodedLen = 0;
+        uploadedLen = 0;
+    }
+}
+
+void FinishAssetLoading(void)
+{
+    while (!IsAssetLoadingDone())
+    {
+        JoinWorkerThread(&worker);
+        UpdateAssetLoading(1e9);
+    }
+}
+
+void UnloadAssetLoading(void)
+{
+    StoreRelease(&cancelled, 1);
+    JoinWorkerThread(&worker);
+    workerRunning = false;
+    for (int i = uploadedLen; i < decodedLen; i++)
+    {
+        Discard(&loads[i]);
+    }
+    loadsLen = 0;
+    decodedLen = 0;
+    uploadedLen = 0;
+    cancelled = 0;
+}
+
+bool IsAssetLoadingDone(void)
+{
+    return loadsLen == 0;
+}
+
+float GetAssetLoadingProgress(void)
+{
+    if (loadsLen == 0)
+    {
+        return 1.0f;
+    }
+    // reading is most of the work, handing over is quick but not free
+    return (3.0f*(float)LoadAcquire(&decodedLen) + (float)uploadedLen)/(4.0f*(float)loadsLen);
+}
@@ -0,0 +1,51 @@
+/**********************************************************************************************
+*
+*   Asset loader: files read and decoded on a worker thread, handed to the GPU and audio
+*   device on the main thread a few at a time
+*
+*   Request* queues a load and returns right away. A worker reads and decodes the files in
+*   the order they were requested, PNG to pixels, WAV to samples, levels mapped and their
+*   checksum checked. Only the main thread can talk to OpenGL and the audio device, so
+*   UpdateAssetLoading, called once a frame, turns what's been decoded into textures and
+*   sounds until the frame's budget is spent. Each result is written to where the request
+*   said once it's ready, until then it's left as it was.
+*
+*   So a screen can queue what it needs when the transition to it starts, the fade keeps
+*   drawing while the worker reads, and the window never stops answering.
+*
+*   Copyright (c) 2022 creikey
+*
+**********************************************************************************************/
+
+#ifndef ASSET_LOADER_H
+#define ASSET_LOADER_H
+
+#include "raylib.h"
+#include "level_file.h"
+
+#define MAX_ASSET_LOADS 32          // requested and not yet finished at once
+#define ASSET_UPLOAD_BUDGET 0.004   // seconds a frame spends on uploads, at least one goes each frame
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//----------------------------------------------------------------------------------
+// Asset Loader Functions Declaration
+//----------------------------------------------------------------------------------
+bool RequestTexture(const char *path, Texture *texture);    // false if there's no room, nothing's written then
+bool RequestFont(const char *path, Font *font);             // an image font like LoadFont takes, the default font if it fails
+bool RequestSound(const char *path, Sound *sound);
+bool RequestLevelImage(const char *path, LevelImage *image);    // left zeroed if it doesn't open, see LoadOpenedLevel
+
+void UpdateAssetLoading(double budget);     // uploads what's decoded, a frame's worth
+void FinishAssetLoading(void);              // waits for and uploads everything requested
+void UnloadAssetLoading(void);              // waits for the worker and drops what wasn't handed over yet
+bool IsAssetLoadingDone(void);
+float GetAssetLoadingProgress(void);        // 0 to 1 over what's been requested since it was last done
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // ASSET_LOADER_H
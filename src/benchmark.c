@@ -0,0 +1,357 @@
+/**********************************************************************************************
+*
+*   Benchmark: replays a fixed input script on the saved level and on scaled up copies of
+*   it, timing every phase of every tick and frame, and prints percentiles as JSON
+*
+*   usage: benchmark [-replay file] [-level file] [-scales 1,2,4] [-o results.json]
+*
+*   A scale of n tiles everything in the level but the player n by n times. Times are in
+*   microseconds. Built twice: benchmark links raylib and also times drawing the gameplay
+*   screen in a hidden window, benchmark_headless only times the simulation.
+*
+*   Copyright (c) 2022 creikey
+*
+**********************************************************************************************/
+
+#include "raylib.h"
+#include "entities.h"
+#include "simulation.h"
+#include "replay.h"
+#if defined(BENCHMARK_DRAW)
+    #include "screens.h"
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define MAX_SCALES 8
+#define RENDER_FPS 60   // the draw phase runs once every SIM_TICK_RATE/RENDER_FPS ticks
+
+#if defined(BENCHMARK_DRAW)
+// screens.h expects these from raylib_game.c
+GameScreen currentScreen = GAMEPLAY;
+Font font = { 0 };
+Music music = { 0 };
+Sound fxCoin = { 0 };
+#endif
+
+typedef enum
+{
+    PHASE_ENTITIES = 0,
+    PHASE_PARTICLES,
+    PHASE_DRAW,
+    PHASE_COUNT
+} Phase;
+
+static const char *phaseNames[PHASE_COUNT] = { "entities", "particles", "draw" };
+
+typedef struct PhaseSamples
+{
+    double *samples;    // microseconds
+    int len;
+    int capacity;
+} PhaseSamples;
+
+//----------------------------------------------------------------------------------
+// Module Functions Definition
+//----------------------------------------------------------------------------------
+static double Now(void)
+{
+    struct timespec ts = { 0 };
+    timespec_get(&ts, TIME_UTC);
+    return (double)ts.tv_sec + (double)ts.tv_nsec*1e-9;
+}
+
+static int CompareDoubles(const void *a, const void *b)
+{
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static double Percentile(const double *sorted, int len, double p)
+{
+    int index = (int)(p*(len - 1) + 0.5);
+    return sorted[index];
+}
+
+// cut short to fit, paths come from the command line
+static void CopyLevelPath(char *to, const char *level)
+{
+    int len = (int)strlen(level);
+    len = (len < SIM_MAX_LEVEL_PATH - 1) ? len : SIM_MAX_LEVEL_PATH - 1;
+    memcpy(to, level, len);
+    to[len] = '\0';
+}
+
+static void AddSample(PhaseSamples *phase, double seconds)
+{
+    if (phase->len < phase->capacity)
+    {
+        phase->samples[phase->len++] = seconds*1e6;
+    }
+}
+
+static void OffsetEntity(Entity *e, Vector2 by)
+{
+    switch (e->type)
+    {
+    case Obstacle: e->obstacle.x += by.x; e->obstacle.y += by.y; break;
+    case Ground: e->ground.x += by.x; e->ground.y += by.y; break;
+    case Fire: e->fire.rect.x += by.x; e->fire.rect.y += by.y; break;
+    case Extinguisher: e->extinguisher.info.pos.x += by.x; e->extinguisher.info.pos.y += by.y; break;
+    case HelpText: e->help.pos.x += by.x; e->help.pos.y += by.y; break;
+    default: break;
+    }
+}
+
+// Tiles everything but the player scale by scale times, side by side, and saves it to path
+static bool BuildScaledLevel(const char *level, int scale, const char *path)
+{
+    RestartSimulation(level, 1);
+    StopLevelStreaming();   // copies of all of it, not just what's around the player
+
+    Rectangle bounds = { 0 };
+    bool first = true;
+    for (int i = 0; i < entitiesLen; i++)
+    {
+        Rectangle r = { 0 };
+        switch (entities[i].type)
+        {
+        case Obstacle:
+        case Ground: r = entities[i].ground; break;
+        case Fire: r = entities[i].fire.rect; break;
+        case Extinguisher: r = (Rectangle){ entities[i].extinguisher.info.pos.x, entities[i].extinguisher.info.pos.y, 0.0f, 0.0f }; break;
+        case HelpText: r = (Rectangle){ entities[i].help.pos.x, entities[i].help.pos.y, 0.0f, 0.0f }; break;
+        default: continue;
+        }
+        if (first)
+        {
+            bounds = r;
+            first = false;
+            continue;
+        }
+        float right = (bounds.x + bounds.width > r.x + r.width) ? bounds.x + bounds.width : r.x + r.width;
+        float bottom = (bounds.y + bounds.height > r.y + r.height) ? bounds.y + bounds.height : r.y + r.height;
+        bounds.x = (bounds.x < r.x) ? bounds.x : r.x;
+        bounds.y = (bounds.y < r.y) ? bounds.y : r.y;
+        bounds.width = right - bounds.x;
+        bounds.height = bottom - bounds.y;
+    }
+
+    int originalLen = entitiesLen;
+    for (int y = 0; y < scale; y++)
+    {
+        for (int x = 0; x < scale; x++)
+        {
+            if ((x == 0) && (y == 0))
+            {
+                continue;
+            }
+            Vector2 offset = { x*(bounds.width + 500.0f), y*(bounds.height + 500.0f) };
+            for (int i = 0; i < originalLen; i++)
+            {
+                Entity copy = entities[i];  // AddEntity may move entities
+                if ((copy.type == Player) || (copy.type == Tombstone))
+                {
+                    continue;
+                }
+                OffsetEntity(&copy, offset);
+                if (AddEntity(copy) == NULL)
+                {
+                    return false;
+                }
+            }
+        }
+    }
+
+    SaveEntities(path);
+    return true;
+}
+
+static void WritePhase(FILE *out, const char *name, PhaseSamples *phase, bool last)
+{
+    if (phase->len == 0)
+    {
+        return;
+    }
+    double sum = 0.0;
+    for (int i = 0; i < phase->len; i++)
+    {
+        sum += phase->samples[i];
+    }
+    qsort(phase->samples, phase->len, sizeof(double), CompareDoubles);
+    fprintf(out, "        \"%s\": { \"samples\": %i, \"mean\": %.3f, \"p50\": %.3f, \"p90\": %.3f, \"p99\": %.3f, \"max\": %.3f }%s\n",
+        name, phase->len, sum/phase->len,
+        Percentile(phase->samples, phase->len, 0.5), Percentile(phase->samples, phase->len, 0.9),
+        Percentile(phase->samples, phase->len, 0.99), phase->samples[phase->len - 1], last ? "" : ",");
+}
+
+// Plays the replay on whatever level it points at, timing each phase
+static void RunBenchmark(Replay *replay, PhaseSamples *phases)
+{
+    const int ticksPerFrame = (SIM_TICK_RATE/RENDER_FPS > 0) ? SIM_TICK_RATE/RENDER_FPS : 1;
+    const float delta = 1.0f/SIM_TICK_RATE;
+
+    ReplayCursor cursor = BeginReplayPlayback(replay);
+#if defined(BENCHMARK_DRAW)
+    SnapGameplayCamera();
+#endif
+    SimInput input = { 0 };
+    for (int tick = 0; NextReplayInput(&cursor, &input); tick++)
+    {
+        double start = Now();
+        UpdateSimulationEntities(&input, delta);
+        double entitiesDone = Now();
+        UpdateSimulationParticles(delta);
+        double particlesDone = Now();
+        AddSample(&phases[PHASE_ENTITIES], entitiesDone - start);
+        AddSample(&phases[PHASE_PARTICLES], particlesDone - entitiesDone);
+
+#if defined(BENCHMARK_DRAW)
+        if ((tick % ticksPerFrame) == ticksPerFrame - 1)
+        {
+            SetGameplayInterpolation(1.0f);
+            SnapGameplayCamera();
+            double drawStart = Now();
+            BeginDrawing();
+            ClearBackground(RAYWHITE);
+            DrawGameplayScreen();
+            EndDrawing();
+            AddSample(&phases[PHASE_DRAW], Now() - drawStart);
+        }
+#else
+        (void)ticksPerFrame;
+#endif
+    }
+}
+
+int main(int argc, char **argv)
+{
+    const char *replayPath = "resources/benchmark.replay";
+    const char *level = NULL;
+    const char *outPath = NULL;
+    int scales[MAX_SCALES] = { 1, 2, 4 };
+    int scalesLen = 3;
+
+    for (int i = 1; i + 1 < argc; i += 2)
+    {
+        if (strcmp(argv[i], "-replay") == 0) replayPath = argv[i + 1];
+        else if (strcmp(argv[i], "-level") == 0) level = argv[i + 1];
+        else if (strcmp(argv[i], "-o") == 0) outPath = argv[i + 1];
+        else if (strcmp(argv[i], "-scales") == 0)
+        {
+            scalesLen = 0;
+            char *next = argv[i + 1];
+            while ((*next != '\0') && (scalesLen < MAX_SCALES))
+            {
+                int scale = (int)strtol(next, &next, 10);
+                if (scale > 0) scales[scalesLen++] = scale;
+                if (*next == ',') next++;
+                else break;
+            }
+        }
+        else
+        {
+            fprintf(stderr, "usage: %s [-replay file] [-level file] [-scales 1,2,4] [-o results.json]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    SetTraceLogLevel(LOG_WARNING);
+
+    Replay replay = { 0 };
+    if (!LoadReplay(&replay, replayPath))
+    {
+        fprintf(stderr, "couldn't load replay %s\n", replayPath);
+        return 1;
+    }
+    char baseLevel[SIM_MAX_LEVEL_PATH] = { 0 };
+    CopyLevelPath(baseLevel, (level != NULL) ? level : replay.level);
+
+#if defined(BENCHMARK_DRAW)
+    SetConfigFlags(FLAG_WINDOW_HIDDEN);
+    InitWindow(900, 900, "benchmark");
+    InitGameplayScreen();
+#endif
+
+    FILE *out = (outPath != NULL) ? fopen(outPath, "w") : stdout;
+    if (out == NULL)
+    {
+        fprintf(stderr, "couldn't open %s\n", outPath);
+        return 1;
+    }
+
+    PhaseSamples phases[PHASE_COUNT] = { 0 };
+    for (int i = 0; i < PHASE_COUNT; i++)
+    {
+        // LoadReplay checked the spans add up to ticks, and AddSample won't go past it anyway
+        phases[i].samples = RL_MALLOC(sizeof(double)*(replay.ticks + 1));
+        phases[i].capacity = (phases[i].samples != NULL) ? replay.ticks + 1 : 0;
+    }
+
+    fprintf(out, "{\n  \"replay\": \"%s\",\n  \"ticks\": %i,\n  \"tickRate\": %i,\n  \"unit\": \"us\",\n  \"levels\": [\n",
+        replayPath, replay.ticks, SIM_TICK_RATE);
+    int levelsWritten = 0;
+    for (int s = 0; s < scalesLen; s++)
+    {
+        char scaledPath[SIM_MAX_LEVEL_PATH] = { 0 };
+        if (scales[s] == 1)
+        {
+            CopyLevelPath(replay.level, baseLevel);
+        }
+        else
+        {
+            snprintf(scaledPath, sizeof(scaledPath), "benchmark_%ix%i.level", scales[s], scales[s]);
+            if (!BuildScaledLevel(baseLevel, scales[s], scaledPath))
+            {
+                fprintf(stderr, "couldn't build the %ix%i level\n", scales[s], scales[s]);
+                continue;
+            }
+            CopyLevelPath(replay.level, scaledPath);
+        }
+
+        for (int i = 0; i < PHASE_COUNT; i++)
+        {
+            phases[i].len = 0;
+        }
+        RunBenchmark(&replay, phases);
+
+        // the comma goes before an entry, a scale that failed to build leaves none behind
+        fprintf(out, "%s    {\n      \"level\": \"%s\",\n      \"scale\": %i,\n      \"entities\": %i,\n      \"deaths\": %i,\n      \"phases\": {\n",
+            (levelsWritten > 0) ? ",\n" : "", baseLevel, scales[s], GetEntityStoreUsage().count, GetSimulationStats().deaths);
+        int lastPhase = (phases[PHASE_DRAW].len > 0) ? PHASE_DRAW : PHASE_PARTICLES;
+        for (int i = 0; i <= lastPhase; i++)
+        {
+            WritePhase(out, phaseNames[i], &phases[i], i == lastPhase);
+        }
+        fprintf(out, "      }\n    }");
+        levelsWritten += 1;
+
+        if (scaledPath[0] != '\0')
+        {
+            remove(scaledPath);
+        }
+    }
+    fprintf(out, "\n  ]\n}\n");
+
+    if (out != stdout)
+    {
+        fclose(out);
+    }
+    for (int i = 0; i < PHASE_COUNT; i++)
+    {
+        RL_FREE(phases[i].samples);
+    }
+    UnloadReplay(&replay);
+
+#if defined(BENCHMARK_DRAW)
+    UnloadGameplayScreen();
+    CloseWindow();
+#else
+    UnloadSimulation();
+#endif
+
+    return 0;
+}
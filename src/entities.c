@@ -0,0 +1,555 @@
+/**********************************************************************************************
+*
+*   Entity storage: dense entity array plus a generational handle table
+*
+*   Both arrays are single heap blocks that double when they fill up, so adding is amortized
+*   O(1), there's no allocation per entity and the only limit is the 20 bit handle index.
+*
+*   Copyright (c) 2022 creikey
+*
+**********************************************************************************************/
+
+#include "entities.h"
+#include "spatial_grid.h"
+#include "aabb_tree.h"
+#include <stddef.h>
+#include <stdlib.h>
+
+#define MIN_ENTITIES_CAPACITY 256
+#define GENERATION_MASK 0xFFF
+#define GRID_CELL_SIZE 128.0f
+#define BODY_MARGIN 10.0f
+#define MAX_ENTITY_CHANGES 1024   // grid rects remembered for GetEntityChanges
+
+// Where a handle's entity lives. When the slot is free index is the next free slot
+typedef struct EntitySlot
+{
+    int index;
+    unsigned int generation;
+} EntitySlot;
+
+// a grid rect that was added, removed or moved away from, and the store version it happened at
+typedef struct EntityChange
+{
+    unsigned int version;
+    enum Type type;
+    Rectangle rect;
+} EntityChange;
+
+//----------------------------------------------------------------------------------
+// Global Variables Definition
+//----------------------------------------------------------------------------------
+Entity *entities = NULL;
+int entitiesLen = 0;
+
+//----------------------------------------------------------------------------------
+// Module Variables Definition (local)
+//----------------------------------------------------------------------------------
+static int entitiesCapacity = 0;
+static EntitySlot *slots = NULL;
+static int slotsLen = 0;
+static int slotsCapacity = 0;
+static int freeSlot = -1;  // head of the free list, -1 when empty
+static int tombstonesLen = 0;
+static ID playerID = { 0 };
+
+static EntityComponents components = { 0 };
+static bool componentsStale = true;
+static unsigned int storeVersion = 0;
+static int obstaclesCapacity = 0;
+static int fireRectsCapacity = 0;
+static int fireIDsCapacity = 0;
+static int extinguishersCapacity = 0;
+
+static SpatialGrid grid = { 0 };
+static EntityChange changes[MAX_ENTITY_CHANGES];   // a ring, oldest at changesStart
+static int changesStart = 0;
+static int changesLen = 0;
+static unsigned int changesFrom = 0;   // versions before this may have changes that were dropped
+static AABBTree bodies = { 0 };
+static bool bodiesInitialized = false;
+
+//----------------------------------------------------------------------------------
+// Module Functions Definition (local)
+//----------------------------------------------------------------------------------
+
+// bumps the generation so every handle to this slot goes stale, then frees it
+static void ReleaseSlot(int slot)
+{
+    slots[slot].generation = (slots[slot].generation + 1) & GENERATION_MASK;
+    if (slots[slot].generation == 0)
+    {
+        slots[slot].generation = 1;
+    }
+    slots[slot].index = freeSlot;
+    freeSlot = slot;
+}
+
+// grows an array to hold at least wanted elements, doubling so repeated adds stay amortized O(1)
+static bool GrowArray(void **array, int *capacity, int wanted, int elementSize)
+{
+    if (wanted <= *capacity)
+    {
+        return true;
+    }
+    int newCapacity = (*capacity < MIN_ENTITIES_CAPACITY) ? MIN_ENTITIES_CAPACITY : *capacity;
+    while (newCapacity < wanted)
+    {
+        newCapacity *= 2;
+    }
+    void *newArray = RL_REALLOC(*array, (size_t)newCapacity * elementSize);
+    if (newArray == NULL)
+    {
+        TraceLog(LOG_ERROR, "ENTITIES: Failed to grow storage to %i elements", newCapacity);
+        return false;
+    }
+    *array = newArray;
+    *capacity = newCapacity;
+    return true;
+}
+
+// the rect static geometry is filed under in the grid, false for types that aren't in it
+static bool GetGridRect(const Entity *e, Rectangle *rect)
+{
+    switch (e->type)
+    {
+    case Obstacle:
+        *rect = e->obstacle;
+        return true;
+    case Ground:
+        *rect = e->ground;
+        return true;
+    case Fire:
+        *rect = e->fire.rect;
+        return true;
+    case HelpText:
+        *rect = (Rectangle){ e->help.pos.x, e->help.pos.y, 0.0f, 0.0f };   // how far it reaches depends on the font
+        return true;
+    default:
+        return false;
+    }
+}
+
+// obstacles, grounds and fires are stored with width and height never negative
+static void NormalizeEntityRect(Entity *e)
+{
+    if (e->type == Fire)
+    {
+        e->fire.rect = FixNegativeRect(e->fire.rect);
+    }
+    else if ((e->type == Obstacle) || (e->type == Ground))
+    {
+        e->ground = FixNegativeRect(e->ground);
+    }
+}
+
+// after storeVersion was bumped for it
+static void NoteEntityChange(enum Type type, Rectangle rect)
+{
+    if (changesLen == MAX_ENTITY_CHANGES)
+    {
+        changesFrom = changes[changesStart].version;
+        changesStart = (changesStart + 1) % MAX_ENTITY_CHANGES;
+        changesLen -= 1;
+    }
+    changes[(changesStart + changesLen) % MAX_ENTITY_CHANGES] = (EntityChange){ storeVersion, type, rect };
+    changesLen += 1;
+}
+
+// everything changed, there's nothing to patch from
+static void ForgetEntityChanges(void)
+{
+    changesStart = 0;
+    changesLen = 0;
+    changesFrom = storeVersion;
+}
+
+// one pass over entities[] sorting them into the per-type arrays
+static void RebuildComponents(void)
+{
+    EntityComponents *c = &components;
+    c->obstaclesLen = 0;
+    c->firesLen = 0;
+    c->extinguishersLen = 0;
+    for (int i = 0; i < entitiesLen; i++)
+    {
+        Entity *e = &entities[i];
+        switch (e->type)
+        {
+        case Obstacle:
+        {
+            if (GrowArray((void **)&c->obstacleRects, &obstaclesCapacity, c->obstaclesLen + 1, sizeof(Rectangle)))
+            {
+                c->obstacleRects[c->obstaclesLen++] = e->obstacle;
+            }
+            break;
+        }
+        case Fire:
+        {
+            if (GrowArray((void **)&c->fireRects, &fireRectsCapacity, c->firesLen + 1, sizeof(Rectangle)) &&
+                GrowArray((void **)&c->fireIDs, &fireIDsCapacity, c->firesLen + 1, sizeof(ID)))
+            {
+                c->fireRects[c->firesLen] = e->fire.rect;
+                c->fireIDs[c->firesLen] = e->id;
+                c->firesLen++;
+            }
+            break;
+        }
+        case Extinguisher:
+        {
+            if (GrowArray((void **)&c->extinguisherIDs, &extinguishersCapacity, c->extinguishersLen + 1, sizeof(ID)))
+            {
+                c->extinguisherIDs[c->extinguishersLen++] = e->id;
+            }
+            break;
+        }
+        default:
+            break;
+        }
+    }
+    componentsStale = false;
+}
+
+//----------------------------------------------------------------------------------
+// Entity Storage Functions Definition
+//----------------------------------------------------------------------------------
+bool IDEquals(ID a, ID b)
+{
+    return a.index == b.index && a.generation == b.generation;
+}
+
+int GetEntityIndex(ID id)
+{
+    if (id.generation == 0 || (int)id.index >= slotsLen)
+    {
+        return -1;
+    }
+    if (slots[id.index].generation != id.generation)
+    {
+        return -1;
+    }
+    return slots[id.index].index;
+}
+
+// null if entity doesn't exist
+Entity *GetEntity(ID id)
+{
+    int index = GetEntityIndex(id);
+    if (index == -1)
+    {
+        return NULL;
+    }
+    return &entities[index];
+}
+
+// null if player not in entities
+Entity *GetPlayerEntity(void)
+{
+    return GetEntity(playerID);
+}
+
+bool ReserveEntities(int capacity)
+{
+    if (capacity > MAX_ENTITY_SLOTS)
+    {
+        TraceLog(LOG_WARNING, "ENTITIES: Can't reserve %i entities, the limit is %i", capacity, MAX_ENTITY_SLOTS);
+        capacity = MAX_ENTITY_SLOTS;
+    }
+    return GrowArray((void **)&entities, &entitiesCapacity, capacity, sizeof(Entity)) &&
+           GrowArray((void **)&slots, &slotsCapacity, capacity, sizeof(EntitySlot));
+}
+
+Entity *AddEntity(Entity e)
+{
+    if (freeSlot == -1 && slotsLen >= MAX_ENTITY_SLOTS)
+    {
+        TraceLog(LOG_WARNING, "ENTITIES: Out of handles, can't have more than %i entities", MAX_ENTITY_SLOTS);
+        return NULL;
+    }
+    if (!GrowArray((void **)&entities, &entitiesCapacity, entitiesLen + 1, sizeof(Entity)) ||
+        !GrowArray((void **)&slots, &slotsCapacity, slotsLen + 1, sizeof(EntitySlot)))
+    {
+        return NULL;
+    }
+
+    int slot = freeSlot;
+    if (slot != -1)
+    {
+        freeSlot = slots[slot].index;
+    }
+    else
+    {
+        slot = slotsLen;
+        slotsLen += 1;
+        slots[slot].generation = 1;
+    }
+    slots[slot].index = entitiesLen;
+
+    e.id = (ID){ .index = (unsigned int)slot, .generation = slots[slot].generation };
+    if (e.type == Player)
+    {
+        playerID = e.id;
+    }
+    NormalizeEntityRect(&e);
+    Rectangle rect;
+    bool inGrid = GetGridRect(&e, &rect);
+    if (inGrid)
+    {
+        InsertSpatialGrid(GetEntityGrid(), e.id, e.type, rect);
+    }
+    if (e.type == Extinguisher)
+    {
+        e.extinguisher.proxy = CreateAABBProxy(GetBodyTree(), AABBFromCircle(e.extinguisher.info.pos, BODY_RADIUS), e.id);
+    }
+    entities[entitiesLen] = e;
+    entitiesLen += 1;
+    componentsStale = true;
+    storeVersion += 1;
+    if (inGrid)
+    {
+        NoteEntityChange(e.type, rect);
+    }
+    return &entities[entitiesLen - 1];
+}
+
+void DeleteEntityIndex(int index)
+{
+    if (entities[index].type == Tombstone)
+    {
+        return;
+    }
+    Rectangle rect;
+    bool inGrid = GetGridRect(&entities[index], &rect);
+    if (inGrid)
+    {
+        RemoveSpatialGrid(GetEntityGrid(), entities[index].id, rect);
+    }
+    if (entities[index].type == Extinguisher)
+    {
+        DestroyAABBProxy(GetBodyTree(), entities[index].extinguisher.proxy);
+    }
+    enum Type type = entities[index].type;
+    ReleaseSlot(entities[index].id.index);
+    entities[index].type = Tombstone;
+    tombstonesLen += 1;
+    componentsStale = true;
+    storeVersion += 1;
+    if (inGrid)
+    {
+        NoteEntityChange(type, rect);
+    }
+}
+
+void DeleteEntity(ID id)
+{
+    int index = GetEntityIndex(id);
+    if (index != -1)
+    {
+        DeleteEntityIndex(index);
+    }
+}
+
+void CompactEntities(void)
+{
+    if (tombstonesLen == 0)
+    {
+        return;
+    }
+    int newLen = 0;
+    for (int i = 0; i < entitiesLen; i++)
+    {
+        if (entities[i].type == Tombstone)
+        {
+            continue;
+        }
+        if (newLen != i)
+        {
+            entities[newLen] = entities[i];
+            slots[entities[newLen].id.index].index = newLen;
+        }
+        newLen += 1;
+    }
+    entitiesLen = newLen;
+    tombstonesLen = 0;
+}
+
+void ClearEntities(void)
+{
+    for (int i = 0; i < entitiesLen; i++)
+    {
+        // tombstones already gave their slot back
+        if (entities[i].type != Tombstone)
+        {
+            ReleaseSlot(entities[i].id.index);
+        }
+    }
+    entitiesLen = 0;
+    tombstonesLen = 0;
+    playerID = NULL_ID;
+    componentsStale = true;
+    storeVersion += 1;
+    ForgetEntityChanges();
+    if (grid.buckets != NULL)
+    {
+        ClearSpatialGrid(&grid);
+    }
+    if (bodiesInitialized)
+    {
+        ClearAABBTree(&bodies);
+    }
+}
+
+void UnloadEntities(void)
+{
+    RL_FREE(entities);
+    RL_FREE(slots);
+    entities = NULL;
+    slots = NULL;
+    entitiesLen = 0;
+    entitiesCapacity = 0;
+    slotsLen = 0;
+    slotsCapacity = 0;
+    freeSlot = -1;
+    tombstonesLen = 0;
+    playerID = NULL_ID;
+
+    RL_FREE(components.obstacleRects);
+    RL_FREE(components.fireRects);
+    RL_FREE(components.fireIDs);
+    RL_FREE(components.extinguisherIDs);
+    components = (EntityComponents){ 0 };
+    obstaclesCapacity = 0;
+    fireRectsCapacity = 0;
+    fireIDsCapacity = 0;
+    extinguishersCapacity = 0;
+    componentsStale = true;
+    storeVersion += 1;
+    ForgetEntityChanges();
+
+    UnloadSpatialGrid(&grid);
+    UnloadAABBTree(&bodies);
+    bodiesInitialized = false;
+}
+
+void SetEntityRect(ID id, Rectangle rect)
+{
+    Entity *e = GetEntity(id);
+    Rectangle old;
+    if (e == NULL || !GetGridRect(e, &old))
+    {
+        return;
+    }
+    RemoveSpatialGrid(GetEntityGrid(), id, old);
+    rect = FixNegativeRect(rect);
+    if (e->type == Fire)
+    {
+        e->fire.rect = rect;
+    }
+    else
+    {
+        e->obstacle = rect;
+    }
+    InsertSpatialGrid(GetEntityGrid(), id, e->type, rect);
+    componentsStale = true;
+    storeVersion += 1;
+    NoteEntityChange(e->type, old);
+    NoteEntityChange(e->type, rect);
+}
+
+struct SpatialGrid *GetEntityGrid(void)
+{
+    if (grid.buckets == NULL)
+    {
+        InitSpatialGrid(&grid, GRID_CELL_SIZE);
+    }
+    return &grid;
+}
+
+void UpdateEntityBody(Entity *e, Vector2 displacement)
+{
+    if (e->type == Extinguisher)
+    {
+        MoveAABBProxy(GetBodyTree(), e->extinguisher.proxy, AABBFromCircle(e->extinguisher.info.pos, BODY_RADIUS), displacement);
+    }
+}
+
+// Same tree a fresh load would build, so a reset level collides exactly like a reloaded one
+void ResetEntityBodies(void)
+{
+    ClearAABBTree(GetBodyTree());
+    for (int i = 0; i < entitiesLen; i++)
+    {
+        if (entities[i].type == Extinguisher)
+        {
+            entities[i].extinguisher.proxy = CreateAABBProxy(GetBodyTree(), AABBFromCircle(entities[i].extinguisher.info.pos, BODY_RADIUS), entities[i].id);
+        }
+    }
+}
+
+struct AABBTree *GetBodyTree(void)
+{
+    if (!bodiesInitialized)
+    {
+        InitAABBTree(&bodies, BODY_MARGIN);
+        bodiesInitialized = true;
+    }
+    return &bodies;
+}
+
+const EntityComponents *GetEntityComponents(void)
+{
+    if (componentsStale)
+    {
+        RebuildComponents();
+    }
+    return &components;
+}
+
+Rectangle FixNegativeRect(Rectangle rect)
+{
+    if (rect.width < 0.0)
+    {
+        rect.x += rect.width;
+        rect.width *= -1.0;
+    }
+    if (rect.height < 0.0)
+    {
+        rect.y += rect.height;
+        rect.height *= -1.0;
+    }
+    return rect;
+}
+
+unsigned int GetEntityStoreVersion(void)
+{
+    return storeVersion;
+}
+
+bool GetEntityChanges(unsigned int since, EntityChangeFunc func, void *context)
+{
+    // the subtractions keep the order right when the version wraps
+    if ((storeVersion - since) > (storeVersion - changesFrom))
+    {
+        return false;
+    }
+    for (int i = 0; i < changesLen; i++)
+    {
+        const EntityChange *change = &changes[(changesStart + i) % MAX_ENTITY_CHANGES];
+        if ((storeVersion - change->version) < (storeVersion - since))
+        {
+            func(change->type, change->rect, context);
+        }
+    }
+    return true;
+}
+
+EntityStoreUsage GetEntityStoreUsage(void)
+{
+    return (EntityStoreUsage){
+        .count = entitiesLen - tombstonesLen,
+        .tombstones = tombstonesLen,
+        .capacity = entitiesCapacity,
+        .maxEntities = MAX_ENTITY_SLOTS,
+        .bytes = (size_t)entitiesCapacity * sizeof(Entity) + (size_t)slotsCapacity * sizeof(EntitySlot),
+    };
+}
@@ -0,0 +1,188 @@
+/**********************************************************************************************
+*
+*   Entity types and storage shared by the gameplay screen
+*
+*   Entities live in one array (iteration order == insertion order). They are referred to
+*   by ID handles which go through a slot table, so looking one up is O(1) and a handle to
+*   an entity that has since been deleted is detected instead of aliasing whatever moved
+*   into its place.
+*
+*   Deleting only turns the entity into a Tombstone, which every type switch already skips.
+*   CompactEntities squeezes the tombstones out in one stable pass, so insertion order (and
+*   with it draw order) survives any number of deletes.
+*
+*   The physics and collision loops don't walk entities[] at all, they ask the spatial grid
+*   of obstacle/ground/fire rects which the store keeps up to date as entities come and go.
+*   Extinguishers move, so they live in a dynamic AABB tree instead. The few passes that want
+*   every obstacle, fire or extinguisher use the dense lists in EntityComponents.
+*
+*   Obstacle, ground and fire rects are normalized on the way in, by AddEntity (so loading
+*   an old level with rects drawn backwards fixes them) and SetEntityRect. Their width and
+*   height are never negative, so nothing that reads them has to check.
+*
+*   Copyright (c) 2022 creikey
+*
+**********************************************************************************************/
+
+#ifndef ENTITIES_H
+#define ENTITIES_H
+
+#include "raylib.h"
+#include <stddef.h>
+
+//----------------------------------------------------------------------------------
+// Types and Structures Definition
+//----------------------------------------------------------------------------------
+
+// Handle to an entity. index is the slot in the handle table, generation is what the
+// slot's generation was when the entity was created. Generation 0 is never handed out,
+// so a zeroed ID is the null handle. Packed in 32 bits so Entity keeps its size
+typedef struct ID
+{
+    unsigned int index : 20;
+    unsigned int generation : 12;
+} ID;
+
+#define NULL_ID ((ID){ 0 })
+#define MAX_ENTITY_SLOTS (1 << 20)
+
+#define BODY_RADIUS 18.0f // the player and extinguishers collide as circles this big
+
+typedef struct KinematicInfo
+{
+    Vector2 vel;
+    Vector2 pos;
+    bool onGround;
+} KinematicInfo;
+
+// All the entity datas
+typedef struct PlayerData
+{
+    KinematicInfo k;
+    ID grabbedEntity;
+    float health;
+    Vector2 prevPos; // k.pos when the last tick started, drawing interpolates from here
+} PlayerData;
+typedef Rectangle ObstacleData;
+typedef Rectangle GroundData;
+typedef struct FireData
+{
+    Rectangle rect;
+    float fireLeft;
+    float fireParticleTimer;
+} FireData;
+typedef struct ExtinguisherData
+{
+    KinematicInfo info;
+    float amountUsed;
+    int proxy; // in the body tree, assigned by AddEntity
+    Vector2 prevPos; // info.pos when the last tick started
+} ExtinguisherData;
+typedef struct HelpTextData
+{
+    Vector2 pos;
+    char text[100];
+} HelpTextData;
+
+// Entity types
+enum Type
+{
+    Tombstone = -1, // deleted, waiting for CompactEntities. Not placeable in the editor
+
+    Player,
+    Obstacle,
+    Ground,
+    Extinguisher,
+    Fire,
+    HelpText,
+
+    // UPDATE MAX_TYPE WHEN YOU CHANGE THIS
+};
+#define MAX_TYPE HelpText
+
+typedef struct Entity
+{
+    ID id;
+    enum Type type;
+    union
+    {
+        PlayerData player;
+        ObstacleData obstacle;
+        GroundData ground;
+        ExtinguisherData extinguisher;
+        FireData fire;
+        HelpTextData help;
+        int empty_data[64]; // so I can add new fields without it breaking
+    };
+} Entity;
+
+// Dense lists for the passes over the whole level: every obstacle rect for the occupancy map,
+// every fire and extinguisher for the level snapshot. Rects are copies; mutable state
+// (fireLeft, extinguisher motion) stays on the entity and is reached through the ID
+typedef struct EntityComponents
+{
+    Rectangle *obstacleRects;
+    int obstaclesLen;
+    Rectangle *fireRects;
+    ID *fireIDs;
+    int firesLen;
+    ID *extinguisherIDs;
+    int extinguishersLen;
+} EntityComponents;
+
+// How full the entity store is, for reporting headroom
+typedef struct EntityStoreUsage
+{
+    int count;          // live entities
+    int tombstones;     // deleted but not compacted yet
+    int capacity;       // entities that fit before the store grows again
+    int maxEntities;    // hard limit from the handle index width
+    size_t bytes;       // heap used by the store
+} EntityStoreUsage;
+
+// a grid rect (see GetEntityGrid) that something was added at, removed from, or moved to or from
+typedef void (*EntityChangeFunc)(enum Type type, Rectangle rect, void *context);
+
+struct SpatialGrid;
+struct AABBTree;
+
+//----------------------------------------------------------------------------------
+// Global Variables Declaration
+//----------------------------------------------------------------------------------
+extern Entity *entities;    // insertion order, may contain tombstones. Don't hold pointers across adds/compaction
+extern int entitiesLen;     // includes tombstones
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//----------------------------------------------------------------------------------
+// Entity Storage Functions Declaration
+//----------------------------------------------------------------------------------
+bool IDEquals(ID a, ID b);
+int GetEntityIndex(ID id);          // -1 if the handle is stale or null
+Entity *GetEntity(ID id);           // NULL if the handle is stale or null
+Entity *GetPlayerEntity(void);      // NULL if there's no player
+Entity *AddEntity(Entity e);        // assigns e.id, returns the stored copy. NULL if out of memory or handles
+bool ReserveEntities(int capacity); // grow ahead of a known number of adds
+void DeleteEntityIndex(int index);  // O(1), leaves a tombstone
+void DeleteEntity(ID id);
+void CompactEntities(void);         // removes tombstones, keeps order and handles
+void ClearEntities(void);           // invalidates every outstanding handle, keeps the memory
+void UnloadEntities(void);          // frees the storage
+void SetEntityRect(ID id, Rectangle rect); // obstacles, grounds and fires, normalized. Keeps the grid in sync
+struct SpatialGrid *GetEntityGrid(void);    // obstacle, ground and fire rects, help text positions
+void UpdateEntityBody(Entity *e, Vector2 displacement); // after moving an extinguisher
+void ResetEntityBodies(void);       // rebuilds the body tree in entity order, after teleporting extinguishers
+struct AABBTree *GetBodyTree(void);         // extinguishers
+const EntityComponents *GetEntityComponents(void); // rebuilt first if anything changed. Don't hold across adds/deletes
+unsigned int GetEntityStoreVersion(void);  // changes with every add, delete and rect change, for telling when a cached query went stale
+bool GetEntityChanges(unsigned int since, EntityChangeFunc func, void *context);  // every grid rect changed after version since. False if the store doesn't remember that far back, rebuild then
+EntityStoreUsage GetEntityStoreUsage(void);
+Rectangle FixNegativeRect(Rectangle rect);  // same area, width and height not negative
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // ENTITIES_H
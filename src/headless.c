@@ -0,0 +1,305 @@
+/**********************************************************************************************
+*
+*   Headless runner: plays levels with no window, as fast as it goes
+*
+*   usage: headless [-threads n] [level] [runs] [seconds per run]
+*          headless [-threads n] -record <replay> [level] [seconds]
+*          headless [-threads n] -replay <replay> [times]
+*          headless -convert <level> <output level>
+*
+*   Runs drive the player with a simple random bot, seeded by the run number so a run plays
+*   out the same way every time. -record saves one bot run as a replay, -replay plays one
+*   back. Both print a hash of the final state: a replay that doesn't reproduce its
+*   recording's hash isn't deterministic anymore. -convert rewrites a level, old raw levels
+*   included, in the current level format, and fails without writing if it doesn't load.
+*   -threads sets how many threads help with big particle updates, the hash must not depend
+*   on it. A level that doesn't exist or doesn't load is an error, not a run of the default
+*   level.
+*
+*   Copyright (c) 2022 creikey
+*
+**********************************************************************************************/
+
+#include "raylib.h"
+#include "raymath.h"
+#include "entities.h"
+#include "simulation.h"
+#include "replay.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define BOT_DECISION_TIME 0.5f  // seconds between the bot changing its mind
+
+typedef struct RunResult
+{
+    int deaths;
+    int fires;
+    int firesOut;
+} RunResult;
+
+// The bot has its own generator so its choices don't move the simulation's random stream
+static unsigned int botState = 1;
+
+static int BotRandom(int min, int max)
+{
+    botState = botState*1103515245u + 12345u;
+    return min + (int)((botState >> 16) % (unsigned int)(max - min + 1));
+}
+
+static SimInput BotInput(void)
+{
+    Vector2 player = GetPlayerEntity()->player.k.pos;
+    float angle = (float)BotRandom(-180, 180)*DEG2RAD;
+    return (SimInput){
+        .movement = Vector2Normalize((Vector2){ (float)BotRandom(-1, 1), (float)BotRandom(-1, 1) }),
+        .aim = Vector2Add(player, Vector2Rotate((Vector2){ 100.0f, 0.0f }, angle)),
+        .grabPressed = BotRandom(0, 3) == 0,
+        .sprayDown = BotRandom(0, 1) == 0,
+    };
+}
+
+// Plays ticks with the bot, recording them if replay isn't NULL
+static void PlayBot(int ticks, Replay *replay)
+{
+    const int decisionTicks = (int)(BOT_DECISION_TIME*SIM_TICK_RATE);
+    SimInput input = { 0 };
+    for (int tick = 0; tick < ticks; tick++)
+    {
+        if ((tick % decisionTicks) == 0)
+        {
+            input = BotInput();
+        }
+        if (replay != NULL)
+        {
+            RecordReplayTick(replay, &input);
+        }
+        StepSimulation(&input, 1.0f/SIM_TICK_RATE);
+        input.grabPressed = false;
+    }
+}
+
+static RunResult GetRunResult(void)
+{
+    RunResult result = { .deaths = GetSimulationStats().deaths };
+    for (int i = 0; i < entitiesLen; i++)
+    {
+        if (entities[i].type == Fire)
+        {
+            result.fires += 1;
+            if (entities[i].fire.fireLeft <= 0.0f)
+            {
+                result.firesOut += 1;
+            }
+        }
+    }
+    return result;
+}
+
+// FNV-1a over everything that moves or burns
+static unsigned int HashBytes(unsigned int hash, const void *data, int size)
+{
+    const unsigned char *bytes = (const unsigned char *)data;
+    for (int i = 0; i < size; i++)
+    {
+        hash = (hash ^ bytes[i])*16777619u;
+    }
+    return hash;
+}
+
+static unsigned int HashState(void)
+{
+    unsigned int hash = 2166136261u;
+    for (int i = 0; i < entitiesLen; i++)
+    {
+        const Entity *e = &entities[i];
+        switch (e->type)
+        {
+        case Player:
+            hash = HashBytes(hash, &e->player.k.pos, sizeof(Vector2));
+            hash = HashBytes(hash, &e->player.k.vel, sizeof(Vector2));
+            hash = HashBytes(hash, &e->player.health, sizeof(float));
+            break;
+        case Extinguisher:
+            hash = HashBytes(hash, &e->extinguisher.info.pos, sizeof(Vector2));
+            hash = HashBytes(hash, &e->extinguisher.info.vel, sizeof(Vector2));
+            hash = HashBytes(hash, &e->extinguisher.amountUsed, sizeof(float));
+            break;
+        case Fire:
+            hash = HashBytes(hash, &e->fire.fireLeft, sizeof(float));
+            break;
+        default:
+            break;
+        }
+    }
+    // particles don't keep an order, so they're summed rather than chained
+    const ParticleArrays *particles = GetParticles();
+    unsigned int particleSum = 0;
+    for (int i = 0; i < particles->count; i++)
+    {
+        unsigned int particleHash = HashBytes(2166136261u, &particles->posX[i], sizeof(float));
+        particleSum += HashBytes(particleHash, &particles->posY[i], sizeof(float));
+    }
+    hash = HashBytes(hash, &particles->count, sizeof(int));
+    hash = HashBytes(hash, &particleSum, sizeof(unsigned int));
+    return hash;
+}
+
+// wall time, clock() adds up every thread's
+static double Now(void)
+{
+    struct timespec ts = { 0 };
+    timespec_get(&ts, TIME_UTC);
+    return (double)ts.tv_sec + (double)ts.tv_nsec*1e-9;
+}
+
+static void PrintSpeed(long long ticks, double start)
+{
+    double elapsed = Now() - start;
+    printf("%lld ticks in %.2fs (%.0f ticks/s, %.1fx real time)\n", ticks, elapsed,
+        (elapsed > 0.0)? ticks/elapsed : 0.0, (elapsed > 0.0)? ticks/(elapsed*SIM_TICK_RATE) : 0.0);
+}
+
+static int Usage(void)
+{
+    fprintf(stderr, "usage: headless [-threads n] [level] [runs] [seconds per run]\n"
+        "       headless [-threads n] -record <replay> [level] [seconds]\n"
+        "       headless [-threads n] -replay <replay> [times]\n"
+        "       headless -convert <level> <output level>\n");
+    return 2;
+}
+
+// The simulation quietly plays the default level when one doesn't load, which is right for
+// the game but would make a typo look like a passing run here
+static bool CheckLevel(const char *level)
+{
+    LevelImage image = { 0 };
+    if (!FileExists(level) || !OpenLevelImage(level, &image))
+    {
+        fprintf(stderr, "%s: not a level that loads\n", level);
+        return false;
+    }
+    CloseLevelImage(&image);
+    return true;
+}
+
+static int RecordMain(const char *path, const char *level, float seconds)
+{
+    Replay replay = { 0 };
+    botState = 1;
+    BeginReplayRecording(&replay, level, 1);
+    PlayBot((int)(seconds*SIM_TICK_RATE), &replay);
+    EndReplayRecording(&replay);
+
+    bool saved = SaveReplay(&replay, path);
+    printf("recorded %i ticks in %i bytes, state %08x\n", replay.ticks, replay.dataLen, HashState());
+    UnloadReplay(&replay);
+    UnloadSimulation();
+    return saved ? 0 : 1;
+}
+
+static int ReplayMain(const char *path, int times)
+{
+    Replay replay = { 0 };
+    if (!LoadReplay(&replay, path))
+    {
+        return 1;
+    }
+
+    long long totalTicks = 0;
+    double start = Now();
+    for (int i = 0; i < times; i++)
+    {
+        ReplayCursor cursor = BeginReplayPlayback(&replay);
+        SimInput input = { 0 };
+        while (NextReplayInput(&cursor, &input))
+        {
+            StepSimulation(&input, 1.0f/SIM_TICK_RATE);
+        }
+        totalTicks += replay.ticks;
+        printf("replay %i: %i deaths, state %08x\n", i, GetSimulationStats().deaths, HashState());
+    }
+    PrintSpeed(totalTicks, start);
+
+    UnloadReplay(&replay);
+    UnloadSimulation();
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    SetTraceLogLevel(LOG_WARNING);
+
+    if ((argc > 2) && (strcmp(argv[1], "-threads") == 0))
+    {
+        SetParticleThreads(atoi(argv[2]));
+        argc -= 2;
+        argv += 2;
+    }
+
+    if ((argc > 2) && (strcmp(argv[1], "-record") == 0))
+    {
+        const char *level = (argc > 3) ? argv[3] : "resources/saved.level";
+        if (!CheckLevel(level))
+        {
+            return 1;
+        }
+        return RecordMain(argv[2], level, (argc > 4) ? (float)atof(argv[4]) : 60.0f);
+    }
+    if ((argc > 2) && (strcmp(argv[1], "-replay") == 0))
+    {
+        return ReplayMain(argv[2], (argc > 3) ? atoi(argv[3]) : 1);
+    }
+    if ((argc > 3) && (strcmp(argv[1], "-convert") == 0))
+    {
+        // the fallback default level must never be written over what was being converted
+        if (!LoadEntities(argv[2], true))
+        {
+            fprintf(stderr, "%s: not a level that loads, nothing written\n", argv[2]);
+            UnloadSimulation();
+            return 1;
+        }
+        bool saved = SaveEntities(argv[3]);
+        if (saved)
+            printf("%s: %i entities\n", argv[3], entitiesLen);
+        else
+            fprintf(stderr, "%s: failed to write\n", argv[3]);
+        UnloadSimulation();
+        return saved ? 0 : 1;
+    }
+
+    // anything else starting with - is a flag we don't have, or one missing its arguments
+    if ((argc > 1) && (argv[1][0] == '-'))
+    {
+        return Usage();
+    }
+    const char *level = (argc > 1) ? argv[1] : "resources/saved.level";
+    if (!CheckLevel(level))
+    {
+        return 1;
+    }
+    int runs = (argc > 2) ? atoi(argv[2]) : 100;
+    float seconds = (argc > 3) ? (float)atof(argv[3]) : 60.0f;
+    int ticks = (int)(seconds*SIM_TICK_RATE);
+
+    long long totalTicks = 0;
+    int totalDeaths = 0;
+    double start = Now();
+    for (int run = 0; run < runs; run++)
+    {
+        botState = (unsigned int)run + 1;
+        RestartSimulation(level, (unsigned int)run + 1);
+        PlayBot(ticks, NULL);
+        RunResult result = GetRunResult();
+        printf("run %i: %i deaths, %i/%i fires out\n", run, result.deaths, result.firesOut, result.fires);
+        totalTicks += ticks;
+        totalDeaths += result.deaths;
+        UnloadSimulation();
+    }
+
+    printf("%i runs of %.1fs, %i deaths, ", runs, seconds, totalDeaths);
+    PrintSpeed(totalTicks, start);
+
+    return 0;
+}
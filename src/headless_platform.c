@@ -0,0 +1,119 @@
+/**********************************************************************************************
+*
+*   The raylib utilities the simulation uses, for builds that don't link raylib
+*
+*   Same behaviour as raylib's versions with the default standard file IO, minus the
+*   platform specific bits (Android assets, web storage) a headless build never needs.
+*
+*   Copyright (c) 2022 creikey
+*
+**********************************************************************************************/
+
+#include "raylib.h"
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+static int logTypeLevel = LOG_INFO;
+
+void SetTraceLogLevel(int logType)
+{
+    logTypeLevel = logType;
+}
+
+void TraceLog(int logType, const char *text, ...)
+{
+    if (logType < logTypeLevel)
+    {
+        return;
+    }
+
+    switch (logType)
+    {
+    case LOG_TRACE: fprintf(stderr, "TRACE: "); break;
+    case LOG_DEBUG: fprintf(stderr, "DEBUG: "); break;
+    case LOG_INFO: fprintf(stderr, "INFO: "); break;
+    case LOG_WARNING: fprintf(stderr, "WARNING: "); break;
+    case LOG_ERROR: fprintf(stderr, "ERROR: "); break;
+    case LOG_FATAL: fprintf(stderr, "FATAL: "); break;
+    default: break;
+    }
+
+    va_list args;
+    va_start(args, text);
+    vfprintf(stderr, text, args);
+    va_end(args);
+    fprintf(stderr, "\n");
+
+    if (logType == LOG_FATAL)
+    {
+        exit(EXIT_FAILURE);
+    }
+}
+
+unsigned char *LoadFileData(const char *fileName, unsigned int *bytesRead)
+{
+    unsigned char *data = NULL;
+    *bytesRead = 0;
+
+    FILE *file = fopen(fileName, "rb");
+    if (file == NULL)
+    {
+        TraceLog(LOG_WARNING, "FILEIO: [%s] Failed to open file", fileName);
+        return NULL;
+    }
+
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    if (size > 0)
+    {
+        data = (unsigned char *)RL_MALLOC(size);
+        if (data != NULL)
+        {
+            *bytesRead = (unsigned int)fread(data, 1, size, file);
+        }
+    }
+    else
+    {
+        TraceLog(LOG_WARNING, "FILEIO: [%s] Failed to read file", fileName);
+    }
+    fclose(file);
+
+    return data;
+}
+
+void UnloadFileData(unsigned char *data)
+{
+    RL_FREE(data);
+}
+
+bool SaveFileData(const char *fileName, void *data, unsigned int bytesToWrite)
+{
+    FILE *file = fopen(fileName, "wb");
+    if (file == NULL)
+    {
+        TraceLog(LOG_WARNING, "FILEIO: [%s] Failed to open file", fileName);
+        return false;
+    }
+
+    unsigned int count = (unsigned int)fwrite(data, 1, bytesToWrite, file);
+    fclose(file);
+    if (count != bytesToWrite)
+    {
+        TraceLog(LOG_WARNING, "FILEIO: [%s] File partially written", fileName);
+        return false;
+    }
+    return true;
+}
+
+bool FileExists(const char *fileName)
+{
+    FILE *file = fopen(fileName, "rb");
+    if (file == NULL)
+    {
+        return false;
+    }
+    fclose(file);
+    return true;
+}
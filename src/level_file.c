@@ -0,0 +1,944 @@
+/**********************************************************************************************
+*
+*   Level files
+*
+*   Copyright (c) 2022 creikey
+*
+**********************************************************************************************/
+
+#include "level_file.h"
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define LEVEL_TYPE_COUNT 6      // Player to HelpText, what the header has counts for
+#define LEVEL_HEADER_SIZE (12 + 4*LEVEL_TYPE_COUNT)
+#define CHUNK_HEADER_SIZE 8
+#define MAX_HELP_TEXT 99        // HelpTextData.text minus the terminator
+#define REGION_HEADER_SIZE 8
+#define REGION_ENTRY_SIZE (24 + 8*LEVEL_REGION_TYPES)
+
+// Before the chunked format levels were the Entity array straight from memory. This is
+// that struct as it was, so old files keep loading whatever happens to Entity
+typedef struct LegacyKinematicInfo
+{
+    Vector2 vel;
+    Vector2 pos;
+    bool onGround;
+} LegacyKinematicInfo;
+
+typedef struct LegacyEntity
+{
+    int id;
+    int type;
+    union
+    {
+        struct { LegacyKinematicInfo k; int grabbedEntity; float health; } player;
+        Rectangle rect; // obstacle and ground
+        struct { Rectangle rect; float fireLeft; float fireParticleTimer; } fire;
+        struct { LegacyKinematicInfo info; float amountUsed; } extinguisher;
+        struct { Vector2 pos; char text[100]; } help;
+        int empty_data[64];
+    };
+} LegacyEntity;
+
+typedef struct ChunkType
+{
+    char tag[4];
+    enum Type type;
+    int recordSize;     // 0 when records vary in size
+} ChunkType;
+
+// in the order they're written, which is also the order they're drawn in
+static const ChunkType chunkTypes[] = {
+    { { 'P', 'L', 'Y', 'R' }, Player, 20 },
+    { { 'G', 'R', 'N', 'D' }, Ground, 16 },
+    { { 'O', 'B', 'S', 'T' }, Obstacle, 16 },
+    { { 'F', 'I', 'R', 'E' }, Fire, 20 },
+    { { 'E', 'X', 'T', 'G' }, Extinguisher, 20 },
+    { { 'H', 'E', 'L', 'P' }, HelpText, 0 },
+};
+#define CHUNK_TYPES_LEN ((int)(sizeof(chunkTypes)/sizeof(chunkTypes[0])))
+
+// what regions hold, in the order REGN entries list them
+static const enum Type regionTypes[LEVEL_REGION_TYPES] = { Ground, Obstacle, HelpText };
+
+// a static entity and the region it's saved in, for sorting them into region order
+typedef struct RegionItem
+{
+    int x;
+    int y;
+    int index;  // in entities[], ties keep the order they had
+} RegionItem;
+
+//----------------------------------------------------------------------------------
+// Module Functions Definition (local)
+//----------------------------------------------------------------------------------
+static unsigned int Crc32(const unsigned char *data, unsigned int size)
+{
+    unsigned int crc = 0xffffffffu;
+    for (unsigned int i = 0; i < size; i++)
+    {
+        crc ^= data[i];
+        for (int bit = 0; bit < 8; bit++)
+        {
+            crc = (crc >> 1) ^ (0xedb88320u & (0u - (crc & 1u)));
+        }
+    }
+    return ~crc;
+}
+
+static void WriteU32(unsigned char *out, unsigned int value)
+{
+    out[0] = (unsigned char)(value & 0xff);
+    out[1] = (unsigned char)((value >> 8) & 0xff);
+    out[2] = (unsigned char)((value >> 16) & 0xff);
+    out[3] = (unsigned char)((value >> 24) & 0xff);
+}
+
+static unsigned int ReadU32(const unsigned char *in)
+{
+    return (unsigned int)in[0] | ((unsigned int)in[1] << 8) | ((unsigned int)in[2] << 16) | ((unsigned int)in[3] << 24);
+}
+
+static void WriteF32(unsigned char *out, float value)
+{
+    unsigned int bits = 0;
+    memcpy(&bits, &value, sizeof(float));
+    WriteU32(out, bits);
+}
+
+static float ReadF32(const unsigned char *in)
+{
+    unsigned int bits = ReadU32(in);
+    float value = 0.0f;
+    memcpy(&value, &bits, sizeof(float));
+    return value;
+}
+
+static unsigned int Pad4(unsigned int size)
+{
+    return (size + 3u) & ~3u;
+}
+
+static const ChunkType *FindChunkType(const unsigned char *tag)
+{
+    for (int i = 0; i < CHUNK_TYPES_LEN; i++)
+    {
+        if (memcmp(chunkTypes[i].tag, tag, 4) == 0)
+        {
+            return &chunkTypes[i];
+        }
+    }
+    return NULL;
+}
+
+// Entity from the record at data, which is known to be in bounds. Returns the record size
+static unsigned int ReadRecord(const ChunkType *chunk, const unsigned char *data, Entity *e)
+{
+    *e = (Entity){ .type = chunk->type };
+    switch (chunk->type)
+    {
+    case Player:
+    {
+        e->player.k.pos = (Vector2){ ReadF32(data), ReadF32(data + 4) };
+        e->player.k.vel = (Vector2){ ReadF32(data + 8), ReadF32(data + 12) };
+        e->player.health = ReadF32(data + 16);
+        e->player.grabbedEntity = NULL_ID;
+        e->player.prevPos = e->player.k.pos;
+    } break;
+    case Obstacle:
+    case Ground:
+    {
+        e->ground = (Rectangle){ ReadF32(data), ReadF32(data + 4), ReadF32(data + 8), ReadF32(data + 12) };
+    } break;
+    case Fire:
+    {
+        e->fire.rect = (Rectangle){ ReadF32(data), ReadF32(data + 4), ReadF32(data + 8), ReadF32(data + 12) };
+        e->fire.fireLeft = ReadF32(data + 16);
+    } break;
+    case Extinguisher:
+    {
+        e->extinguisher.info.pos = (Vector2){ ReadF32(data), ReadF32(data + 4) };
+        e->extinguisher.info.vel = (Vector2){ ReadF32(data + 8), ReadF32(data + 12) };
+        e->extinguisher.amountUsed = ReadF32(data + 16);
+        e->extinguisher.prevPos = e->extinguisher.info.pos;
+    } break;
+    case HelpText:
+    {
+        e->help.pos = (Vector2){ ReadF32(data), ReadF32(data + 4) };
+        unsigned int len = ReadU32(data + 8);
+        memcpy(e->help.text, data + 12, (len < MAX_HELP_TEXT) ? len : MAX_HELP_TEXT);
+        return 12 + Pad4(len);
+    }
+    default: break;
+    }
+    return (unsigned int)chunk->recordSize;
+}
+
+static unsigned int WriteRecord(const Entity *e, unsigned char *out)
+{
+    switch (e->type)
+    {
+    case Player:
+    {
+        WriteF32(out, e->player.k.pos.x);
+        WriteF32(out + 4, e->player.k.pos.y);
+        WriteF32(out + 8, e->player.k.vel.x);
+        WriteF32(out + 12, e->player.k.vel.y);
+        WriteF32(out + 16, e->player.health);
+        return 20;
+    }
+    case Obstacle:
+    case Ground:
+    case Fire:
+    {
+        Rectangle rect = (e->type == Fire) ? e->fire.rect : e->ground;
+        WriteF32(out, rect.x);
+        WriteF32(out + 4, rect.y);
+        WriteF32(out + 8, rect.width);
+        WriteF32(out + 12, rect.height);
+        if (e->type != Fire)
+        {
+            return 16;
+        }
+        WriteF32(out + 16, e->fire.fireLeft);
+        return 20;
+    }
+    case Extinguisher:
+    {
+        WriteF32(out, e->extinguisher.info.pos.x);
+        WriteF32(out + 4, e->extinguisher.info.pos.y);
+        WriteF32(out + 8, e->extinguisher.info.vel.x);
+        WriteF32(out + 12, e->extinguisher.info.vel.y);
+        WriteF32(out + 16, e->extinguisher.amountUsed);
+        return 20;
+    }
+    case HelpText:
+    {
+        unsigned int len = (unsigned int)strlen(e->help.text);
+        WriteF32(out, e->help.pos.x);
+        WriteF32(out + 4, e->help.pos.y);
+        WriteU32(out + 8, len);
+        memset(out + 12, 0, Pad4(len));
+        memcpy(out + 12, e->help.text, len);
+        return 12 + Pad4(len);
+    }
+    default: break;
+    }
+    return 0;
+}
+
+static const ChunkType *ChunkOfType(enum Type type)
+{
+    for (int i = 0; i < CHUNK_TYPES_LEN; i++)
+    {
+        if (chunkTypes[i].type == type)
+        {
+            return &chunkTypes[i];
+        }
+    }
+    return NULL;
+}
+
+static unsigned int RecordSize(const Entity *e)
+{
+    if (e->type == HelpText)
+    {
+        return 12 + Pad4((unsigned int)strlen(e->help.text));
+    }
+    const ChunkType *chunk = ChunkOfType(e->type);
+    return (chunk != NULL) ? (unsigned int)chunk->recordSize : 0;
+}
+
+// Checks everything before any entity is touched, so a bad file leaves the level alone
+static bool ValidateLevel(const unsigned char *data, unsigned int size)
+{
+    if (ReadU32(data + 4) > LEVEL_VERSION)
+    {
+        TraceLog(LOG_WARNING, "LEVEL: Saved by a newer version (%u)", ReadU32(data + 4));
+        return false;
+    }
+    if (ReadU32(data + 8) != Crc32(data + 12, size - 12))
+    {
+        TraceLog(LOG_WARNING, "LEVEL: Checksum mismatch, the file is corrupt");
+        return false;
+    }
+    if (ReadU32(data + 12 + 4*Player) != 1)
+    {
+        TraceLog(LOG_WARNING, "LEVEL: Needs exactly one player, has %u", ReadU32(data + 12 + 4*Player));
+        return false;
+    }
+    // 64 bits so a huge count can't wrap around into a small total
+    unsigned long long total = 0;
+    for (int type = 0; type < LEVEL_TYPE_COUNT; type++)
+    {
+        total += ReadU32(data + 12 + 4*type);
+    }
+    if (total > MAX_ENTITY_SLOTS)
+    {
+        TraceLog(LOG_WARNING, "LEVEL: Has %llu entities, more than the %i there can be", total, MAX_ENTITY_SLOTS);
+        return false;
+    }
+
+    unsigned int found[LEVEL_TYPE_COUNT] = { 0 };
+    unsigned int offset = LEVEL_HEADER_SIZE;
+    while (offset < size)
+    {
+        if (size - offset < CHUNK_HEADER_SIZE || ReadU32(data + offset + 4) > size - offset - CHUNK_HEADER_SIZE)
+        {
+            TraceLog(LOG_WARNING, "LEVEL: Chunk runs past the end of the file");
+            return false;
+        }
+        unsigned int chunkSize = ReadU32(data + offset + 4);
+        const ChunkType *chunk = FindChunkType(data + offset);
+        const unsigned char *payload = data + offset + CHUNK_HEADER_SIZE;
+        if (chunk != NULL)
+        {
+            unsigned int count = ReadU32(data + 12 + 4*chunk->type);
+            if (chunk->recordSize > 0)
+            {
+                // divided rather than multiplied, the multiply can wrap
+                if ((chunkSize % (unsigned int)chunk->recordSize != 0) || (count != chunkSize/(unsigned int)chunk->recordSize))
+                {
+                    TraceLog(LOG_WARNING, "LEVEL: %.4s chunk is %u bytes, expected %u records", chunk->tag, chunkSize, count);
+                    return false;
+                }
+            }
+            else
+            {
+                // variable size records, walk them
+                unsigned int at = 0;
+                for (unsigned int i = 0; i < count; i++)
+                {
+                    if ((chunkSize - at < 12) || (ReadU32(payload + at + 8) > chunkSize - at - 12) ||
+                        (Pad4(ReadU32(payload + at + 8)) > chunkSize - at - 12))
+                    {
+                        TraceLog(LOG_WARNING, "LEVEL: %.4s record runs past its chunk", chunk->tag);
+                        return false;
+                    }
+                    at += 12 + Pad4(ReadU32(payload + at + 8));
+                }
+                if (at != chunkSize)
+                {
+                    TraceLog(LOG_WARNING, "LEVEL: %.4s chunk has extra bytes", chunk->tag);
+                    return false;
+                }
+            }
+            found[chunk->type] += count;
+        }
+        offset += CHUNK_HEADER_SIZE + Pad4(chunkSize);
+    }
+
+    for (int type = 0; type < LEVEL_TYPE_COUNT; type++)
+    {
+        if (found[type] != ReadU32(data + 12 + 4*type))
+        {
+            TraceLog(LOG_WARNING, "LEVEL: Header says %u of type %i, chunks have %u", ReadU32(data + 12 + 4*type), type, found[type]);
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool LoadLegacyLevel(const unsigned char *data, unsigned int size)
+{
+    int count = (int)(size/sizeof(LegacyEntity));
+    ClearEntities();
+    ReserveEntities(count);
+    for (int i = 0; i < count; i++)
+    {
+        LegacyEntity old = { 0 };
+        memcpy(&old, data + i*sizeof(LegacyEntity), sizeof(LegacyEntity));
+
+        Entity e = { .type = (enum Type)old.type };
+        switch (old.type)
+        {
+        case Player:
+        {
+            e.player.k.pos = old.player.k.pos;
+            e.player.k.vel = old.player.k.vel;
+            e.player.health = old.player.health;
+            e.player.grabbedEntity = NULL_ID;
+            e.player.prevPos = e.player.k.pos;
+        } break;
+        case Obstacle:
+        case Ground: e.ground = old.rect; break;
+        case Fire:
+        {
+            e.fire.rect = old.fire.rect;
+            e.fire.fireLeft = old.fire.fireLeft;
+        } break;
+        case Extinguisher:
+        {
+            e.extinguisher.info.pos = old.extinguisher.info.pos;
+            e.extinguisher.info.vel = old.extinguisher.info.vel;
+            e.extinguisher.amountUsed = old.extinguisher.amountUsed;
+            e.extinguisher.prevPos = e.extinguisher.info.pos;
+        } break;
+        case HelpText:
+        {
+            e.help.pos = old.help.pos;
+            memcpy(e.help.text, old.help.text, MAX_HELP_TEXT);
+        } break;
+        default:
+        {
+            TraceLog(LOG_WARNING, "LEVEL: Skipping legacy entity %i of unknown type %i", i, old.type);
+            continue;
+        }
+        }
+        AddEntity(e);
+    }
+    return GetPlayerEntity() != NULL;
+}
+
+// Rect records are laid out just like Rectangle, so where the floats are little endian and
+// aligned they're used as they are instead of being decoded one at a time
+static bool CanUseRectsInPlace(const unsigned char *payload)
+{
+    const unsigned int one = 1;
+    unsigned char lowByte = 0;
+    memcpy(&lowByte, &one, 1);
+    return (lowByte == 1) && (((uintptr_t)payload % sizeof(float)) == 0) && (sizeof(Rectangle) == 16);
+}
+
+// Adds a chunk's worth of records, or a region's slice of one. Returns how many were added
+static int AddRecords(const ChunkType *chunk, const unsigned char *records, unsigned int size, ID *ids)
+{
+    int added = 0;
+    if (((chunk->type == Ground) || (chunk->type == Obstacle)) && CanUseRectsInPlace(records))
+    {
+        const Rectangle *rects = (const Rectangle *)records;
+        for (unsigned int i = 0; i < size/sizeof(Rectangle); i++)
+        {
+            Entity *e = AddEntity((Entity){ .type = chunk->type, .ground = rects[i] });
+            if ((e != NULL) && (ids != NULL))
+            {
+                ids[added] = e->id;
+            }
+            added += (e != NULL) ? 1 : 0;
+        }
+        return added;
+    }
+    for (unsigned int at = 0; at < size;)
+    {
+        Entity record = { 0 };
+        at += ReadRecord(chunk, records + at, &record);
+        Entity *e = AddEntity(record);
+        if ((e != NULL) && (ids != NULL))
+        {
+            ids[added] = e->id;
+        }
+        added += (e != NULL) ? 1 : 0;
+    }
+    return added;
+}
+
+static int RegionTypeIndex(enum Type type)
+{
+    for (int t = 0; t < LEVEL_REGION_TYPES; t++)
+    {
+        if (regionTypes[t] == type)
+        {
+            return t;
+        }
+    }
+    return -1;
+}
+
+// what a static entity covers, help text only counts where it starts
+static Rectangle RegionBounds(const Entity *e)
+{
+    if (e->type == HelpText)
+    {
+        return (Rectangle){ e->help.pos.x, e->help.pos.y, 0.0f, 0.0f };
+    }
+    return e->ground;
+}
+
+// Entities for a level ValidateLevel passed. Without the region types it's only the player,
+// fires and extinguishers, and streaming brings in the rest
+static bool AddLevelEntities(const unsigned char *data, unsigned int size, bool withRegions)
+{
+    unsigned int total = 0;
+    for (int type = 0; type < LEVEL_TYPE_COUNT; type++)
+    {
+        if (withRegions || (RegionTypeIndex((enum Type)type) < 0))
+        {
+            total += ReadU32(data + 12 + 4*type);
+        }
+    }
+    ClearEntities();
+    ReserveEntities((int)total);    // ValidateLevel capped the counts, it can't have wrapped
+
+    unsigned int offset = LEVEL_HEADER_SIZE;
+    while (offset < size)
+    {
+        unsigned int chunkSize = ReadU32(data + offset + 4);
+        const ChunkType *chunk = FindChunkType(data + offset);
+        const unsigned char *payload = data + offset + CHUNK_HEADER_SIZE;
+        offset += CHUNK_HEADER_SIZE + Pad4(chunkSize);
+        if ((chunk == NULL) || (!withRegions && (RegionTypeIndex(chunk->type) >= 0)))
+        {
+            continue;
+        }
+        AddRecords(chunk, payload, chunkSize, NULL);
+    }
+    return GetPlayerEntity() != NULL;
+}
+
+static int CompareRegionItems(const void *a, const void *b)
+{
+    const RegionItem *itemA = (const RegionItem *)a;
+    const RegionItem *itemB = (const RegionItem *)b;
+    if (itemA->y != itemB->y)
+    {
+        return (itemA->y < itemB->y) ? -1 : 1;
+    }
+    if (itemA->x != itemB->x)
+    {
+        return (itemA->x < itemB->x) ? -1 : 1;
+    }
+    return itemA->index - itemB->index;
+}
+
+// Checks REGN against the chunks it points into. ValidateLevel already passed, so the
+// chunks themselves are sound. A bad index only costs streaming, the level loads whole
+static void FindRegionIndex(LevelImage *image)
+{
+    const unsigned char *data = image->file.data;
+    unsigned int size = image->file.size;
+    const unsigned char *index = NULL;
+    unsigned int indexSize = 0;
+    int chunksSeen[LEVEL_REGION_TYPES] = { 0 };
+    for (unsigned int offset = LEVEL_HEADER_SIZE; offset < size;)
+    {
+        unsigned int chunkSize = ReadU32(data + offset + 4);
+        const ChunkType *chunk = FindChunkType(data + offset);
+        int t = (chunk != NULL) ? RegionTypeIndex(chunk->type) : -1;
+        if (t >= 0)
+        {
+            image->regionChunks[t] = data + offset + CHUNK_HEADER_SIZE;
+            image->regionChunkSizes[t] = chunkSize;
+            chunksSeen[t] += 1;
+        }
+        else if (memcmp(data + offset, "REGN", 4) == 0)
+        {
+            index = data + offset + CHUNK_HEADER_SIZE;
+            indexSize = chunkSize;
+        }
+        offset += CHUNK_HEADER_SIZE + Pad4(chunkSize);
+    }
+    if (index == NULL)
+    {
+        return;
+    }
+
+    bool valid = (indexSize >= REGION_HEADER_SIZE) &&
+                 (ReadU32(index + 4) <= (indexSize - REGION_HEADER_SIZE)/REGION_ENTRY_SIZE) &&
+                 (indexSize == REGION_HEADER_SIZE + ReadU32(index + 4)*REGION_ENTRY_SIZE) &&
+                 (ReadF32(index) > 0.0f) && (ReadF32(index) < 1e30f);
+    for (int t = 0; t < LEVEL_REGION_TYPES; t++)
+    {
+        valid = valid && (chunksSeen[t] == 1);
+    }
+
+    // each region's records start where the last one's ended and they cover every record
+    unsigned int expected[LEVEL_REGION_TYPES] = { 0 };
+    unsigned int count = valid ? ReadU32(index + 4) : 0;
+    for (unsigned int i = 0; valid && (i < count); i++)
+    {
+        const unsigned char *entry = index + REGION_HEADER_SIZE + i*REGION_ENTRY_SIZE;
+        if (i > 0)
+        {
+            int x = (int)ReadU32(entry);
+            int y = (int)ReadU32(entry + 4);
+            int lastX = (int)ReadU32(entry - REGION_ENTRY_SIZE);
+            int lastY = (int)ReadU32(entry - REGION_ENTRY_SIZE + 4);
+            valid = (y > lastY) || ((y == lastY) && (x > lastX));
+        }
+        for (int t = 0; valid && (t < LEVEL_REGION_TYPES); t++)
+        {
+            const ChunkType *chunk = ChunkOfType(regionTypes[t]);
+            unsigned int chunkSize = image->regionChunkSizes[t];
+            unsigned int records = ReadU32(entry + 28 + 8*t);
+            valid = ReadU32(entry + 24 + 8*t) == expected[t];
+            if (valid && (chunk->recordSize > 0))
+            {
+                valid = records <= (chunkSize - expected[t])/(unsigned int)chunk->recordSize;
+                expected[t] += valid ? records*(unsigned int)chunk->recordSize : 0;
+            }
+            for (unsigned int r = 0; valid && (chunk->recordSize == 0) && (r < records); r++)
+            {
+                valid = expected[t] < chunkSize;
+                expected[t] += valid ? 12 + Pad4(ReadU32(image->regionChunks[t] + expected[t] + 8)) : 0;
+            }
+        }
+    }
+    for (int t = 0; t < LEVEL_REGION_TYPES; t++)
+    {
+        valid = valid && (expected[t] == image->regionChunkSizes[t]);
+    }
+
+    if (!valid)
+    {
+        TraceLog(LOG_WARNING, "LEVEL: Region index doesn't match the level, it can only load whole");
+        for (int t = 0; t < LEVEL_REGION_TYPES; t++)
+        {
+            image->regionChunks[t] = NULL;
+            image->regionChunkSizes[t] = 0;
+        }
+        return;
+    }
+    image->regions = index + REGION_HEADER_SIZE;
+    image->regionsLen = count;
+    image->regionSize = ReadF32(index);
+}
+
+//----------------------------------------------------------------------------------
+// Level File Functions Definition
+//----------------------------------------------------------------------------------
+bool IsLevelData(const unsigned char *data, unsigned int size)
+{
+    return (size >= LEVEL_HEADER_SIZE) && (memcmp(data, "FLVL", 4) == 0);
+}
+
+bool LoadLevelFromMemory(const unsigned char *data, unsigned int size)
+{
+    if (!IsLevelData(data, size))
+    {
+        if ((size == 0) || (size % sizeof(LegacyEntity) != 0))
+        {
+            TraceLog(LOG_WARNING, "LEVEL: Not a level file");
+            return false;
+        }
+        TraceLog(LOG_INFO, "LEVEL: Loading a legacy raw level, saving will convert it");
+        return LoadLegacyLevel(data, size);
+    }
+    return ValidateLevel(data, size) && AddLevelEntities(data, size, true);
+}
+
+unsigned char *ExportLevel(unsigned int *size)
+{
+    unsigned int counts[LEVEL_TYPE_COUNT] = { 0 };
+    unsigned int chunkSizes[LEVEL_TYPE_COUNT] = { 0 };
+    int itemsLen = 0;
+    for (int i = 0; i < entitiesLen; i++)
+    {
+        if ((entities[i].type >= 0) && (entities[i].type < LEVEL_TYPE_COUNT))
+        {
+            counts[entities[i].type] += 1;
+            chunkSizes[entities[i].type] += RecordSize(&entities[i]);
+            itemsLen += (RegionTypeIndex(entities[i].type) >= 0) ? 1 : 0;
+        }
+    }
+
+    // static geometry goes out sorted by region, everything else in entity order
+    RegionItem *items = RL_MALLOC(((itemsLen > 0) ? itemsLen : 1)*sizeof(RegionItem));
+    if (items == NULL)
+    {
+        TraceLog(LOG_ERROR, "LEVEL: Failed to allocate %i region items to save", itemsLen);
+        *size = 0;
+        return NULL;
+    }
+    itemsLen = 0;
+    for (int i = 0; i < entitiesLen; i++)
+    {
+        if ((entities[i].type >= 0) && (RegionTypeIndex(entities[i].type) >= 0))
+        {
+            Rectangle bounds = RegionBounds(&entities[i]);
+            items[itemsLen++] = (RegionItem){
+                .x = LevelRegionCoord(bounds.x + bounds.width/2.0f, LEVEL_REGION_SIZE),
+                .y = LevelRegionCoord(bounds.y + bounds.height/2.0f, LEVEL_REGION_SIZE),
+                .index = i,
+            };
+        }
+    }
+    qsort(items, (size_t)itemsLen, sizeof(RegionItem), CompareRegionItems);
+    unsigned int regionsLen = 0;
+    for (int i = 0; i < itemsLen; i++)
+    {
+        if ((i == 0) || (items[i].x != items[i - 1].x) || (items[i].y != items[i - 1].y))
+        {
+            regionsLen += 1;
+        }
+    }
+
+    unsigned int total = LEVEL_HEADER_SIZE;
+    for (int i = 0; i < CHUNK_TYPES_LEN; i++)
+    {
+        total += CHUNK_HEADER_SIZE + chunkSizes[chunkTypes[i].type];
+    }
+    unsigned int regionChunkSize = REGION_HEADER_SIZE + regionsLen*REGION_ENTRY_SIZE;
+    total += CHUNK_HEADER_SIZE + regionChunkSize;
+    unsigned char *out = RL_CALLOC(total, 1);
+    if (out == NULL)
+    {
+        TraceLog(LOG_ERROR, "LEVEL: Failed to allocate %u bytes to save", total);
+        RL_FREE(items);
+        *size = 0;
+        return NULL;
+    }
+
+    memcpy(out, "FLVL", 4);
+    WriteU32(out + 4, LEVEL_VERSION);
+    for (int type = 0; type < LEVEL_TYPE_COUNT; type++)
+    {
+        WriteU32(out + 12 + 4*type, counts[type]);
+    }
+
+    unsigned int offset = LEVEL_HEADER_SIZE;
+    for (int i = 0; i < CHUNK_TYPES_LEN; i++)
+    {
+        const ChunkType *chunk = &chunkTypes[i];
+        memcpy(out + offset, chunk->tag, 4);
+        WriteU32(out + offset + 4, chunkSizes[chunk->type]);
+        offset += CHUNK_HEADER_SIZE;
+        if (RegionTypeIndex(chunk->type) >= 0)
+        {
+            for (int item = 0; item < itemsLen; item++)
+            {
+                if (entities[items[item].index].type == chunk->type)
+                {
+                    offset += WriteRecord(&entities[items[item].index], out + offset);
+                }
+            }
+            continue;
+        }
+        for (int e = 0; e < entitiesLen; e++)
+        {
+            if (entities[e].type == chunk->type)
+            {
+                offset += WriteRecord(&entities[e], out + offset);
+            }
+        }
+    }
+
+    // one entry per run of items in the same region
+    memcpy(out + offset, "REGN", 4);
+    WriteU32(out + offset + 4, regionChunkSize);
+    WriteF32(out + offset + CHUNK_HEADER_SIZE, LEVEL_REGION_SIZE);
+    WriteU32(out + offset + CHUNK_HEADER_SIZE + 4, regionsLen);
+    unsigned char *entry = out + offset + CHUNK_HEADER_SIZE + REGION_HEADER_SIZE;
+    unsigned int regionOffsets[LEVEL_REGION_TYPES] = { 0 };
+    for (int first = 0; first < itemsLen;)
+    {
+        int last = first;
+        Rectangle bounds = RegionBounds(&entities[items[first].index]);
+        unsigned int regionCounts[LEVEL_REGION_TYPES] = { 0 };
+        unsigned int regionSizes[LEVEL_REGION_TYPES] = { 0 };
+        for (; (last < itemsLen) && (items[last].x == items[first].x) && (items[last].y == items[first].y); last++)
+        {
+            const Entity *e = &entities[items[last].index];
+            int t = RegionTypeIndex(e->type);
+            if (t < 0)
+            {
+                continue;   // items only hold region types, this is for the compiler
+            }
+            Rectangle r = RegionBounds(e);
+            float right = fmaxf(bounds.x + bounds.width, r.x + r.width);
+            float bottom = fmaxf(bounds.y + bounds.height, r.y + r.height);
+            bounds.x = fminf(bounds.x, r.x);
+            bounds.y = fminf(bounds.y, r.y);
+            bounds.width = right - bounds.x;
+            bounds.height = bottom - bounds.y;
+            regionCounts[t] += 1;
+            regionSizes[t] += RecordSize(e);
+        }
+        WriteU32(entry, (unsigned int)items[first].x);
+        WriteU32(entry + 4, (unsigned int)items[first].y);
+        WriteF32(entry + 8, bounds.x);
+        WriteF32(entry + 12, bounds.y);
+        WriteF32(entry + 16, bounds.width);
+        WriteF32(entry + 20, bounds.height);
+        for (int t = 0; t < LEVEL_REGION_TYPES; t++)
+        {
+            WriteU32(entry + 24 + 8*t, regionOffsets[t]);
+            WriteU32(entry + 28 + 8*t, regionCounts[t]);
+            regionOffsets[t] += regionSizes[t];
+        }
+        entry += REGION_ENTRY_SIZE;
+        first = last;
+    }
+    RL_FREE(items);
+
+    WriteU32(out + 8, Crc32(out + 12, total - 12));
+    *size = total;
+    return out;
+}
+
+unsigned int LevelRecordSize(const Entity *e)
+{
+    return RecordSize(e);
+}
+
+unsigned int WriteLevelRecord(const Entity *e, unsigned char *out)
+{
+    return WriteRecord(e, out);
+}
+
+bool ReadLevelRecord(enum Type type, const unsigned char *data, unsigned int size, Entity *e)
+{
+    const ChunkType *chunk = ChunkOfType(type);
+    if (chunk == NULL)
+    {
+        return false;
+    }
+    if (chunk->recordSize > 0)
+    {
+        if (size != (unsigned int)chunk->recordSize)
+        {
+            return false;
+        }
+    }
+    else if ((size < 12) || (ReadU32(data + 8) > size - 12) || (12 + Pad4(ReadU32(data + 8)) != size))
+    {
+        return false;
+    }
+    ReadRecord(chunk, data, e);
+    return true;
+}
+
+unsigned int LevelChecksum(const unsigned char *data, unsigned int size)
+{
+    return Crc32(data, size);
+}
+
+bool OpenLevelImage(const char *path, LevelImage *image)
+{
+    *image = (LevelImage){ 0 };
+    if (!MapFile(path, &image->file))
+    {
+        TraceLog(LOG_WARNING, "LEVEL: [%s] Failed to open file", path);
+        return false;
+    }
+
+    const unsigned char *data = image->file.data;
+    unsigned int size = image->file.size;
+    if (!IsLevelData(data, size))
+    {
+        image->legacy = (size % sizeof(LegacyEntity)) == 0;
+        if (!image->legacy)
+        {
+            TraceLog(LOG_WARNING, "LEVEL: [%s] Not a level file", path);
+            CloseLevelImage(image);
+        }
+        return image->legacy;
+    }
+    if (!ValidateLevel(data, size))
+    {
+        CloseLevelImage(image);
+        return false;
+    }
+    image->checksum = ReadU32(data + 8);
+    FindRegionIndex(image);
+    return true;
+}
+
+void CloseLevelImage(LevelImage *image)
+{
+    UnmapFile(&image->file);
+    *image = (LevelImage){ 0 };
+}
+
+bool LoadLevelImage(const LevelImage *image)
+{
+    if (image->file.data == NULL)
+    {
+        return false;
+    }
+    if (image->legacy)
+    {
+        TraceLog(LOG_INFO, "LEVEL: Loading a legacy raw level, saving will convert it");
+        return LoadLegacyLevel(image->file.data, image->file.size);
+    }
+    return AddLevelEntities(image->file.data, image->file.size, true);
+}
+
+bool LoadLevelImageWithoutRegions(const LevelImage *image)
+{
+    if ((image->file.data == NULL) || image->legacy)
+    {
+        return false;
+    }
+    return AddLevelEntities(image->file.data, image->file.size, false);
+}
+
+bool GetLevelRegion(const LevelImage *image, unsigned int index, LevelRegion *region)
+{
+    if (index >= image->regionsLen)
+    {
+        return false;
+    }
+    const unsigned char *entry = image->regions + index*REGION_ENTRY_SIZE;
+    region->x = (int)ReadU32(entry);
+    region->y = (int)ReadU32(entry + 4);
+    region->bounds = (Rectangle){ ReadF32(entry + 8), ReadF32(entry + 12), ReadF32(entry + 16), ReadF32(entry + 20) };
+    for (int t = 0; t < LEVEL_REGION_TYPES; t++)
+    {
+        // a region's records run up to where the next one's start
+        unsigned int offset = ReadU32(entry + 24 + 8*t);
+        unsigned int end = (index + 1 < image->regionsLen) ? ReadU32(entry + REGION_ENTRY_SIZE + 24 + 8*t) : image->regionChunkSizes[t];
+        region->records[t] = image->regionChunks[t] + offset;
+        region->sizes[t] = end - offset;
+        region->counts[t] = ReadU32(entry + 28 + 8*t);
+    }
+    return true;
+}
+
+unsigned int FindLevelRegion(const LevelImage *image, int x, int y)
+{
+    unsigned int low = 0;
+    unsigned int high = image->regionsLen;
+    while (low < high)
+    {
+        unsigned int middle = low + (high - low)/2;
+        const unsigned char *entry = image->regions + middle*REGION_ENTRY_SIZE;
+        int middleX = (int)ReadU32(entry);
+        int middleY = (int)ReadU32(entry + 4);
+        if ((middleY < y) || ((middleY == y) && (middleX < x)))
+        {
+            low = middle + 1;
+        }
+        else
+        {
+            high = middle;
+        }
+    }
+    return low;
+}
+
+int AddLevelRegionEntities(const LevelRegion *region, ID *ids)
+{
+    unsigned int total = 0;
+    for (int t = 0; t < LEVEL_REGION_TYPES; t++)
+    {
+        total += region->counts[t];
+    }
+    ReserveEntities(entitiesLen + (int)total);
+
+    int added = 0;
+    for (int t = 0; t < LEVEL_REGION_TYPES; t++)
+    {
+        added += AddRecords(ChunkOfType(regionTypes[t]), region->records[t], region->sizes[t], (ids != NULL) ? ids + added : NULL);
+    }
+    return added;
+}
+
+int LevelRegionCoord(float coord, float regionSize)
+{
+    float square = floorf(coord/regionSize);
+    // NaN fails both comparisons and lands on 0
+    if (!(square > -1e9f))
+    {
+        return (square < 0.0f) ? -1000000000 : 0;
+    }
+    return (square < 1e9f) ? (int)square : 1000000000;
+}
+
+enum Type LevelChunkType(int chunk)
+{
+    return ((chunk >= 0) && (chunk < CHUNK_TYPES_LEN)) ? chunkTypes[chunk].type : Tombstone;
+}
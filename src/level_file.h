@@ -0,0 +1,114 @@
+/**********************************************************************************************
+*
+*   Level files
+*
+*   Levels are saved as a small header followed by one chunk per entity type, each a packed
+*   array of just the fields that make up a level (no ids, timers or what's being held).
+*   All values are little endian, records are 4 byte aligned. Layout:
+*
+*       header  "FLVL" | u32 version | u32 crc32 of everything after it
+*               u32 entity count for each type, in enum Type order
+*       chunks  4 character tag | u32 payload size | payload, padded to 4 bytes
+*
+*       PLYR    pos, vel, health                    f32 x5
+*       GRND    rect                                f32 x4
+*       OBST    rect                                f32 x4
+*       FIRE    rect, fireLeft                      f32 x5
+*       EXTG    pos, vel, amountUsed                f32 x5
+*       HELP    pos, u32 text length, text          f32 x2, then the text padded to 4
+*
+*   Chunks come in draw order: ground under obstacles under fire under help text. Unknown
+*   chunks are skipped, so a newer minor addition still loads.
+*
+*   Ground, obstacle and help text records are grouped by region, the LEVEL_REGION_SIZE
+*   square their center is in, and REGN says where each region's records are so they can be
+*   streamed in without reading the rest:
+*
+*       REGN    f32 region size | u32 region count, then for each region by y, then x:
+*               i32 x, i32 y | bounds f32 x4 | u32 offset, u32 count into GRND, OBST, HELP
+*
+*   Files from before this format were raw dumps of the Entity struct, 264 bytes each. They
+*   still load, and saving writes them back in this format.
+*
+*   A LevelImage keeps a level file memory mapped after it's loaded. It's checked once when
+*   it's opened and ground and obstacle rects are read straight out of the mapping, so
+*   loading it again doesn't read or check the file again. If it has regions they can be
+*   loaded one at a time from the mapping instead, see level_stream.h.
+*
+*   Copyright (c) 2022 creikey
+*
+**********************************************************************************************/
+
+#ifndef LEVEL_FILE_H
+#define LEVEL_FILE_H
+
+#include "raylib.h"
+#include "entities.h"
+#include "mapped_file.h"
+
+#define LEVEL_VERSION 1
+#define LEVEL_MAX_PATH 256          // level paths longer than this get cut short
+
+#define LEVEL_REGION_SIZE 1024.0f   // side of the squares static geometry is grouped by when saving
+#define LEVEL_REGION_TYPES 3        // ground, obstacle and help text, the types regions hold
+
+//----------------------------------------------------------------------------------
+// Types and Structures Definition
+//----------------------------------------------------------------------------------
+
+// A validated level file, mapped read only
+typedef struct LevelImage
+{
+    MappedFile file;
+    bool legacy;            // a raw dump, loaded the slow way
+    unsigned int checksum;  // from the header, journals are tied to it. 0 for legacy files
+
+    const unsigned char *regions;   // REGN entries, NULL when the level isn't split into regions
+    unsigned int regionsLen;
+    float regionSize;
+    const unsigned char *regionChunks[LEVEL_REGION_TYPES];  // the GRND, OBST and HELP payloads they point into
+    unsigned int regionChunkSizes[LEVEL_REGION_TYPES];
+} LevelImage;
+
+// One region of a LevelImage, pointing into the mapping
+typedef struct LevelRegion
+{
+    int x;                  // which square, in regions
+    int y;
+    Rectangle bounds;       // around everything in it, big rects reach past the square
+    const unsigned char *records[LEVEL_REGION_TYPES];   // ground, obstacle and help text
+    unsigned int sizes[LEVEL_REGION_TYPES];             // bytes of records
+    unsigned int counts[LEVEL_REGION_TYPES];
+} LevelRegion;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//----------------------------------------------------------------------------------
+// Level File Functions Declaration
+//----------------------------------------------------------------------------------
+bool IsLevelData(const unsigned char *data, unsigned int size);         // the chunked format, not a legacy dump
+bool LoadLevelFromMemory(const unsigned char *data, unsigned int size); // replaces every entity, false if the data is bad
+unsigned char *ExportLevel(unsigned int *size);                         // the entities as a level file, RL_FREE it
+
+unsigned int LevelRecordSize(const Entity *e);                         // bytes WriteLevelRecord takes, 0 for types levels don't save
+unsigned int WriteLevelRecord(const Entity *e, unsigned char *out);     // one record as it's saved in its chunk
+bool ReadLevelRecord(enum Type type, const unsigned char *data, unsigned int size, Entity *e); // false unless it's exactly one record
+unsigned int LevelChecksum(const unsigned char *data, unsigned int size);   // the CRC32 level headers use
+
+bool OpenLevelImage(const char *path, LevelImage *image);   // maps and validates, false leaves image closed
+void CloseLevelImage(LevelImage *image);                    // fine on a closed image
+bool LoadLevelImage(const LevelImage *image);               // replaces every entity, no checks or copies of the file
+bool LoadLevelImageWithoutRegions(const LevelImage *image); // same but leaves out what regions hold, for streaming it in
+bool GetLevelRegion(const LevelImage *image, unsigned int index, LevelRegion *region);  // false past the last
+unsigned int FindLevelRegion(const LevelImage *image, int x, int y);    // first region at or after x, y in row order
+int AddLevelRegionEntities(const LevelRegion *region, ID *ids);         // adds its entities, handles into ids if not NULL
+int LevelRegionCoord(float coord, float regionSize);    // the square a coordinate is in, safe for any float
+enum Type LevelChunkType(int chunk);    // type of the chunk-th chunk in a saved level, Tombstone past the last
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // LEVEL_FILE_H
@@ -0,0 +1,466 @@
+/**********************************************************************************************
+*
+*   Level journals: editor saves appended next to the level instead of rewriting it
+*
+*   Copyright (c) 2022 creikey
+*
+**********************************************************************************************/
+
+#include "level_journal.h"
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+#define JOURNAL_HEADER_SIZE 12
+#define BATCH_HEADER_SIZE 12
+#define OP_HEADER_SIZE 16
+#define MIN_JOURNAL_CAPACITY 64
+
+enum JournalOp
+{
+    JOURNAL_ADD = 1,
+    JOURNAL_SET,
+    JOURNAL_DELETE,
+};
+
+//----------------------------------------------------------------------------------
+// Module Functions Definition (local)
+//----------------------------------------------------------------------------------
+static void WriteU32(unsigned char *out, unsigned int value)
+{
+    out[0] = (unsigned char)(value & 0xff);
+    out[1] = (unsigned char)((value >> 8) & 0xff);
+    out[2] = (unsigned char)((value >> 16) & 0xff);
+    out[3] = (unsigned char)((value >> 24) & 0xff);
+}
+
+static unsigned int ReadU32(const unsigned char *in)
+{
+    return (unsigned int)in[0] | ((unsigned int)in[1] << 8) | ((unsigned int)in[2] << 16) | ((unsigned int)in[3] << 24);
+}
+
+static bool GrowJournalArray(void **array, int *capacity, int wanted, int elementSize)
+{
+    if (wanted <= *capacity)
+    {
+        return true;
+    }
+    int newCapacity = (*capacity < MIN_JOURNAL_CAPACITY) ? MIN_JOURNAL_CAPACITY : *capacity;
+    while (newCapacity < wanted)
+    {
+        newCapacity *= 2;
+    }
+    void *newArray = RL_REALLOC(*array, (size_t)newCapacity * elementSize);
+    if (newArray == NULL)
+    {
+        TraceLog(LOG_ERROR, "JOURNAL: Failed to grow storage to %i elements", newCapacity);
+        return false;
+    }
+    *array = newArray;
+    *capacity = newCapacity;
+    return true;
+}
+
+// slotKeys and slotEdited cover every handle slot up to id
+static bool CoverSlot(LevelJournal *journal, ID id)
+{
+    if ((int)id.index < journal->slotsCapacity)
+    {
+        return true;
+    }
+    int keysCapacity = journal->slotsCapacity;
+    int editedCapacity = journal->slotsCapacity;
+    if (!GrowJournalArray((void **)&journal->slotKeys, &keysCapacity, (int)id.index + 1, sizeof(int)) ||
+        !GrowJournalArray((void **)&journal->slotEdited, &editedCapacity, keysCapacity, sizeof(ID)))
+    {
+        return false;
+    }
+    for (int i = journal->slotsCapacity; i < keysCapacity; i++)
+    {
+        journal->slotKeys[i] = -1;
+        journal->slotEdited[i] = NULL_ID;
+    }
+    journal->slotsCapacity = keysCapacity;
+    return true;
+}
+
+static int KeyOf(const LevelJournal *journal, ID id)
+{
+    if ((int)id.index >= journal->slotsCapacity)
+    {
+        return -1;
+    }
+    int key = journal->slotKeys[id.index];
+    return ((key >= 0) && IDEquals(journal->keyIDs[key], id)) ? key : -1;
+}
+
+static bool AddKey(LevelJournal *journal, ID id)
+{
+    if (!CoverSlot(journal, id) ||
+        !GrowJournalArray((void **)&journal->keyIDs, &journal->keysCapacity, journal->keysLen + 1, sizeof(ID)))
+    {
+        return false;
+    }
+    journal->keyIDs[journal->keysLen] = id;
+    journal->slotKeys[id.index] = journal->keysLen;
+    journal->keysLen += 1;
+    return true;
+}
+
+// What saving an edited entity writes, 0 for nothing: it was added and deleted again,
+// or it's something levels don't keep
+static unsigned int OpFor(const LevelJournal *journal, ID id, const Entity *e)
+{
+    bool keyed = KeyOf(journal, id) >= 0;
+    if (e == NULL)
+    {
+        return keyed ? JOURNAL_DELETE : 0;
+    }
+    if (LevelRecordSize(e) == 0)
+    {
+        return 0;
+    }
+    if (keyed)
+    {
+        return JOURNAL_SET;
+    }
+    return (e->type != Player) ? JOURNAL_ADD : 0;
+}
+
+// The base file's records are the first keys, in the order they're saved: chunk by chunk,
+// each chunk in the order its entities loaded. Going by chunk rather than by entity order
+// matters for streamed levels, where the static geometry arrives after everything else
+static void ResetKeys(LevelJournal *journal)
+{
+    journal->keysLen = 0;
+    journal->editedLen = 0;
+    for (int i = 0; i < journal->slotsCapacity; i++)
+    {
+        journal->slotKeys[i] = -1;
+        journal->slotEdited[i] = NULL_ID;
+    }
+    for (int chunk = 0; LevelChunkType(chunk) != Tombstone; chunk++)
+    {
+        for (int i = 0; i < entitiesLen; i++)
+        {
+            if (entities[i].type == LevelChunkType(chunk))
+            {
+                AddKey(journal, entities[i].id);
+            }
+        }
+    }
+}
+
+static bool AppendData(LevelJournal *journal, const unsigned char *data, int size)
+{
+    if (!GrowJournalArray((void **)&journal->data, &journal->dataCapacity, journal->dataLen + size, 1))
+    {
+        return false;
+    }
+    memcpy(journal->data + journal->dataLen, data, size);
+    journal->dataLen += size;
+    return true;
+}
+
+// Puts what a SET op saved onto the entity. False if it moved an extinguisher
+static bool SetFromRecord(Entity *e, const Entity *saved)
+{
+    switch (e->type)
+    {
+    case Player:
+    {
+        e->player.k.pos = saved->player.k.pos;
+        e->player.k.vel = saved->player.k.vel;
+        e->player.health = saved->player.health;
+        e->player.prevPos = saved->player.k.pos;
+    } break;
+    case Obstacle:
+    case Ground: SetEntityRect(e->id, saved->ground); break;
+    case Fire:
+    {
+        SetEntityRect(e->id, saved->fire.rect);
+        e->fire.fireLeft = saved->fire.fireLeft;
+    } break;
+    case Extinguisher:
+    {
+        e->extinguisher.info.pos = saved->extinguisher.info.pos;
+        e->extinguisher.info.vel = saved->extinguisher.info.vel;
+        e->extinguisher.amountUsed = saved->extinguisher.amountUsed;
+        e->extinguisher.prevPos = saved->extinguisher.info.pos;
+        return false;
+    }
+    case HelpText: e->help = saved->help; break;
+    default: break;
+    }
+    return true;
+}
+
+// Applies one batch that passed its checksum. Returns false if an extinguisher was moved
+static bool ApplyBatch(LevelJournal *journal, const unsigned char *payload, unsigned int size)
+{
+    bool bodiesKept = true;
+    unsigned int at = 0;
+    while (size - at >= OP_HEADER_SIZE)
+    {
+        unsigned int op = ReadU32(payload + at);
+        unsigned int key = ReadU32(payload + at + 4);
+        enum Type type = (enum Type)ReadU32(payload + at + 8);
+        unsigned int recordSize = ReadU32(payload + at + 12);
+        if (recordSize > size - at - OP_HEADER_SIZE)
+        {
+            TraceLog(LOG_WARNING, "JOURNAL: Operation runs past its batch");
+            break;
+        }
+        const unsigned char *record = payload + at + OP_HEADER_SIZE;
+        at += OP_HEADER_SIZE + recordSize;
+
+        Entity saved = { 0 };
+        Entity *e = (key < (unsigned int)journal->keysLen) ? GetEntity(journal->keyIDs[key]) : NULL;
+        switch (op)
+        {
+        case JOURNAL_ADD:
+        {
+            Entity *added = NULL;
+            if ((key == (unsigned int)journal->keysLen) && (type != Player) && ReadLevelRecord(type, record, recordSize, &saved))
+            {
+                added = AddEntity(saved);
+            }
+            if (added == NULL)
+            {
+                TraceLog(LOG_WARNING, "JOURNAL: Couldn't add level key %u", key);
+                continue;
+            }
+            AddKey(journal, added->id);
+            bodiesKept = bodiesKept && (type != Extinguisher);
+        } break;
+        case JOURNAL_SET:
+        {
+            if ((e == NULL) || (e->type != type) || !ReadLevelRecord(type, record, recordSize, &saved))
+            {
+                TraceLog(LOG_WARNING, "JOURNAL: Couldn't change level key %u", key);
+                continue;
+            }
+            bodiesKept = SetFromRecord(e, &saved) && bodiesKept;
+        } break;
+        case JOURNAL_DELETE:
+        {
+            if ((e == NULL) || (e->type == Player))
+            {
+                TraceLog(LOG_WARNING, "JOURNAL: Couldn't delete level key %u", key);
+                continue;
+            }
+            bodiesKept = bodiesKept && (e->type != Extinguisher);
+            DeleteEntity(e->id);
+            journal->keyIDs[key] = NULL_ID;
+        } break;
+        default:
+        {
+            TraceLog(LOG_WARNING, "JOURNAL: Unknown operation %u", op);
+        } break;
+        }
+    }
+    CompactEntities();
+    return bodiesKept;
+}
+
+//----------------------------------------------------------------------------------
+// Level Journal Functions Definition
+//----------------------------------------------------------------------------------
+void OpenLevelJournal(LevelJournal *journal, const char *levelPath, unsigned int baseChecksum)
+{
+    journal->open = false;
+    journal->dataLen = 0;
+    journal->editedLen = 0;
+    journal->baseChecksum = baseChecksum;
+    snprintf(journal->path, sizeof(journal->path), "%s.journal", levelPath);
+    if (baseChecksum == 0)
+    {
+        return; // legacy levels are saved whole, which converts them
+    }
+    journal->open = true;
+    if (!FileExists(journal->path))
+    {
+        return;
+    }
+
+    unsigned int size = 0;
+    unsigned char *data = LoadFileData(journal->path, &size);
+    if ((data == NULL) || (size < JOURNAL_HEADER_SIZE) || (memcmp(data, "FJRN", 4) != 0) ||
+        (ReadU32(data + 4) > LEVEL_JOURNAL_VERSION))
+    {
+        TraceLog(LOG_WARNING, "JOURNAL: [%s] Not a journal this version can read, ignoring it", journal->path);
+    }
+    else if (ReadU32(data + 8) != baseChecksum)
+    {
+        TraceLog(LOG_WARNING, "JOURNAL: [%s] Written against a different version of the level, ignoring it", journal->path);
+    }
+    else
+    {
+        AppendData(journal, data, (int)size);
+    }
+    UnloadFileData(data);
+}
+
+bool ApplyLevelJournal(LevelJournal *journal)
+{
+    ResetKeys(journal);
+    if (!journal->open || (journal->dataLen == 0))
+    {
+        return true;
+    }
+
+    bool bodiesKept = true;
+    int batches = 0;
+    int offset = JOURNAL_HEADER_SIZE;
+    while (offset < journal->dataLen)
+    {
+        const unsigned char *batch = journal->data + offset;
+        unsigned int left = (unsigned int)(journal->dataLen - offset);
+        if ((left < BATCH_HEADER_SIZE) || (memcmp(batch, "BTCH", 4) != 0) || (ReadU32(batch + 4) > left - BATCH_HEADER_SIZE) ||
+            (ReadU32(batch + 8) != LevelChecksum(batch + BATCH_HEADER_SIZE, ReadU32(batch + 4))))
+        {
+            // cut short or corrupt. Everything before it still stands, the rest goes so the
+            // next save appends after the good batches
+            TraceLog(LOG_WARNING, "JOURNAL: [%s] Dropping a damaged save after %i good ones", journal->path, batches);
+            journal->dataLen = offset;
+            SaveFileData(journal->path, journal->data, (unsigned int)journal->dataLen);
+            break;
+        }
+        bodiesKept = ApplyBatch(journal, batch + BATCH_HEADER_SIZE, ReadU32(batch + 4)) && bodiesKept;
+        offset += BATCH_HEADER_SIZE + (int)ReadU32(batch + 4);
+        batches += 1;
+    }
+    if (!bodiesKept)
+    {
+        ResetEntityBodies();
+    }
+    return GetPlayerEntity() != NULL;
+}
+
+bool LevelJournalHasEdits(const LevelJournal *journal)
+{
+    return journal->open && (journal->dataLen > JOURNAL_HEADER_SIZE);
+}
+
+void NoteLevelJournalEdit(LevelJournal *journal, ID id)
+{
+    if ((id.generation == 0) || !CoverSlot(journal, id) || IDEquals(journal->slotEdited[id.index], id) ||
+        !GrowJournalArray((void **)&journal->edited, &journal->editedCapacity, journal->editedLen + 1, sizeof(ID)))
+    {
+        return;
+    }
+    journal->slotEdited[id.index] = id;
+    journal->edited[journal->editedLen++] = id;
+}
+
+int SaveLevelJournal(LevelJournal *journal)
+{
+    if (!journal->open)
+    {
+        return -1;
+    }
+
+    // sized first so the batch goes out in one write
+    unsigned int payloadSize = 0;
+    for (int i = 0; i < journal->editedLen; i++)
+    {
+        const Entity *e = GetEntity(journal->edited[i]);
+        if (OpFor(journal, journal->edited[i], e) != 0)
+        {
+            payloadSize += OP_HEADER_SIZE + ((e != NULL) ? LevelRecordSize(e) : 0);
+        }
+    }
+    if (payloadSize == 0)
+    {
+        journal->editedLen = 0;
+        return 0;
+    }
+
+    bool newFile = journal->dataLen == 0;
+    unsigned int size = (newFile ? JOURNAL_HEADER_SIZE : 0) + BATCH_HEADER_SIZE + payloadSize;
+    unsigned char *out = RL_CALLOC(size, 1);
+    if (out == NULL)
+    {
+        TraceLog(LOG_ERROR, "JOURNAL: Failed to allocate %u bytes to save", size);
+        return -1;
+    }
+    unsigned char *batch = out;
+    if (newFile)
+    {
+        memcpy(out, "FJRN", 4);
+        WriteU32(out + 4, LEVEL_JOURNAL_VERSION);
+        WriteU32(out + 8, journal->baseChecksum);
+        batch += JOURNAL_HEADER_SIZE;
+    }
+    memcpy(batch, "BTCH", 4);
+    WriteU32(batch + 4, payloadSize);
+
+    int nextKey = journal->keysLen;
+    unsigned char *op = batch + BATCH_HEADER_SIZE;
+    for (int i = 0; i < journal->editedLen; i++)
+    {
+        const Entity *e = GetEntity(journal->edited[i]);
+        unsigned int kind = OpFor(journal, journal->edited[i], e);
+        if (kind == 0)
+        {
+            continue;
+        }
+        int key = KeyOf(journal, journal->edited[i]);
+        unsigned int recordSize = (e != NULL) ? WriteLevelRecord(e, op + OP_HEADER_SIZE) : 0;
+        WriteU32(op, kind);
+        WriteU32(op + 4, (kind == JOURNAL_ADD) ? (unsigned int)nextKey++ : (unsigned int)key);
+        WriteU32(op + 8, (e != NULL) ? (unsigned int)e->type : 0u);
+        WriteU32(op + 12, recordSize);
+        op += OP_HEADER_SIZE + recordSize;
+    }
+    WriteU32(batch + 8, LevelChecksum(batch + BATCH_HEADER_SIZE, payloadSize));
+
+    FILE *file = fopen(journal->path, newFile ? "wb" : "ab");
+    bool written = (file != NULL) && (fwrite(out, 1, size, file) == size);
+    written = (file != NULL) && (fclose(file) == 0) && written;
+    if (!written || !AppendData(journal, out, (int)size))
+    {
+        TraceLog(LOG_WARNING, "JOURNAL: [%s] Failed to write", journal->path);
+        RL_FREE(out);
+        return -1;
+    }
+    RL_FREE(out);
+
+    // the keys the file now has
+    for (int i = 0; i < journal->editedLen; i++)
+    {
+        const Entity *e = GetEntity(journal->edited[i]);
+        unsigned int kind = OpFor(journal, journal->edited[i], e);
+        if (kind == JOURNAL_DELETE)
+        {
+            journal->keyIDs[KeyOf(journal, journal->edited[i])] = NULL_ID;
+        }
+        else if (kind == JOURNAL_ADD)
+        {
+            AddKey(journal, e->id);
+        }
+        journal->slotEdited[journal->edited[i].index] = NULL_ID;
+    }
+    journal->editedLen = 0;
+    return (int)size;
+}
+
+void CloseLevelJournal(LevelJournal *journal)
+{
+    RL_FREE(journal->data);
+    RL_FREE(journal->keyIDs);
+    RL_FREE(journal->slotKeys);
+    RL_FREE(journal->edited);
+    RL_FREE(journal->slotEdited);
+    *journal = (LevelJournal){ 0 };
+}
+
+void RemoveLevelJournal(const char *levelPath)
+{
+    char path[LEVEL_MAX_PATH + 16] = { 0 };
+    snprintf(path, sizeof(path), "%s.journal", levelPath);
+    if (FileExists(path))
+    {
+        remove(path);
+    }
+}
@@ -0,0 +1,77 @@
+/**********************************************************************************************
+*
+*   Level journals: editor saves appended next to the level instead of rewriting it
+*
+*   level.journal sits next to level and holds batches of operations on it, one batch per
+*   save. Loading the level loads the base file and then replays the batches in order. An
+*   edit costs a write the size of the entities it touched, however big the level is.
+*
+*   Operations name entities by level key: the record number in the base file, then the
+*   next number for every entity a journal adds. Keys aren't reused. Layout:
+*
+*       header  "FJRN" | u32 version | u32 checksum of the base level it applies to
+*       batch   "BTCH" | u32 payload size | u32 crc32 of the payload | payload
+*       op      u32 op | u32 key | u32 type | u32 record size | record, as in the level file
+*
+*   A batch cut short by a crash fails its checksum, so it and anything after it is dropped
+*   and the level loads as of the last good save. A journal whose base was rewritten is
+*   ignored.
+*
+*   Copyright (c) 2022 creikey
+*
+**********************************************************************************************/
+
+#ifndef LEVEL_JOURNAL_H
+#define LEVEL_JOURNAL_H
+
+#include "raylib.h"
+#include "entities.h"
+#include "level_file.h"
+
+#define LEVEL_JOURNAL_VERSION 1
+
+//----------------------------------------------------------------------------------
+// Types and Structures Definition
+//----------------------------------------------------------------------------------
+typedef struct LevelJournal
+{
+    char path[LEVEL_MAX_PATH + 16]; // the level's path plus .journal
+    unsigned int baseChecksum;
+    bool open;
+
+    unsigned char *data;    // the file as it is on disk, so replaying doesn't read it again
+    int dataLen;
+    int dataCapacity;
+
+    ID *keyIDs;             // the entity each level key made, NULL_ID once deleted
+    int keysLen;
+    int keysCapacity;
+    int *slotKeys;          // level key of the entity in each handle slot, -1 for none
+    int slotsCapacity;
+
+    ID *edited;             // touched since the last save, in the order they were first touched
+    int editedLen;
+    int editedCapacity;
+    ID *slotEdited;         // dedupes edited by handle slot
+} LevelJournal;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//----------------------------------------------------------------------------------
+// Level Journal Functions Declaration
+//----------------------------------------------------------------------------------
+void OpenLevelJournal(LevelJournal *journal, const char *levelPath, unsigned int baseChecksum); // reads the journal if there is one
+bool ApplyLevelJournal(LevelJournal *journal);  // right after the base loaded, replays every batch and numbers the keys
+bool LevelJournalHasEdits(const LevelJournal *journal);     // there are saves on top of the base file
+void NoteLevelJournalEdit(LevelJournal *journal, ID id);    // added, changed or about to be deleted
+int SaveLevelJournal(LevelJournal *journal);    // appends the edits as one batch, bytes written or -1
+void CloseLevelJournal(LevelJournal *journal);  // frees everything, the file stays
+void RemoveLevelJournal(const char *levelPath); // after the level was saved whole
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // LEVEL_JOURNAL_H
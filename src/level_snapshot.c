@@ -0,0 +1,182 @@
+/**********************************************************************************************
+*
+*   Level snapshots: the mutable state of a level, captured once after it loads
+*
+*   Copyright (c) 2022 creikey
+*
+**********************************************************************************************/
+
+#include "level_snapshot.h"
+#include <stddef.h>
+
+#define MIN_SNAPSHOT_CAPACITY 16
+
+//----------------------------------------------------------------------------------
+// Module Functions Definition (local)
+//----------------------------------------------------------------------------------
+static bool ReserveSnapshot(void **array, int *capacity, int wanted, int elementSize)
+{
+    if (wanted <= *capacity)
+    {
+        return true;
+    }
+    int newCapacity = (wanted < MIN_SNAPSHOT_CAPACITY) ? MIN_SNAPSHOT_CAPACITY : wanted;
+    void *newArray = RL_REALLOC(*array, (size_t)newCapacity * elementSize);
+    if (newArray == NULL)
+    {
+        TraceLog(LOG_ERROR, "SNAPSHOT: Failed to grow storage to %i elements", newCapacity);
+        return false;
+    }
+    *array = newArray;
+    *capacity = newCapacity;
+    return true;
+}
+
+static bool KinematicsEqual(KinematicInfo a, KinematicInfo b)
+{
+    return (a.pos.x == b.pos.x) && (a.pos.y == b.pos.y) && (a.vel.x == b.vel.x) && (a.vel.y == b.vel.y) && (a.onGround == b.onGround);
+}
+
+//----------------------------------------------------------------------------------
+// Level Snapshot Functions Definition
+//----------------------------------------------------------------------------------
+bool CaptureLevelSnapshot(LevelSnapshot *snapshot)
+{
+    snapshot->captured = false;
+    Entity *player = GetPlayerEntity();
+    const EntityComponents *c = GetEntityComponents();
+    if ((player == NULL) ||
+        !ReserveSnapshot((void **)&snapshot->fires, &snapshot->firesCapacity, c->firesLen, sizeof(FireSnapshot)) ||
+        !ReserveSnapshot((void **)&snapshot->extinguishers, &snapshot->extinguishersCapacity, c->extinguishersLen, sizeof(ExtinguisherSnapshot)))
+    {
+        return false;
+    }
+
+    snapshot->playerID = player->id;
+    snapshot->player = player->player.k;
+    snapshot->playerHealth = player->player.health;
+    for (int i = 0; i < c->firesLen; i++)
+    {
+        snapshot->fires[i] = (FireSnapshot){ c->fireIDs[i], GetEntity(c->fireIDs[i])->fire.fireLeft };
+    }
+    snapshot->firesLen = c->firesLen;
+    for (int i = 0; i < c->extinguishersLen; i++)
+    {
+        const Entity *e = GetEntity(c->extinguisherIDs[i]);
+        snapshot->extinguishers[i] = (ExtinguisherSnapshot){ e->id, e->extinguisher.info, e->extinguisher.amountUsed };
+    }
+    snapshot->extinguishersLen = c->extinguishersLen;
+    snapshot->captured = true;
+    return true;
+}
+
+int RestoreLevelSnapshot(const LevelSnapshot *snapshot)
+{
+    const EntityComponents *c = GetEntityComponents();
+    Entity *player = GetEntity(snapshot->playerID);
+    if (!snapshot->captured || (player == NULL) ||
+        (c->firesLen != snapshot->firesLen) || (c->extinguishersLen != snapshot->extinguishersLen))
+    {
+        return -1;
+    }
+    for (int i = 0; i < snapshot->firesLen; i++)
+    {
+        if (GetEntity(snapshot->fires[i].id) == NULL)
+        {
+            return -1;
+        }
+    }
+    for (int i = 0; i < snapshot->extinguishersLen; i++)
+    {
+        if (GetEntity(snapshot->extinguishers[i].id) == NULL)
+        {
+            return -1;
+        }
+    }
+
+    player->player.k = snapshot->player;
+    player->player.health = snapshot->playerHealth;
+    player->player.grabbedEntity = NULL_ID;
+    int written = 1;
+
+    for (int i = 0; i < snapshot->firesLen; i++)
+    {
+        FireData *fire = &GetEntity(snapshot->fires[i].id)->fire;
+        if ((fire->fireLeft != snapshot->fires[i].fireLeft) || (fire->fireParticleTimer != 0.0f))
+        {
+            fire->fireLeft = snapshot->fires[i].fireLeft;
+            fire->fireParticleTimer = 0.0f;
+            written += 1;
+        }
+    }
+
+    bool moved = false;
+    for (int i = 0; i < snapshot->extinguishersLen; i++)
+    {
+        const ExtinguisherSnapshot *saved = &snapshot->extinguishers[i];
+        ExtinguisherData *extinguisher = &GetEntity(saved->id)->extinguisher;
+        if (!KinematicsEqual(extinguisher->info, saved->info) || (extinguisher->amountUsed != saved->amountUsed))
+        {
+            extinguisher->info = saved->info;
+            extinguisher->amountUsed = saved->amountUsed;
+            extinguisher->prevPos = saved->info.pos;
+            moved = true;
+            written += 1;
+        }
+    }
+    // untouched extinguishers leave the tree as it was
+    if (moved)
+    {
+        ResetEntityBodies();
+    }
+    return written;
+}
+
+// Only compares what a level file keeps, timers and onGround don't count as changes
+int FindSnapshotChanges(const LevelSnapshot *snapshot, SnapshotChangeCallback callback, void *context)
+{
+    if (!snapshot->captured)
+    {
+        return 0;
+    }
+    int found = 0;
+    const Entity *player = GetEntity(snapshot->playerID);
+    if ((player != NULL) &&
+        ((player->player.k.pos.x != snapshot->player.pos.x) || (player->player.k.pos.y != snapshot->player.pos.y) ||
+         (player->player.k.vel.x != snapshot->player.vel.x) || (player->player.k.vel.y != snapshot->player.vel.y) ||
+         (player->player.health != snapshot->playerHealth)))
+    {
+        callback(player->id, context);
+        found += 1;
+    }
+    for (int i = 0; i < snapshot->firesLen; i++)
+    {
+        const Entity *fire = GetEntity(snapshot->fires[i].id);
+        if ((fire != NULL) && (fire->fire.fireLeft != snapshot->fires[i].fireLeft))
+        {
+            callback(fire->id, context);
+            found += 1;
+        }
+    }
+    for (int i = 0; i < snapshot->extinguishersLen; i++)
+    {
+        const ExtinguisherSnapshot *saved = &snapshot->extinguishers[i];
+        const Entity *e = GetEntity(saved->id);
+        if ((e != NULL) &&
+            ((e->extinguisher.info.pos.x != saved->info.pos.x) || (e->extinguisher.info.pos.y != saved->info.pos.y) ||
+             (e->extinguisher.info.vel.x != saved->info.vel.x) || (e->extinguisher.info.vel.y != saved->info.vel.y) ||
+             (e->extinguisher.amountUsed != saved->amountUsed)))
+        {
+            callback(e->id, context);
+            found += 1;
+        }
+    }
+    return found;
+}
+
+void UnloadLevelSnapshot(LevelSnapshot *snapshot)
+{
+    RL_FREE(snapshot->fires);
+    RL_FREE(snapshot->extinguishers);
+    *snapshot = (LevelSnapshot){ 0 };
+}
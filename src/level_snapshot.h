@@ -0,0 +1,69 @@
+/**********************************************************************************************
+*
+*   Level snapshots: the mutable state of a level, captured once after it loads
+*
+*   Only the player, fire and extinguisher state that playing changes is kept, keyed by
+*   entity handle. Restoring compares each entity against its snapshot and only writes the
+*   ones that changed, so putting a level back after dying is a pass over a few small
+*   arrays instead of a file read and a rebuild of every entity.
+*
+*   Copyright (c) 2022 creikey
+*
+**********************************************************************************************/
+
+#ifndef LEVEL_SNAPSHOT_H
+#define LEVEL_SNAPSHOT_H
+
+#include "raylib.h"
+#include "entities.h"
+
+//----------------------------------------------------------------------------------
+// Types and Structures Definition
+//----------------------------------------------------------------------------------
+typedef struct FireSnapshot
+{
+    ID id;
+    float fireLeft;
+} FireSnapshot;
+
+typedef struct ExtinguisherSnapshot
+{
+    ID id;
+    KinematicInfo info;
+    float amountUsed;
+} ExtinguisherSnapshot;
+
+typedef struct LevelSnapshot
+{
+    ID playerID;
+    KinematicInfo player;
+    float playerHealth;
+
+    FireSnapshot *fires;
+    int firesLen;
+    int firesCapacity;
+    ExtinguisherSnapshot *extinguishers;
+    int extinguishersLen;
+    int extinguishersCapacity;
+    bool captured;
+} LevelSnapshot;
+
+typedef void (*SnapshotChangeCallback)(ID id, void *context);
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//----------------------------------------------------------------------------------
+// Level Snapshot Functions Declaration
+//----------------------------------------------------------------------------------
+bool CaptureLevelSnapshot(LevelSnapshot *snapshot);     // reuses the snapshot's memory, false if out of memory
+int RestoreLevelSnapshot(const LevelSnapshot *snapshot); // entities written, -1 if fires or extinguishers came or went
+int FindSnapshotChanges(const LevelSnapshot *snapshot, SnapshotChangeCallback callback, void *context); // saved fields that differ
+void UnloadLevelSnapshot(LevelSnapshot *snapshot);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // LEVEL_SNAPSHOT_H
@@ -0,0 +1,239 @@
+/**********************************************************************************************
+*
+*   Level streaming: static geometry paged in and out of the entity store around the player
+*
+*   Copyright (c) 2022 creikey
+*
+**********************************************************************************************/
+
+#include "level_stream.h"
+#include <math.h>
+#include <stddef.h>
+
+#define MIN_RESIDENT_CAPACITY 16
+#define STREAM_MAX_REACH 16     // regions reaching further than this past their square are always loaded
+
+//----------------------------------------------------------------------------------
+// Module Functions Definition (local)
+//----------------------------------------------------------------------------------
+
+// the squares within regions of x, y
+static Rectangle RegionArea(const LevelStream *stream, int x, int y, int regions)
+{
+    float size = stream->image->regionSize;
+    float side = (float)(2*regions + 1)*size;
+    return (Rectangle){ (float)(x - regions)*size, (float)(y - regions)*size, side, side };
+}
+
+// edges count, help text bounds are a point
+static bool Overlaps(Rectangle a, Rectangle b)
+{
+    return (a.x <= b.x + b.width) && (b.x <= a.x + a.width) && (a.y <= b.y + b.height) && (b.y <= a.y + a.height);
+}
+
+// how many regions the bounds stick out past the region's own square
+static int RegionReach(const LevelRegion *region, float size)
+{
+    float left = (float)region->x*size - region->bounds.x;
+    float top = (float)region->y*size - region->bounds.y;
+    float right = region->bounds.x + region->bounds.width - (float)(region->x + 1)*size;
+    float bottom = region->bounds.y + region->bounds.height - (float)(region->y + 1)*size;
+    float out = fmaxf(fmaxf(left, right), fmaxf(top, bottom));
+    if (!(out > 0.0f))
+    {
+        return 0;
+    }
+    return (out < (float)(STREAM_MAX_REACH + 1)*size) ? (int)ceilf(out/size) : STREAM_MAX_REACH + 1;
+}
+
+static bool IsResident(const LevelStream *stream, unsigned int index)
+{
+    for (int r = 0; r < stream->residentLen; r++)
+    {
+        if (stream->resident[r].index == index)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void LoadRegion(LevelStream *stream, const LevelRegion *region, unsigned int index, bool pinned)
+{
+    if (stream->residentLen == stream->residentCapacity)
+    {
+        int newCapacity = (stream->residentCapacity < MIN_RESIDENT_CAPACITY) ? MIN_RESIDENT_CAPACITY : stream->residentCapacity*2;
+        StreamedRegion *newResident = RL_REALLOC(stream->resident, (size_t)newCapacity*sizeof(StreamedRegion));
+        if (newResident == NULL)
+        {
+            TraceLog(LOG_ERROR, "STREAM: Failed to grow the resident regions to %i", newCapacity);
+            return;
+        }
+        stream->resident = newResident;
+        stream->residentCapacity = newCapacity;
+    }
+
+    unsigned int total = 0;
+    for (int t = 0; t < LEVEL_REGION_TYPES; t++)
+    {
+        total += region->counts[t];
+    }
+    ID *ids = RL_MALLOC(((total > 0) ? total : 1)*sizeof(ID));
+    if (ids == NULL)
+    {
+        TraceLog(LOG_ERROR, "STREAM: Failed to allocate handles for region %i, %i", region->x, region->y);
+        return;
+    }
+    stream->resident[stream->residentLen++] = (StreamedRegion){
+        .index = index,
+        .bounds = region->bounds,
+        .ids = ids,
+        .idsLen = AddLevelRegionEntities(region, ids),
+        .pinned = pinned,
+    };
+}
+
+static void UnloadRegion(LevelStream *stream, int r)
+{
+    StreamedRegion *region = &stream->resident[r];
+    for (int i = 0; i < region->idsLen; i++)
+    {
+        DeleteEntity(region->ids[i]);
+    }
+    RL_FREE(region->ids);
+    stream->resident[r] = stream->resident[stream->residentLen - 1];
+    stream->residentLen -= 1;
+}
+
+static void PrefetchRegion(const LevelStream *stream, const LevelRegion *region)
+{
+    for (int t = 0; t < LEVEL_REGION_TYPES; t++)
+    {
+        PrefetchMappedRange(&stream->image->file, region->records[t], region->sizes[t]);
+    }
+}
+
+//----------------------------------------------------------------------------------
+// Level Stream Functions Definition
+//----------------------------------------------------------------------------------
+bool BeginLevelStream(LevelStream *stream, const LevelImage *image)
+{
+    EndLevelStream(stream);
+    if (image->regions == NULL)
+    {
+        return false;
+    }
+    stream->image = image;
+
+    // the row search has to look as far out as bounds reach. The few that reach further
+    // than is worth searching for are just kept in
+    LevelRegion region = { 0 };
+    for (unsigned int i = 0; GetLevelRegion(image, i, &region); i++)
+    {
+        int reach = RegionReach(&region, image->regionSize);
+        if (reach > STREAM_MAX_REACH)
+        {
+            LoadRegion(stream, &region, i, true);
+        }
+        else if (reach > stream->reach)
+        {
+            stream->reach = reach;
+        }
+    }
+    return true;
+}
+
+void UpdateLevelStream(LevelStream *stream, Vector2 focus)
+{
+    if (stream->image == NULL)
+    {
+        return;
+    }
+    float size = stream->image->regionSize;
+    int x = LevelRegionCoord(focus.x, size);
+    int y = LevelRegionCoord(focus.y, size);
+    if (stream->focused && (x == stream->focusX) && (y == stream->focusY))
+    {
+        return;
+    }
+    stream->focused = true;
+    stream->focusX = x;
+    stream->focusY = y;
+
+    Rectangle loadArea = RegionArea(stream, x, y, STREAM_LOAD_REGIONS);
+    Rectangle keepArea = RegionArea(stream, x, y, STREAM_UNLOAD_REGIONS);
+    Rectangle prefetchArea = RegionArea(stream, x, y, STREAM_PREFETCH_REGIONS);
+
+    bool unloaded = false;
+    for (int r = stream->residentLen - 1; r >= 0; r--)
+    {
+        if (!stream->resident[r].pinned && !Overlaps(stream->resident[r].bounds, keepArea))
+        {
+            UnloadRegion(stream, r);
+            unloaded = true;
+        }
+    }
+    // deleting leaves tombstones and loading appends, so squeeze them out now and then
+    EntityStoreUsage usage = GetEntityStoreUsage();
+    if (unloaded && (usage.tombstones > usage.count))
+    {
+        CompactEntities();
+    }
+
+    int span = STREAM_PREFETCH_REGIONS + stream->reach;
+    for (int row = y - span; row <= y + span; row++)
+    {
+        LevelRegion region = { 0 };
+        for (unsigned int i = FindLevelRegion(stream->image, x - span, row);
+             GetLevelRegion(stream->image, i, &region) && (region.y == row) && (region.x <= x + span); i++)
+        {
+            if (!Overlaps(region.bounds, prefetchArea) || IsResident(stream, i))
+            {
+                continue;
+            }
+            if (Overlaps(region.bounds, loadArea))
+            {
+                LoadRegion(stream, &region, i, false);
+            }
+            else
+            {
+                PrefetchRegion(stream, &region);
+            }
+        }
+    }
+}
+
+void FinishLevelStream(LevelStream *stream)
+{
+    if (stream->image == NULL)
+    {
+        return;
+    }
+    while (stream->residentLen > 0)
+    {
+        UnloadRegion(stream, stream->residentLen - 1);
+    }
+    // all of them again in file order, which is the order a whole load has them in
+    LevelRegion region = { 0 };
+    for (unsigned int i = 0; GetLevelRegion(stream->image, i, &region); i++)
+    {
+        AddLevelRegionEntities(&region, NULL);
+    }
+    CompactEntities();
+    EndLevelStream(stream);
+}
+
+void EndLevelStream(LevelStream *stream)
+{
+    for (int r = 0; r < stream->residentLen; r++)
+    {
+        RL_FREE(stream->resident[r].ids);
+    }
+    RL_FREE(stream->resident);
+    *stream = (LevelStream){ 0 };
+}
+
+bool IsLevelStreaming(const LevelStream *stream)
+{
+    return stream->image != NULL;
+}
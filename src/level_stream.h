@@ -0,0 +1,76 @@
+/**********************************************************************************************
+*
+*   Level streaming: static geometry paged in and out of the entity store around the player
+*
+*   A level with a region index (see level_file.h) is loaded without its ground, obstacles and
+*   help text. Those come in a region at a time, straight from the mapped file, once the
+*   region gets within STREAM_LOAD_REGIONS of the focus, and are deleted again once it's
+*   further than STREAM_UNLOAD_REGIONS, the gap keeps a region on the edge from coming and
+*   going every step. Regions a little further out still get their pages requested from the
+*   OS ahead of time, so the disk reads happen in the background before they're needed.
+*
+*   So what's resident, what the grid holds and what gets drawn follows the player instead of
+*   the size of the level. Static geometry doesn't change while playing, so dropping a region
+*   and reading it back later loses nothing. Which regions are in only depends on where the
+*   focus is, so a replay streams the same way every time.
+*
+*   The editor and saving want the whole level: FinishLevelStream loads every region that's
+*   still out, in file order, and stops streaming.
+*
+*   Copyright (c) 2022 creikey
+*
+**********************************************************************************************/
+
+#ifndef LEVEL_STREAM_H
+#define LEVEL_STREAM_H
+
+#include "raylib.h"
+#include "entities.h"
+#include "level_file.h"
+
+#define STREAM_LOAD_REGIONS 2       // regions either side of the focus's that are loaded
+#define STREAM_UNLOAD_REGIONS 3     // loaded regions stay until they're further than this
+#define STREAM_PREFETCH_REGIONS 4   // and out to here their pages are asked for
+
+//----------------------------------------------------------------------------------
+// Types and Structures Definition
+//----------------------------------------------------------------------------------
+typedef struct StreamedRegion
+{
+    unsigned int index;     // in the level's region index
+    Rectangle bounds;
+    ID *ids;                // the entities it made
+    int idsLen;
+    bool pinned;            // reaches too far to search for, never unloaded
+} StreamedRegion;
+
+typedef struct LevelStream
+{
+    const LevelImage *image;    // NULL when not streaming
+    StreamedRegion *resident;
+    int residentLen;
+    int residentCapacity;
+    int reach;          // regions the furthest reaching bounds stick out past their square
+    int focusX;         // region the focus was in at the last update
+    int focusY;
+    bool focused;       // there was an update since it began
+} LevelStream;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//----------------------------------------------------------------------------------
+// Level Stream Functions Declaration
+//----------------------------------------------------------------------------------
+bool BeginLevelStream(LevelStream *stream, const LevelImage *image);   // after LoadLevelImageWithoutRegions, false if it has no regions
+void UpdateLevelStream(LevelStream *stream, Vector2 focus);            // only does anything when the focus changed region
+void FinishLevelStream(LevelStream *stream);    // everything resident in file order, and stops streaming
+void EndLevelStream(LevelStream *stream);       // stops and frees, leaves the entities alone
+bool IsLevelStreaming(const LevelStream *stream);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // LEVEL_STREAM_H
@@ -0,0 +1,140 @@
+/**********************************************************************************************
+*
+*   Read only memory mapped files
+*
+*   Copyright (c) 2022 creikey
+*
+**********************************************************************************************/
+
+#if !defined(_WIN32) && !defined(_POSIX_C_SOURCE)
+    #define _POSIX_C_SOURCE 200112L // posix_madvise under strict C
+#endif
+
+#include "mapped_file.h"
+#include <stdint.h>
+
+#if defined(_WIN32)
+    // windows.h clashes with raylib.h (CloseWindow, Rectangle, DrawText...), which is why
+    // this file doesn't log and leaves that to the caller
+    #define WIN32_LEAN_AND_MEAN
+    #define NOGDI
+    #define NOUSER
+    #include <windows.h>
+#elif defined(__EMSCRIPTEN__)
+    #include "raylib.h"
+#else
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
+//----------------------------------------------------------------------------------
+// Mapped File Functions Definition
+//----------------------------------------------------------------------------------
+bool MapFile(const char *path, MappedFile *file)
+{
+    *file = (MappedFile){ 0 };
+
+#if defined(_WIN32)
+    HANDLE handle = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (handle == INVALID_HANDLE_VALUE)
+    {
+        return false;
+    }
+    LARGE_INTEGER size = { 0 };
+    if (!GetFileSizeEx(handle, &size) || (size.QuadPart <= 0) || (size.QuadPart > 0xffffffffLL))
+    {
+        CloseHandle(handle);
+        return false;
+    }
+    // the view keeps the mapping and the file open, the handles can go right away
+    HANDLE mapping = CreateFileMappingA(handle, NULL, PAGE_READONLY, 0, 0, NULL);
+    CloseHandle(handle);
+    if (mapping == NULL)
+    {
+        return false;
+    }
+    file->data = (const unsigned char *)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    CloseHandle(mapping);
+    if (file->data == NULL)
+    {
+        return false;
+    }
+    file->size = (unsigned int)size.QuadPart;
+#elif defined(__EMSCRIPTEN__)
+    // the preloaded files are already in memory, a copy is as good as it gets
+    unsigned int size = 0;
+    unsigned char *data = LoadFileData(path, &size);
+    if ((data == NULL) || (size == 0))
+    {
+        UnloadFileData(data);
+        return false;
+    }
+    file->data = data;
+    file->size = size;
+    file->copied = true;
+#else
+    int fd = open(path, O_RDONLY);
+    if (fd == -1)
+    {
+        return false;
+    }
+    struct stat info;
+    if ((fstat(fd, &info) != 0) || (info.st_size <= 0) || ((unsigned long long)info.st_size > 0xffffffffull))
+    {
+        close(fd);
+        return false;
+    }
+    // the mapping holds its own reference to the file
+    void *data = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+    {
+        return false;
+    }
+    file->data = (const unsigned char *)data;
+    file->size = (unsigned int)info.st_size;
+#endif
+
+    return true;
+}
+
+void UnmapFile(MappedFile *file)
+{
+    if (file->data == NULL)
+    {
+        return;
+    }
+
+#if defined(_WIN32)
+    UnmapViewOfFile(file->data);
+#elif defined(__EMSCRIPTEN__)
+    UnloadFileData((unsigned char *)file->data);
+#else
+    munmap((void *)file->data, file->size);
+#endif
+
+    *file = (MappedFile){ 0 };
+}
+
+void PrefetchMappedRange(const MappedFile *file, const unsigned char *data, unsigned int size)
+{
+    if ((file->data == NULL) || file->copied || (size == 0) || (data < file->data) ||
+        (data + size > file->data + file->size))
+    {
+        return;
+    }
+
+#if defined(_WIN32)
+    #if defined(_WIN32_WINNT) && (_WIN32_WINNT >= 0x0602)
+    WIN32_MEMORY_RANGE_ENTRY range = { (PVOID)data, (SIZE_T)size };
+    PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+    #endif
+#elif !defined(__EMSCRIPTEN__)
+    // the advice has to start on a page boundary
+    uintptr_t page = (uintptr_t)sysconf(_SC_PAGESIZE);
+    uintptr_t start = (uintptr_t)data & ~(page - 1);
+    posix_madvise((void *)start, (size_t)((uintptr_t)data + size - start), POSIX_MADV_WILLNEED);
+#endif
+}
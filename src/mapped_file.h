@@ -0,0 +1,49 @@
+/**********************************************************************************************
+*
+*   Read only memory mapped files
+*
+*   The OS pages the file in as it's touched and the pages are shared with its file cache,
+*   so opening a file costs about the same however big it is and nothing is copied. Where
+*   there's no mmap (the web build) the file is read into memory instead, same interface.
+*
+*   PrefetchMappedRange asks the OS to start reading part of the file in the background, so
+*   touching it later doesn't stall on the disk.
+*
+*   Don't write to a file while it's mapped, unmap it first: truncating a mapped file
+*   kills the process on the next read past the new end.
+*
+*   Copyright (c) 2022 creikey
+*
+**********************************************************************************************/
+
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <stdbool.h>
+
+//----------------------------------------------------------------------------------
+// Types and Structures Definition
+//----------------------------------------------------------------------------------
+typedef struct MappedFile
+{
+    const unsigned char *data;  // at least 4 byte aligned, NULL when nothing is mapped
+    unsigned int size;
+    bool copied;                // read into memory because the platform can't map
+} MappedFile;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//----------------------------------------------------------------------------------
+// Mapped File Functions Declaration
+//----------------------------------------------------------------------------------
+bool MapFile(const char *path, MappedFile *file);   // false if it can't be opened or is empty
+void UnmapFile(MappedFile *file);                   // fine on a file that was never mapped
+void PrefetchMappedRange(const MappedFile *file, const unsigned char *data, unsigned int size);  // a hint, returns right away
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // MAPPED_FILE_H
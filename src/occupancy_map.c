@@ -0,0 +1,330 @@
+/**********************************************************************************************
+*
+*   Occupancy map: the level's obstacles and fires rasterized into a grid of small cells
+*
+*   Copyright (c) 2022 creikey
+*
+**********************************************************************************************/
+
+#include "occupancy_map.h"
+#include "spatial_grid.h"
+#include <math.h>
+#include <string.h>
+
+//----------------------------------------------------------------------------------
+// Types and Structures Definition
+//----------------------------------------------------------------------------------
+// a cell's bounds grown by the margin on every side
+typedef struct CellBounds
+{
+    float x0, y0;
+    float x1, y1;
+} CellBounds;
+
+// the cells a rect can change, inclusive
+typedef struct CellRange
+{
+    int firstX, firstY;
+    int lastX, lastY;
+} CellRange;
+
+typedef struct ChangeCheck
+{
+    const OccupancyMap *map;
+    bool fits;
+} ChangeCheck;
+
+//----------------------------------------------------------------------------------
+// Module Functions Definition (local)
+//----------------------------------------------------------------------------------
+static bool GrowBuffer(void **buffer, int *capacity, int needed, size_t itemSize)
+{
+    if (needed <= *capacity)
+    {
+        return true;
+    }
+    void *newBuffer = RL_REALLOC(*buffer, (size_t)needed*itemSize);
+    if (newBuffer == NULL)
+    {
+        TraceLog(LOG_ERROR, "OCCUPANCY: Failed to grow a buffer to %i items", needed);
+        return false;
+    }
+    *buffer = newBuffer;
+    *capacity = needed;
+    return true;
+}
+
+static int CellCoord(float coord, const OccupancyMap *map, float origin, int size)
+{
+    float cell = floorf((coord - origin)*map->inverseCellSize);
+    if (!(cell > 0.0f))
+    {
+        return 0;
+    }
+    return (cell < (float)(size - 1)) ? (int)cell : size - 1;
+}
+
+static CellRange RectCells(const OccupancyMap *map, Rectangle rect)
+{
+    // a cell past either end, the bounds test in DrawOccupancyRect is what decides
+    CellRange range = {
+        .firstX = CellCoord(rect.x - map->margin, map, map->x, map->width) - 1,
+        .firstY = CellCoord(rect.y - map->margin, map, map->y, map->height) - 1,
+        .lastX = CellCoord(rect.x + rect.width + map->margin, map, map->x, map->width) + 1,
+        .lastY = CellCoord(rect.y + rect.height + map->margin, map, map->y, map->height) + 1,
+    };
+    range.firstX = (range.firstX < 0) ? 0 : range.firstX;
+    range.firstY = (range.firstY < 0) ? 0 : range.firstY;
+    range.lastX = (range.lastX < map->width) ? range.lastX : map->width - 1;
+    range.lastY = (range.lastY < map->height) ? range.lastY : map->height - 1;
+    return range;
+}
+
+static CellBounds GetCellBounds(const OccupancyMap *map, int x, int y)
+{
+    CellBounds cell = {
+        .x0 = map->x + (float)x*map->cellSize - map->margin,
+        .y0 = map->y + (float)y*map->cellSize - map->margin,
+    };
+    cell.x1 = cell.x0 + map->cellSize + 2.0f*map->margin;
+    cell.y1 = cell.y0 + map->cellSize + 2.0f*map->margin;
+    return cell;
+}
+
+// Marks the cells in range the rect reaches into. A rect that covers a cell's bounds decides
+// it, one that only touches them makes it MIXED. Obstacles win over everything and a second
+// fire makes it MIXED, so the order rects come in doesn't matter
+static void DrawOccupancyRect(OccupancyMap *map, Rectangle rect, int value, CellRange clip)
+{
+    CellRange range = RectCells(map, rect);
+    range.firstX = (range.firstX > clip.firstX) ? range.firstX : clip.firstX;
+    range.firstY = (range.firstY > clip.firstY) ? range.firstY : clip.firstY;
+    range.lastX = (range.lastX < clip.lastX) ? range.lastX : clip.lastX;
+    range.lastY = (range.lastY < clip.lastY) ? range.lastY : clip.lastY;
+    for (int y = range.firstY; y <= range.lastY; y++)
+    {
+        for (int x = range.firstX; x <= range.lastX; x++)
+        {
+            CellBounds cell = GetCellBounds(map, x, y);
+            bool touches = (rect.x <= cell.x1) && (rect.x + rect.width >= cell.x0) && (rect.y <= cell.y1) && (rect.y + rect.height >= cell.y0);
+            if (!touches)
+            {
+                continue;
+            }
+            bool covers = (rect.x <= cell.x0) && (rect.x + rect.width >= cell.x1) && (rect.y <= cell.y0) && (rect.y + rect.height >= cell.y1);
+
+            short *occupancy = &map->cells[y*map->width + x];
+            if (*occupancy == OCCUPANCY_SOLID)
+            {
+                continue;
+            }
+            if (covers && (value == OCCUPANCY_SOLID))
+            {
+                *occupancy = OCCUPANCY_SOLID;
+            }
+            else if (covers && (*occupancy == OCCUPANCY_EMPTY))
+            {
+                *occupancy = (short)value;
+            }
+            else
+            {
+                *occupancy = OCCUPANCY_MIXED;
+            }
+        }
+    }
+}
+
+// A number for the fire's cells. Once they run out its cells are MIXED, which is slower but
+// still right
+static int NumberFire(OccupancyMap *map, ID fire)
+{
+    if (map->firesLen == OCCUPANCY_MAX_FIRES)
+    {
+        return OCCUPANCY_MIXED;
+    }
+    if (map->firesLen == map->firesCapacity)
+    {
+        int capacity = (map->firesCapacity < 16) ? 16 : map->firesCapacity*2;
+        capacity = (capacity < OCCUPANCY_MAX_FIRES) ? capacity : OCCUPANCY_MAX_FIRES;
+        if (!GrowBuffer((void **)&map->fires, &map->firesCapacity, capacity, sizeof(ID)))
+        {
+            return OCCUPANCY_MIXED;
+        }
+    }
+    map->fires[map->firesLen++] = fire;
+    return map->firesLen;
+}
+
+static bool BuildOccupancyMap(OccupancyMap *map)
+{
+    const EntityComponents *c = GetEntityComponents();
+    map->width = 0;
+    map->height = 0;
+    map->firesLen = 0;
+    if ((c->obstaclesLen == 0) && (c->firesLen == 0))
+    {
+        return true;    // all of it empty
+    }
+
+    Rectangle first = (c->obstaclesLen > 0) ? c->obstacleRects[0] : c->fireRects[0];
+    float minX = first.x, minY = first.y;
+    float maxX = first.x + first.width, maxY = first.y + first.height;
+    for (int i = 0; i < c->obstaclesLen + c->firesLen; i++)
+    {
+        Rectangle rect = (i < c->obstaclesLen) ? c->obstacleRects[i] : c->fireRects[i - c->obstaclesLen];
+        minX = fminf(minX, rect.x);
+        minY = fminf(minY, rect.y);
+        maxX = fmaxf(maxX, rect.x + rect.width);
+        maxY = fmaxf(maxY, rect.y + rect.height);
+    }
+    if (!isfinite(minX) || !isfinite(minY) || !isfinite(maxX) || !isfinite(maxY))
+    {
+        return false;
+    }
+
+    // a spare cell all around, so whatever lands outside is well clear of every rect
+    map->cellSize = OCCUPANCY_CELL_SIZE;
+    while (((double)(maxX - minX)/map->cellSize + 3.0)*((double)(maxY - minY)/map->cellSize + 3.0) > (double)OCCUPANCY_MAX_CELLS)
+    {
+        map->cellSize *= 2.0f;
+    }
+    map->inverseCellSize = 1.0f/map->cellSize;
+    map->x = floorf(minX/map->cellSize)*map->cellSize - map->cellSize;
+    map->y = floorf(minY/map->cellSize)*map->cellSize - map->cellSize;
+    int width = (int)ceilf((maxX - map->x)/map->cellSize) + 1;
+    int height = (int)ceilf((maxY - map->y)/map->cellSize) + 1;
+    if (!GrowBuffer((void **)&map->cells, &map->cellsCapacity, width*height, sizeof(short)))
+    {
+        return false;
+    }
+    map->width = width;
+    map->height = height;
+    memset(map->cells, 0, (size_t)width*height*sizeof(short));
+
+    // Where a point is looked up, and where the cells are said to be, are both rounded. The
+    // margin is more than they can be off by, a fraction of a cell plus a bit for big
+    // coordinates. Patches can put rects anywhere on the map, so it's as far as its far edges
+    float reach = fmaxf(fmaxf(fabsf(map->x), fabsf(map->y)), fmaxf(fabsf(map->x + (float)width*map->cellSize), fabsf(map->y + (float)height*map->cellSize)));
+    map->margin = map->cellSize*0.125f + reach*1e-5f;
+    CellRange all = { 0, 0, width - 1, height - 1 };
+    for (int i = 0; i < c->obstaclesLen; i++)
+    {
+        DrawOccupancyRect(map, c->obstacleRects[i], OCCUPANCY_SOLID, all);
+    }
+    for (int i = 0; i < c->firesLen; i++)
+    {
+        DrawOccupancyRect(map, c->fireRects[i], NumberFire(map, c->fireIDs[i]), all);
+    }
+    map->builtFires = map->firesLen;
+    return true;
+}
+
+// A patch can only redraw cells the map has. What the margin reaches has to stay clear of the
+// spare cell around the edge, like it is after a build
+static void CheckChange(enum Type type, Rectangle rect, void *context)
+{
+    ChangeCheck *check = (ChangeCheck *)context;
+    const OccupancyMap *map = check->map;
+    if ((type != Obstacle) && (type != Fire))
+    {
+        return;
+    }
+    float x0 = (rect.x - map->margin - map->x)*map->inverseCellSize;
+    float y0 = (rect.y - map->margin - map->y)*map->inverseCellSize;
+    float x1 = (rect.x + rect.width + map->margin - map->x)*map->inverseCellSize;
+    float y1 = (rect.y + rect.height + map->margin - map->y)*map->inverseCellSize;
+    // NaN fails these too
+    if (!((x0 >= 1.0f) && (y0 >= 1.0f) && (x1 < (float)(map->width - 1)) && (y1 < (float)(map->height - 1))))
+    {
+        check->fits = false;
+    }
+}
+
+// everything under a rect that changed, cleared and drawn again from the grid
+static void PatchChange(enum Type type, Rectangle rect, void *context)
+{
+    OccupancyMap *map = (OccupancyMap *)context;
+    if ((type != Obstacle) && (type != Fire))
+    {
+        return;
+    }
+    CellRange range = RectCells(map, rect);
+    for (int y = range.firstY; y <= range.lastY; y++)
+    {
+        memset(&map->cells[y*map->width + range.firstX], 0, (size_t)(range.lastX - range.firstX + 1)*sizeof(short));
+    }
+
+    // whatever touches those cells' bounds is in here, the grid can give more than that
+    CellBounds first = GetCellBounds(map, range.firstX, range.firstY);
+    CellBounds last = GetCellBounds(map, range.lastX, range.lastY);
+    Rectangle area = { first.x0, first.y0, last.x1 - first.x0, last.y1 - first.y0 };
+    QuerySpatialGridRect(GetEntityGrid(), area, GRID_TYPE_MASK(Obstacle) | GRID_TYPE_MASK(Fire), &map->query);
+    for (int i = 0; i < map->query.len; i++)
+    {
+        const GridItem *item = &map->query.items[i];
+        int value = (item->type == Obstacle) ? OCCUPANCY_SOLID : NumberFire(map, item->id);
+        DrawOccupancyRect(map, item->rect, value, range);
+    }
+}
+
+static bool PatchOccupancyMap(OccupancyMap *map)
+{
+    // fire numbers handed out by patches are never given back, start over when they run out.
+    // Unless the level itself has more fires than that, then patching is as good as it gets
+    if ((map->firesLen == OCCUPANCY_MAX_FIRES) && (map->builtFires < OCCUPANCY_MAX_FIRES))
+    {
+        return false;
+    }
+    ChangeCheck check = { map, true };
+    if (!GetEntityChanges(map->version, CheckChange, &check) || !check.fits)
+    {
+        return false;
+    }
+    GetEntityChanges(map->version, PatchChange, map);
+    return true;
+}
+
+//----------------------------------------------------------------------------------
+// Occupancy Map Functions Definition
+//----------------------------------------------------------------------------------
+bool UpdateOccupancyMap(OccupancyMap *map)
+{
+    unsigned int version = GetEntityStoreVersion();
+    if (map->checked && (map->version == version))
+    {
+        return map->built;
+    }
+    // the editor and streaming change a few rects at a time, only the cells under those are
+    // drawn again. The whole map is only built when it has to grow, or after a load
+    if (!map->checked || !map->built || !PatchOccupancyMap(map))
+    {
+        map->built = BuildOccupancyMap(map);
+    }
+    map->version = version;
+    map->checked = true;
+    if (!map->built)
+    {
+        TraceLog(LOG_WARNING, "OCCUPANCY: Couldn't build the map, particles test every rect");
+    }
+    return map->built;
+}
+
+void UnloadOccupancyMap(OccupancyMap *map)
+{
+    RL_FREE(map->cells);
+    RL_FREE(map->fires);
+    UnloadGridQuery(&map->query);
+    *map = (OccupancyMap){ 0 };
+}
+
+int GetOccupancy(const OccupancyMap *map, Vector2 point)
+{
+    float x = (point.x - map->x)*map->inverseCellSize;
+    float y = (point.y - map->y)*map->inverseCellSize;
+    // NaN fails these too, and it's never in a rect either
+    if ((x >= 0.0f) && (x < (float)map->width) && (y >= 0.0f) && (y < (float)map->height))
+    {
+        return map->cells[(int)y*map->width + (int)x];
+    }
+    return OCCUPANCY_EMPTY;
+}
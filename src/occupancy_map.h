@@ -0,0 +1,73 @@
+/**********************************************************************************************
+*
+*   Occupancy map: the level's obstacles and fires rasterized into a grid of small cells
+*
+*   Each cell says what any point inside it is in: nothing, an obstacle, or one particular
+*   fire, so a particle finds out what it hit with one lookup instead of a grid query and a
+*   rect test per candidate. Rects don't line up with cells, so a cell an edge passes through
+*   (or where fires overlap) is MIXED, and only those go back to testing the rects. A cell is
+*   only given an answer when every point in it, and a bit around it, gets that answer from
+*   the rects, so using the map never changes what a particle hits.
+*
+*   When the entity store changes (editor changes, regions streaming in or out) only the cells
+*   under the rects that changed are cleared and drawn again from the grid. It's built from
+*   scratch after a load, or when something lands too close to its edge for it to hold.
+*
+*   Copyright (c) 2022 creikey
+*
+**********************************************************************************************/
+
+#ifndef OCCUPANCY_MAP_H
+#define OCCUPANCY_MAP_H
+
+#include "raylib.h"
+#include "entities.h"
+#include "spatial_grid.h"
+
+#define OCCUPANCY_CELL_SIZE 16.0f       // world units, doubled until the level fits in OCCUPANCY_MAX_CELLS
+#define OCCUPANCY_MAX_CELLS (1 << 20)
+#define OCCUPANCY_MAX_FIRES 32767       // numbers a cell can hold, past that fires' cells are MIXED
+
+// what a cell holds. Positive values are fires, fires[value - 1]
+#define OCCUPANCY_EMPTY 0
+#define OCCUPANCY_SOLID -1      // inside an obstacle
+#define OCCUPANCY_MIXED -2      // depends on where in the cell, test the rects
+
+//----------------------------------------------------------------------------------
+// Types and Structures Definition
+//----------------------------------------------------------------------------------
+typedef struct OccupancyMap
+{
+    float x, y;             // world position of cell 0, 0
+    float cellSize;
+    float inverseCellSize;
+    int width, height;      // in cells, everything outside is empty
+    float margin;           // cells are classified this far out past their bounds
+    short *cells;
+    int cellsCapacity;
+    ID *fires;              // a fire can be under more than one number after patches
+    int firesLen;
+    int firesCapacity;
+    int builtFires;         // firesLen after the last build
+    GridQuery query;        // for patches
+    unsigned int version;   // entity store version it was last brought up to
+    bool checked;           // version means something
+    bool built;             // false when the last build failed
+} OccupancyMap;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//----------------------------------------------------------------------------------
+// Occupancy Map Functions Declaration
+//----------------------------------------------------------------------------------
+bool UpdateOccupancyMap(OccupancyMap *map);    // rebuilds it if the entity store changed since. False if it couldn't be built, don't use it then
+void UnloadOccupancyMap(OccupancyMap *map);
+int GetOccupancy(const OccupancyMap *map, Vector2 point);  // one of OCCUPANCY_EMPTY, _SOLID, _MIXED or a fire number
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // OCCUPANCY_MAP_H
@@ -0,0 +1,314 @@
+/**********************************************************************************************
+*
+*   Particle renderer: every live particle in one instanced draw
+*
+*   Copyright (c) 2022 creikey
+*
+**********************************************************************************************/
+
+#include "particle_renderer.h"
+#include "sprite_batch.h"
+#include "rlgl.h"
+#include "raymath.h"
+#include <stddef.h>
+#include <string.h>
+
+#if defined(GRAPHICS_API_OPENGL_ES2)
+    #include <GLES2/gl2.h>      // for the extension string, rlgl doesn't say if it found instancing
+#endif
+
+//----------------------------------------------------------------------------------
+// Types and Structures Definition
+//----------------------------------------------------------------------------------
+// what the shader gets per particle, 20 bytes
+typedef struct ParticleInstance
+{
+    float x, y;
+    float radius;
+    float life;     // lifetime left over max_lifetime
+    Color color;
+} ParticleInstance;
+
+//----------------------------------------------------------------------------------
+// Global Variables Definition
+//----------------------------------------------------------------------------------
+// corner of the quad, -1 to 1 so the distance from the middle is the fraction of the radius
+static const float quadCorners[] = {
+    -1.0f, -1.0f,   1.0f, -1.0f,   1.0f, 1.0f,
+    -1.0f, -1.0f,   1.0f, 1.0f,   -1.0f, 1.0f,
+};
+
+static const char *vertexShader330 =
+    "#version 330\n"
+    "in vec2 corner;\n"
+    "in vec4 particle;\n"       // x, y, radius, life
+    "in vec4 particleColor;\n"
+    "uniform mat4 mvp;\n"
+    "out vec2 fragCorner;\n"
+    "out vec4 fragColor;\n"
+    "void main()\n"
+    "{\n"
+    "    fragCorner = corner;\n"
+    "    fragColor = vec4(particleColor.rgb, particle.w);\n"
+    "    gl_Position = mvp*vec4(particle.xy + corner*particle.z, 0.0, 1.0);\n"
+    "}\n";
+
+static const char *fragmentShader330 =
+    "#version 330\n"
+    "in vec2 fragCorner;\n"
+    "in vec4 fragColor;\n"
+    "out vec4 finalColor;\n"
+    "void main()\n"
+    "{\n"
+    "    float edge = 1.0 - smoothstep(0.94, 1.0, length(fragCorner));\n"
+    "    finalColor = vec4(fragColor.rgb, fragColor.a*edge);\n"
+    "}\n";
+
+static const char *vertexShader100 =
+    "#version 100\n"
+    "attribute vec2 corner;\n"
+    "attribute vec4 particle;\n"
+    "attribute vec4 particleColor;\n"
+    "uniform mat4 mvp;\n"
+    "varying vec2 fragCorner;\n"
+    "varying vec4 fragColor;\n"
+    "void main()\n"
+    "{\n"
+    "    fragCorner = corner;\n"
+    "    fragColor = vec4(particleColor.rgb, particle.w);\n"
+    "    gl_Position = mvp*vec4(particle.xy + corner*particle.z, 0.0, 1.0);\n"
+    "}\n";
+
+static const char *fragmentShader100 =
+    "#version 100\n"
+    "precision mediump float;\n"
+    "varying vec2 fragCorner;\n"
+    "varying vec4 fragColor;\n"
+    "void main()\n"
+    "{\n"
+    "    float edge = 1.0 - smoothstep(0.94, 1.0, length(fragCorner));\n"
+    "    gl_FragColor = vec4(fragColor.rgb, fragColor.a*edge);\n"
+    "}\n";
+
+static Shader shader = { 0 };
+static int mvpLoc = -1;
+static unsigned int vao = 0;
+static unsigned int quadBuffer = 0;
+static unsigned int instanceBuffer = 0;
+static bool instanced = false;
+static int particleLoc = -1;
+static int colorLoc = -1;
+static ParticleInstance *instances = NULL;  // as many as particles there can be, so one draw takes them all
+static int instancesCapacity = 0;           // of instances and instanceBuffer
+static float *fades = NULL;     // one per live particle
+static int fadesCapacity = 0;
+
+//----------------------------------------------------------------------------------
+// Module Functions Definition (local)
+//----------------------------------------------------------------------------------
+// GL 3.3 has it built in, GLES2 and WebGL 1 only with an extension. Without it rlgl's
+// instanced calls go through null function pointers
+static bool HasInstancedArrays(void)
+{
+#if defined(GRAPHICS_API_OPENGL_ES2)
+    const char *extensions = (const char *)glGetString(GL_EXTENSIONS);
+    return (extensions != NULL) && ((strstr(extensions, "GL_ANGLE_instanced_arrays") != NULL) ||
+        (strstr(extensions, "GL_EXT_instanced_arrays") != NULL) || (strstr(extensions, "GL_NV_instanced_arrays") != NULL));
+#else
+    return false;
+#endif
+}
+
+static bool LoadInstancing(void)
+{
+    int version = rlGetVersion();
+    if ((version == RL_OPENGL_33) || (version == RL_OPENGL_43))
+    {
+        shader = LoadShaderFromMemory(vertexShader330, fragmentShader330);
+    }
+    else if ((version == RL_OPENGL_ES_20) && HasInstancedArrays())
+    {
+        shader = LoadShaderFromMemory(vertexShader100, fragmentShader100);
+    }
+    else
+    {
+        return false;   // GL 1.1 and 2.1 have no instancing in rlgl
+    }
+    // a shader that fails to build comes back as the default one
+    if ((shader.id == 0) || (shader.id == rlGetShaderIdDefault()))
+    {
+        return false;
+    }
+    int cornerLoc = GetShaderLocationAttrib(shader, "corner");
+    particleLoc = GetShaderLocationAttrib(shader, "particle");
+    colorLoc = GetShaderLocationAttrib(shader, "particleColor");
+    mvpLoc = GetShaderLocation(shader, "mvp");
+    if ((cornerLoc < 0) || (particleLoc < 0) || (colorLoc < 0) || (mvpLoc < 0))
+    {
+        return false;
+    }
+
+    // 0 when rlgl found no vertex array support
+    vao = rlLoadVertexArray();
+    if ((vao == 0) || !rlEnableVertexArray(vao))
+    {
+        return false;
+    }
+    quadBuffer = rlLoadVertexBuffer(quadCorners, sizeof(quadCorners), false);
+    rlSetVertexAttribute(cornerLoc, 2, RL_FLOAT, false, 0, 0);
+    rlEnableVertexAttribute(cornerLoc);
+    rlDisableVertexArray();
+
+    return quadBuffer != 0;    // the instance buffer comes with the first particles
+}
+
+// Room for capacity instances, CPU and GPU side. The old buffer stays if either fails
+static bool LoadInstanceBuffer(int capacity)
+{
+    ParticleInstance *newInstances = RL_REALLOC(instances, (size_t)capacity*sizeof(ParticleInstance));
+    if (newInstances == NULL)
+    {
+        return false;
+    }
+    instances = newInstances;
+
+    rlEnableVertexArray(vao);
+    unsigned int newBuffer = rlLoadVertexBuffer(NULL, capacity*(int)sizeof(ParticleInstance), true);
+    if (newBuffer == 0)
+    {
+        rlDisableVertexArray();
+        return false;
+    }
+    rlUnloadVertexBuffer(instanceBuffer);
+    instanceBuffer = newBuffer;
+    instancesCapacity = capacity;
+    rlSetVertexAttribute(particleLoc, 4, RL_FLOAT, false, sizeof(ParticleInstance), (void *)offsetof(ParticleInstance, x));
+    rlEnableVertexAttribute(particleLoc);
+    rlSetVertexAttributeDivisor(particleLoc, 1);
+    rlSetVertexAttribute(colorLoc, 4, RL_UNSIGNED_BYTE, true, sizeof(ParticleInstance), (void *)offsetof(ParticleInstance, color));
+    rlEnableVertexAttribute(colorLoc);
+    rlSetVertexAttributeDivisor(colorLoc, 1);
+    rlDisableVertexArray();
+    return true;
+}
+
+static void DrawInstances(int count)
+{
+    rlEnableShader(shader.id);
+    rlSetUniformMatrix(mvpLoc, MatrixMultiply(rlGetMatrixModelview(), rlGetMatrixProjection()));
+    rlUpdateVertexBuffer(instanceBuffer, instances, count*(int)sizeof(ParticleInstance), 0);
+    rlEnableVertexArray(vao);
+    rlDrawVertexArrayInstanced(0, 6, count);
+    rlDisableVertexArray();
+    rlDisableShader();
+}
+
+// whether any of it is in view
+static bool IsParticleVisible(const ParticleArrays *particles, int i, Rectangle view)
+{
+    return (particles->posX[i] + PARTICLE_RADIUS >= view.x) && (particles->posX[i] - PARTICLE_RADIUS <= view.x + view.width) &&
+        (particles->posY[i] + PARTICLE_RADIUS >= view.y) && (particles->posY[i] - PARTICLE_RADIUS <= view.y + view.height);
+}
+
+//----------------------------------------------------------------------------------
+// Particle Renderer Functions Definition
+//----------------------------------------------------------------------------------
+void LoadParticleRenderer(void)
+{
+    instanced = LoadInstancing();
+    if (!instanced)
+    {
+        TraceLog(LOG_INFO, "PARTICLES: No instancing, drawing them as sprites");
+        UnloadParticleRenderer();
+    }
+}
+
+void UnloadParticleRenderer(void)
+{
+    if (shader.id != 0)
+    {
+        UnloadShader(shader);   // leaves the default shader alone
+    }
+    rlUnloadVertexBuffer(quadBuffer);
+    rlUnloadVertexBuffer(instanceBuffer);
+    rlUnloadVertexArray(vao);
+    shader = (Shader){ 0 };
+    mvpLoc = -1;
+    particleLoc = -1;
+    colorLoc = -1;
+    vao = 0;
+    quadBuffer = 0;
+    instanceBuffer = 0;
+    instanced = false;
+    RL_FREE(instances);
+    instances = NULL;
+    instancesCapacity = 0;
+    RL_FREE(fades);
+    fades = NULL;
+    fadesCapacity = 0;
+}
+
+void DrawParticles(const ParticleArrays *particles, Rectangle view)
+{
+    if (particles->count > fadesCapacity)
+    {
+        float *newFades = RL_REALLOC(fades, (size_t)particles->capacity*sizeof(float));
+        if (newFades == NULL)
+        {
+            return;
+        }
+        fades = newFades;
+        fadesCapacity = particles->capacity;
+    }
+    ComputeParticleFade(particles, fades);
+
+    // a buffer that couldn't grow still works, a draw per bufferful
+    bool useInstances = instanced && ((particles->count <= instancesCapacity) || LoadInstanceBuffer(particles->capacity) || (instancesCapacity > 0));
+    if (!useInstances)
+    {
+        for (int i = 0; i < particles->count; i++)
+        {
+            if ((fades[i] <= 0.0f) || !IsParticleVisible(particles, i, view))
+                continue;
+            Color color = particles->color[i];
+            color.a = (unsigned char)(fades[i]*255);
+            DrawSpriteCircle((Vector2){ particles->posX[i], particles->posY[i] }, PARTICLE_RADIUS, color);
+        }
+        return;
+    }
+
+    int live = 0;
+    for (int i = 0; i < particles->count; i++)
+    {
+        if ((fades[i] <= 0.0f) || !IsParticleVisible(particles, i, view))
+            continue;
+        if (live == 0)
+        {
+            // what's queued so far has to be on the screen first to end up underneath
+            FlushSpriteBatch();
+            rlDrawRenderBatchActive();
+        }
+        instances[live++] = (ParticleInstance){
+            .x = particles->posX[i],
+            .y = particles->posY[i],
+            .radius = PARTICLE_RADIUS,
+            .life = fades[i],
+            .color = particles->color[i],
+        };
+        if (live == instancesCapacity)
+        {
+            // only when the buffer couldn't grow
+            DrawInstances(live);
+            live = 0;
+        }
+    }
+    if (live > 0)
+    {
+        DrawInstances(live);
+    }
+}
+
+bool IsParticleRendererInstanced(void)
+{
+    return instanced;
+}
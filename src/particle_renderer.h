@@ -0,0 +1,43 @@
+/**********************************************************************************************
+*
+*   Particle renderer: every live particle in one instanced draw
+*
+*   Each frame the live particles are packed into a small per particle buffer (position,
+*   radius, how much life is left, color) and uploaded once. A unit quad is drawn once per
+*   particle with glDrawArraysInstanced, and the shader places it, fades it by the life left
+*   and cuts the circle out with a soft edge. So the CPU does one pass over the live
+*   particles and there's one draw call for all of them in view, the buffer grows with the
+*   particle capacity.
+*
+*   It needs vertex arrays and instancing: GL 3.3 always has them, GLES2/WebGL only with the
+*   ANGLE/EXT/NV instanced arrays extension, which is checked for before picking it. The shaders come in GLSL 330 and GLSL 100, picked by what
+*   rlgl says it's running on. When instancing can't be used, or the shader doesn't build,
+*   particles go through the sprite batch instead and look the same.
+*
+*   Copyright (c) 2022 creikey
+*
+**********************************************************************************************/
+
+#ifndef PARTICLE_RENDERER_H
+#define PARTICLE_RENDERER_H
+
+#include "raylib.h"
+#include "simulation.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//----------------------------------------------------------------------------------
+// Particle Renderer Functions Declaration
+//----------------------------------------------------------------------------------
+void LoadParticleRenderer(void);    // needs the window, and LoadSpriteBatch for the fallback
+void UnloadParticleRenderer(void);
+void DrawParticles(const ParticleArrays *particles, Rectangle view);  // in BeginMode2D, on top of what's been drawn so far. Skips ones outside view
+bool IsParticleRendererInstanced(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // PARTICLE_RENDERER_H
@@ -0,0 +1,332 @@
+/**********************************************************************************************
+*
+*   Particle system: particles stored as arrays of each field, stepped a SIMD register at a time
+*
+*   Copyright (c) 2022 creikey
+*
+**********************************************************************************************/
+
+#include "particle_system.h"
+#include <stdint.h>
+
+#if defined(__AVX__)
+    #include <immintrin.h>
+    #define PARTICLE_KERNEL_AVX
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+    #include <emmintrin.h>
+    #define PARTICLE_KERNEL_SSE2
+#elif defined(__wasm_simd128__)
+    #include <wasm_simd128.h>
+    #define PARTICLE_KERNEL_SIMD128
+#endif
+
+//----------------------------------------------------------------------------------
+// Module Functions Definition (local)
+//----------------------------------------------------------------------------------
+static size_t AlignSize(size_t size)
+{
+    return (size + PARTICLE_ALIGNMENT - 1) & ~(size_t)(PARTICLE_ALIGNMENT - 1);
+}
+
+// what the vector loops leave over, and all of it when there's no SIMD
+static void IntegrateScalar(ParticleArrays *particles, int first, int last, float delta)
+{
+    for (int i = first; i < last; i++)
+    {
+        if (particles->lifetime[i] > 0.0f)
+        {
+            particles->lifetime[i] -= delta;
+            particles->posX[i] += particles->velX[i]*delta;
+            particles->posY[i] += particles->velY[i]*delta;
+        }
+    }
+}
+
+static void FadeScalar(const ParticleArrays *particles, int first, float *fade)
+{
+    for (int i = first; i < particles->count; i++)
+    {
+        fade[i] = (particles->lifetime[i] > 0.0f) ? particles->lifetime[i]/particles->maxLifetime[i] : 0.0f;
+    }
+}
+
+// whether a should be replaced before b when they're all in use
+static bool EvictsBefore(const ParticleArrays *particles, int a, int b)
+{
+    if (particles->eviction == EVICT_MOST_FADED)
+    {
+        float fadeA = particles->lifetime[a]/particles->maxLifetime[a];
+        float fadeB = particles->lifetime[b]/particles->maxLifetime[b];
+        if (fadeA != fadeB)
+        {
+            return fadeA < fadeB;
+        }
+    }
+    // the subtraction keeps the order right when the serials wrap
+    return (particles->nextSerial - particles->serial[a]) > (particles->nextSerial - particles->serial[b]);
+}
+
+static void SiftVictim(ParticleArrays *particles, int at)
+{
+    int *victims = particles->victims;
+    for (;;)
+    {
+        int first = at;
+        int left = 2*at + 1;
+        int right = left + 1;
+        if ((left < particles->victimsLen) && EvictsBefore(particles, victims[left], victims[first]))
+        {
+            first = left;
+        }
+        if ((right < particles->victimsLen) && EvictsBefore(particles, victims[right], victims[first]))
+        {
+            first = right;
+        }
+        if (first == at)
+        {
+            return;
+        }
+        int swap = victims[at];
+        victims[at] = victims[first];
+        victims[first] = swap;
+        at = first;
+    }
+}
+
+// every live one, the next to replace on top. Only lifetimes changing reorders them, and
+// RemoveDeadParticles throws this away after they've aged
+static void BuildVictims(ParticleArrays *particles)
+{
+    particles->victimsLen = particles->count;
+    for (int i = 0; i < particles->count; i++)
+    {
+        particles->victims[i] = i;
+    }
+    for (int i = particles->victimsLen/2 - 1; i >= 0; i--)
+    {
+        SiftVictim(particles, i);
+    }
+}
+
+//----------------------------------------------------------------------------------
+// Particle System Functions Definition
+//----------------------------------------------------------------------------------
+bool LoadParticleArrays(ParticleArrays *particles, int capacity, ParticleEviction eviction)
+{
+    UnloadParticleArrays(particles);
+    if (capacity <= 0)
+    {
+        return false;
+    }
+
+    size_t floats = AlignSize((size_t)capacity*sizeof(float));
+    size_t colors = AlignSize((size_t)capacity*sizeof(Color));
+    size_t types = AlignSize((size_t)capacity*sizeof(unsigned char));
+    size_t serials = AlignSize((size_t)capacity*sizeof(unsigned int));
+    size_t victims = AlignSize((size_t)capacity*sizeof(int));
+    void *block = RL_MALLOC(6*floats + colors + types + serials + victims + PARTICLE_ALIGNMENT - 1);
+    if (block == NULL)
+    {
+        TraceLog(LOG_ERROR, "PARTICLES: Failed to allocate %i particles", capacity);
+        return false;
+    }
+
+    unsigned char *next = (unsigned char *)(((uintptr_t)block + PARTICLE_ALIGNMENT - 1) & ~(uintptr_t)(PARTICLE_ALIGNMENT - 1));
+    particles->posX = (float *)next;
+    particles->posY = (float *)(next += floats);
+    particles->velX = (float *)(next += floats);
+    particles->velY = (float *)(next += floats);
+    particles->lifetime = (float *)(next += floats);
+    particles->maxLifetime = (float *)(next += floats);
+    particles->color = (Color *)(next += floats);
+    particles->type = (unsigned char *)(next += colors);
+    particles->serial = (unsigned int *)(next += types);
+    particles->victims = (int *)(next += serials);
+    particles->capacity = capacity;
+    particles->eviction = eviction;
+    particles->block = block;
+    ClearParticleArrays(particles);
+    return true;
+}
+
+void UnloadParticleArrays(ParticleArrays *particles)
+{
+    RL_FREE(particles->block);
+    *particles = (ParticleArrays){ 0 };
+}
+
+void ClearParticleArrays(ParticleArrays *particles)
+{
+    particles->count = 0;
+    particles->nextSerial = 0;
+    particles->victimsLen = 0;
+}
+
+bool AddParticle(ParticleArrays *particles, Particle particle)
+{
+    if (particles->capacity == 0)
+    {
+        return false;
+    }
+    int index = particles->count;
+    bool evicted = (index == particles->capacity);
+    if (evicted)
+    {
+        if (particles->victimsLen != particles->count)
+        {
+            BuildVictims(particles);
+        }
+        index = particles->victims[0];
+    }
+    else
+    {
+        particles->count += 1;
+    }
+
+    particles->posX[index] = particle.pos.x;
+    particles->posY[index] = particle.pos.y;
+    particles->velX[index] = particle.vel.x;
+    particles->velY[index] = particle.vel.y;
+    particles->lifetime[index] = particle.lifetime;
+    particles->maxLifetime[index] = particle.max_lifetime;
+    particles->color[index] = particle.color;
+    particles->type[index] = (unsigned char)particle.type;
+    particles->serial[index] = particles->nextSerial++;
+    if (evicted)
+    {
+        SiftVictim(particles, 0);   // the new one is where the old one was
+    }
+    return evicted;
+}
+
+void RemoveParticle(ParticleArrays *particles, int index)
+{
+    int last = --particles->count;
+    particles->victimsLen = 0;
+    particles->posX[index] = particles->posX[last];
+    particles->posY[index] = particles->posY[last];
+    particles->velX[index] = particles->velX[last];
+    particles->velY[index] = particles->velY[last];
+    particles->lifetime[index] = particles->lifetime[last];
+    particles->maxLifetime[index] = particles->maxLifetime[last];
+    particles->color[index] = particles->color[last];
+    particles->type[index] = particles->type[last];
+    particles->serial[index] = particles->serial[last];
+}
+
+void RemoveDeadParticles(ParticleArrays *particles)
+{
+    particles->victimsLen = 0;  // they've aged since, the order is different
+    // from the back, so whatever gets swapped in was already looked at
+    for (int i = particles->count - 1; i >= 0; i--)
+    {
+        if (!(particles->lifetime[i] > 0.0f))
+        {
+            RemoveParticle(particles, i);
+        }
+    }
+}
+
+Particle GetParticle(const ParticleArrays *particles, int index)
+{
+    return (Particle){
+        .pos = { particles->posX[index], particles->posY[index] },
+        .vel = { particles->velX[index], particles->velY[index] },
+        .lifetime = particles->lifetime[index],
+        .max_lifetime = particles->maxLifetime[index],
+        .color = particles->color[index],
+        .type = (enum ParticleType)particles->type[index],
+    };
+}
+
+// Everything before count is alive, but one that died since (or a NaN) is masked rather than
+// branched on, like IntegrateScalar does. The multiply and add stay separate instructions
+void IntegrateParticles(ParticleArrays *particles, int first, int last, float delta)
+{
+    int i = first;
+#if defined(PARTICLE_KERNEL_AVX)
+    __m256 step = _mm256_set1_ps(delta);
+    __m256 zero = _mm256_setzero_ps();
+    for (; i + 8 <= last; i += 8)
+    {
+        __m256 lifetime = _mm256_load_ps(&particles->lifetime[i]);
+        __m256 live = _mm256_cmp_ps(lifetime, zero, _CMP_GT_OQ);
+        __m256 moveX = _mm256_and_ps(live, _mm256_mul_ps(_mm256_load_ps(&particles->velX[i]), step));
+        __m256 moveY = _mm256_and_ps(live, _mm256_mul_ps(_mm256_load_ps(&particles->velY[i]), step));
+        _mm256_store_ps(&particles->lifetime[i], _mm256_sub_ps(lifetime, _mm256_and_ps(live, step)));
+        _mm256_store_ps(&particles->posX[i], _mm256_add_ps(_mm256_load_ps(&particles->posX[i]), moveX));
+        _mm256_store_ps(&particles->posY[i], _mm256_add_ps(_mm256_load_ps(&particles->posY[i]), moveY));
+    }
+#elif defined(PARTICLE_KERNEL_SSE2)
+    __m128 step = _mm_set1_ps(delta);
+    __m128 zero = _mm_setzero_ps();
+    for (; i + 4 <= last; i += 4)
+    {
+        __m128 lifetime = _mm_load_ps(&particles->lifetime[i]);
+        __m128 live = _mm_cmpgt_ps(lifetime, zero);
+        __m128 moveX = _mm_and_ps(live, _mm_mul_ps(_mm_load_ps(&particles->velX[i]), step));
+        __m128 moveY = _mm_and_ps(live, _mm_mul_ps(_mm_load_ps(&particles->velY[i]), step));
+        _mm_store_ps(&particles->lifetime[i], _mm_sub_ps(lifetime, _mm_and_ps(live, step)));
+        _mm_store_ps(&particles->posX[i], _mm_add_ps(_mm_load_ps(&particles->posX[i]), moveX));
+        _mm_store_ps(&particles->posY[i], _mm_add_ps(_mm_load_ps(&particles->posY[i]), moveY));
+    }
+#elif defined(PARTICLE_KERNEL_SIMD128)
+    v128_t step = wasm_f32x4_splat(delta);
+    v128_t zero = wasm_f32x4_splat(0.0f);
+    for (; i + 4 <= last; i += 4)
+    {
+        v128_t lifetime = wasm_v128_load(&particles->lifetime[i]);
+        v128_t live = wasm_f32x4_gt(lifetime, zero);
+        v128_t moveX = wasm_v128_and(live, wasm_f32x4_mul(wasm_v128_load(&particles->velX[i]), step));
+        v128_t moveY = wasm_v128_and(live, wasm_f32x4_mul(wasm_v128_load(&particles->velY[i]), step));
+        wasm_v128_store(&particles->lifetime[i], wasm_f32x4_sub(lifetime, wasm_v128_and(live, step)));
+        wasm_v128_store(&particles->posX[i], wasm_f32x4_add(wasm_v128_load(&particles->posX[i]), moveX));
+        wasm_v128_store(&particles->posY[i], wasm_f32x4_add(wasm_v128_load(&particles->posY[i]), moveY));
+    }
+#endif
+    IntegrateScalar(particles, i, last, delta);
+}
+
+void ComputeParticleFade(const ParticleArrays *particles, float *fade)
+{
+    int i = 0;
+#if defined(PARTICLE_KERNEL_AVX)
+    __m256 zero = _mm256_setzero_ps();
+    for (; i + 8 <= particles->count; i += 8)
+    {
+        __m256 lifetime = _mm256_load_ps(&particles->lifetime[i]);
+        __m256 live = _mm256_cmp_ps(lifetime, zero, _CMP_GT_OQ);
+        _mm256_storeu_ps(&fade[i], _mm256_and_ps(live, _mm256_div_ps(lifetime, _mm256_load_ps(&particles->maxLifetime[i]))));
+    }
+#elif defined(PARTICLE_KERNEL_SSE2)
+    __m128 zero = _mm_setzero_ps();
+    for (; i + 4 <= particles->count; i += 4)
+    {
+        __m128 lifetime = _mm_load_ps(&particles->lifetime[i]);
+        __m128 live = _mm_cmpgt_ps(lifetime, zero);
+        _mm_storeu_ps(&fade[i], _mm_and_ps(live, _mm_div_ps(lifetime, _mm_load_ps(&particles->maxLifetime[i]))));
+    }
+#elif defined(PARTICLE_KERNEL_SIMD128)
+    v128_t zero = wasm_f32x4_splat(0.0f);
+    for (; i + 4 <= particles->count; i += 4)
+    {
+        v128_t lifetime = wasm_v128_load(&particles->lifetime[i]);
+        v128_t live = wasm_f32x4_gt(lifetime, zero);
+        wasm_v128_store(&fade[i], wasm_v128_and(live, wasm_f32x4_div(lifetime, wasm_v128_load(&particles->maxLifetime[i]))));
+    }
+#endif
+    FadeScalar(particles, i, fade);
+}
+
+const char *GetParticleKernelName(void)
+{
+#if defined(PARTICLE_KERNEL_AVX)
+    return "AVX";
+#elif defined(PARTICLE_KERNEL_SSE2)
+    return "SSE2";
+#elif defined(PARTICLE_KERNEL_SIMD128)
+    return "SIMD128";
+#else
+    return "scalar";
+#endif
+}
@@ -0,0 +1,104 @@
+/**********************************************************************************************
+*
+*   Particle system: particles stored as arrays of each field, stepped a SIMD register at a time
+*
+*   Instead of an array of Particle structs every field has its own array, so the passes that
+*   touch every particle (moving them, aging them, working out how faded they are) read and
+*   write contiguous floats and do 4 or 8 particles per instruction: SSE2 on x86, AVX when the
+*   compiler is allowed to use it, SIMD128 on wasm, and plain C anywhere else. The arrays come
+*   out of one allocation and each starts aligned for the widest register.
+*
+*   Every kernel gives bit for bit what the plain C loop gives, no fused multiply-adds and no
+*   reordering, so replays don't change with the instruction set the game was built for.
+*
+*   Live particles are packed at the front, the first count of them, and nothing else is
+*   visited: one that dies is swapped with the last, so with nothing alive there's nothing to
+*   do. Their order means nothing. When it's full a new particle replaces a live one picked by
+*   the eviction policy, and AddParticle says so. The victims are kept in a heap made the first
+*   time one's needed after the particles aged (RemoveDeadParticles, once a tick), so a burst
+*   spawned into a full array costs a log n per particle, not a look at every one.
+*
+*   Copyright (c) 2022 creikey
+*
+**********************************************************************************************/
+
+#ifndef PARTICLE_SYSTEM_H
+#define PARTICLE_SYSTEM_H
+
+#include "raylib.h"
+
+#define DEFAULT_PARTICLE_CAPACITY 1000
+#define PARTICLE_LANES 8        // widest register a kernel uses, in floats
+#define PARTICLE_ALIGNMENT 32   // bytes, every array starts on one
+
+//----------------------------------------------------------------------------------
+// Types and Structures Definition
+//----------------------------------------------------------------------------------
+enum ParticleType
+{
+    RetardantParticle,
+    FireParticle,
+};
+
+// one particle, for spawning and reading back
+typedef struct Particle
+{
+    Vector2 pos;
+    Vector2 vel;
+    float lifetime;
+    float max_lifetime; // used to compute color alpha
+    Color color;
+    enum ParticleType type;
+} Particle;
+
+// which live particle a new one replaces when they're all in use
+typedef enum ParticleEviction
+{
+    EVICT_MOST_FADED,   // lowest lifetime/max_lifetime, the least visible. Ties go to the oldest
+    EVICT_OLDEST,       // spawned longest ago, what a ring buffer would overwrite
+} ParticleEviction;
+
+typedef struct ParticleArrays
+{
+    float *posX;
+    float *posY;
+    float *velX;
+    float *velY;
+    float *lifetime;    // dead ones have lifetime <= 0
+    float *maxLifetime;
+    Color *color;
+    unsigned char *type;    // enum ParticleType
+    unsigned int *serial;   // spawn order, for finding the oldest
+    int *victims;       // heap of live indices, the next to evict first
+    int victimsLen;     // not count when it has to be made again
+    int count;          // live ones, in [0, count)
+    int capacity;       // 0 until loaded
+    ParticleEviction eviction;
+    unsigned int nextSerial;
+    void *block;        // the arrays are all in this one allocation
+} ParticleArrays;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//----------------------------------------------------------------------------------
+// Particle System Functions Declaration
+//----------------------------------------------------------------------------------
+bool LoadParticleArrays(ParticleArrays *particles, int capacity, ParticleEviction eviction);  // none alive
+void UnloadParticleArrays(ParticleArrays *particles);
+void ClearParticleArrays(ParticleArrays *particles);   // none alive
+bool AddParticle(ParticleArrays *particles, Particle particle);    // true if a live one was evicted for it
+void RemoveParticle(ParticleArrays *particles, int index); // the last one takes its place
+void RemoveDeadParticles(ParticleArrays *particles);    // the ones with lifetime <= 0
+Particle GetParticle(const ParticleArrays *particles, int index);
+
+void IntegrateParticles(ParticleArrays *particles, int first, int last, float delta);  // [first, last) age by delta and move by vel*delta. first a multiple of PARTICLE_LANES. RemoveDeadParticles after, before adding more
+void ComputeParticleFade(const ParticleArrays *particles, float *fade); // lifetime/max_lifetime for each of count
+const char *GetParticleKernelName(void);    // which instruction set the kernels were built for
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // PARTICLE_SYSTEM_H
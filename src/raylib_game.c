@@ -14,6 +14,8 @@
 
 #include "raylib.h"
 #include "screens.h"    // NOTE: Declares global (extern) variables and screens functions
+#include "simulation.h" // SIM_TICK_RATE
+#include "asset_loader.h"
 
 #if defined(PLATFORM_WEB)
     #include <emscripten/emscripten.h>
@@ -41,11 +43,19 @@ static bool transFadeOut = false;
 static int transFromScreen = -1;
 static int transToScreen = -1;
 
+// Gameplay simulates in fixed steps, drawing interpolates between the last two of them
+#define MAX_FRAME_TIME 0.25f    // longer frames (hitches, breakpoints) are dropped, not caught up on
+#ifndef SIM_TIME_SCALE
+    #define SIM_TIME_SCALE 1.0f // above 1 the simulation runs faster than real time
+#endif
+static float simAccumulator = 0.0f;
+
 //----------------------------------------------------------------------------------
 // Local Functions Declaration
 //----------------------------------------------------------------------------------
 static void ChangeToScreen(int screen);     // Change to screen, no transition effect
 
+static void PreloadScreen(int screen);      // Start loading what a screen needs in the background
 static void TransitionToScreen(int screen); // Request transition to next screen
 static void UpdateTransition(void);         // Update transition effect
 static void DrawTransition(void);           // Draw transition effect (full-screen rectangle)
@@ -64,17 +74,19 @@ int main(void)
     InitAudioDevice();      // Initialize audio device
 
     // Load global data (assets that must be available in all screens, i.e. font)
-    font = LoadFont("resources/mecha.png");
+    // NOTE: They load in the background, the first screen comes in once they're done
+    RequestFont("resources/mecha.png", &font);
     // music = LoadMusicStream("resources/ambient.ogg");
-    fxCoin = LoadSound("resources/coin.wav");
+    RequestSound("resources/coin.wav", &fxCoin);
 
     SetMusicVolume(music, 1.0f);
     
     // PlayMusicStream(music);
 
-    // Setup and init first screen
-    currentScreen = GAMEPLAY;
-    InitGameplayScreen();
+    // Setup and init first screen, faded in from black like any other
+    currentScreen = -1;
+    TransitionToScreen(GAMEPLAY);
+    transAlpha = 1.0f;
 
 #if defined(PLATFORM_WEB)
     emscripten_set_main_loop(UpdateDrawFrame, 60, 1);
@@ -102,6 +114,7 @@ int main(void)
     }
 
     // Unload global data loaded
+    UnloadAssetLoading();   // closing while something still loads
     UnloadFont(font);
     // UnloadMusicStream(music);
     UnloadSound(fxCoin);
@@ -143,7 +156,19 @@ static void ChangeToScreen(int screen)
     currentScreen = screen;
 }
 
+// Start loading what a screen needs in the background
+// NOTE: Screens without a Preload function load everything in Init
+static void PreloadScreen(int screen)
+{
+    switch (screen)
+    {
+        case GAMEPLAY: PreloadGameplayScreen(); break;
+        default: break;
+    }
+}
+
 // Request transition to next screen
+// NOTE: The next screen starts loading now, while the current one fades out
 static void TransitionToScreen(int screen)
 {
     onTransition = true;
@@ -151,6 +176,8 @@ static void TransitionToScreen(int screen)
     transFromScreen = currentScreen;
     transToScreen = screen;
     transAlpha = 0.0f;
+
+    PreloadScreen(screen);
 }
 
 // Update transition effect (fade-in, fade-out)
@@ -166,6 +193,9 @@ static void UpdateTransition(void)
         {
             transAlpha = 1.0f;
 
+            // Stay faded out until the loader is done, the progress bar shows meanwhile
+            if (!IsAssetLoadingDone()) return;
+
             // Unload current screen
             switch (transFromScreen)
             {
@@ -212,6 +242,16 @@ static void UpdateTransition(void)
 static void DrawTransition(void)
 {
     DrawRectangle(0, 0, GetScreenWidth(), GetScreenHeight(), Fade(BLACK, transAlpha));
+
+    // Loading progress bar, only once it's faded out and still waiting
+    if (!transFadeOut && (transAlpha >= 1.0f) && !IsAssetLoadingDone())
+    {
+        int width = GetScreenWidth()/2;
+        int x = (GetScreenWidth() - width)/2;
+        int y = GetScreenHeight()/2;
+        DrawRectangleLines(x, y, width, 20, GRAY);
+        DrawRectangle(x + 2, y + 2, (int)((float)(width - 4)*GetAssetLoadingProgress()), 16, RAYWHITE);
+    }
 }
 
 // Update and draw game frame
@@ -220,6 +260,7 @@ static void UpdateDrawFrame(void)
     // Update
     //----------------------------------------------------------------------------------
     // UpdateMusicStream(music);       // NOTE: Music keeps playing between screens
+    UpdateAssetLoading(ASSET_UPLOAD_BUDGET);    // NOTE: Hands over a little of what's loaded each frame
 
     if (!onTransition)
     {
@@ -251,6 +292,17 @@ static void UpdateDrawFrame(void)
             {
                 UpdateGameplayScreen();
 
+                const float step = 1.0f/SIM_TICK_RATE;
+                float frameTime = GetFrameTime();
+                if (frameTime > MAX_FRAME_TIME) frameTime = MAX_FRAME_TIME;
+                simAccumulator += frameTime*SIM_TIME_SCALE;
+                while (simAccumulator >= step)
+                {
+                    FixedUpdateGameplayScreen(step);
+                    simAccumulator -= step;
+                }
+                SetGameplayInterpolation(simAccumulator/step);
+
                 if (FinishGameplayScreen() == 1) TransitionToScreen(ENDING);
                 //else if (FinishGameplayScreen() == 2) TransitionToScreen(TITLE);
 
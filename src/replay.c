@@ -0,0 +1,371 @@
+/**********************************************************************************************
+*
+*   Input recording and replay
+*
+*   File layout, all integers little endian:
+*       "FREP" | u32 version | u32 tick rate | u32 seed | u32 ticks
+*       u32 level path length | level path | u32 spans length | spans
+*
+*   Each span is a flags byte, the changed fields it flags, then the number of ticks it
+*   lasts as a 7 bits per byte varint.
+*
+*   Copyright (c) 2022 creikey
+*
+**********************************************************************************************/
+
+#include "replay.h"
+#include <stddef.h>
+#include <string.h>
+
+#define REPLAY_VERSION 1
+#define REPLAY_HEADER_SIZE 24   // magic, version, tick rate, seed, ticks, level path length
+#define MIN_DATA_CAPACITY 256
+
+// span flags
+#define SPAN_GRAB       (1 << 0)
+#define SPAN_SPRAY      (1 << 1)
+#define SPAN_EDITING    (1 << 2)
+#define SPAN_MOVEMENT   (1 << 3)    // followed by movement x and y
+#define SPAN_AIM        (1 << 4)    // followed by aim x and y
+
+//----------------------------------------------------------------------------------
+// Module Functions Definition (local)
+//----------------------------------------------------------------------------------
+static bool ReserveData(Replay *replay, int extra)
+{
+    int wanted = replay->dataLen + extra;
+    if (wanted <= replay->dataCapacity)
+    {
+        return true;
+    }
+    int newCapacity = (replay->dataCapacity < MIN_DATA_CAPACITY) ? MIN_DATA_CAPACITY : replay->dataCapacity * 2;
+    while (newCapacity < wanted)
+    {
+        newCapacity *= 2;
+    }
+    unsigned char *newData = RL_REALLOC(replay->data, newCapacity);
+    if (newData == NULL)
+    {
+        TraceLog(LOG_ERROR, "REPLAY: Failed to grow recording to %i bytes", newCapacity);
+        return false;
+    }
+    replay->data = newData;
+    replay->dataCapacity = newCapacity;
+    return true;
+}
+
+static void WriteU32(unsigned char *out, unsigned int value)
+{
+    out[0] = (unsigned char)(value & 0xff);
+    out[1] = (unsigned char)((value >> 8) & 0xff);
+    out[2] = (unsigned char)((value >> 16) & 0xff);
+    out[3] = (unsigned char)((value >> 24) & 0xff);
+}
+
+static unsigned int ReadU32(const unsigned char *in)
+{
+    return (unsigned int)in[0] | ((unsigned int)in[1] << 8) | ((unsigned int)in[2] << 16) | ((unsigned int)in[3] << 24);
+}
+
+static void WriteVector2(unsigned char *out, Vector2 v)
+{
+    unsigned int bits[2];
+    memcpy(&bits[0], &v.x, sizeof(float));
+    memcpy(&bits[1], &v.y, sizeof(float));
+    WriteU32(out, bits[0]);
+    WriteU32(out + 4, bits[1]);
+}
+
+static Vector2 ReadVector2(const unsigned char *in)
+{
+    unsigned int bits[2] = { ReadU32(in), ReadU32(in + 4) };
+    Vector2 v = { 0 };
+    memcpy(&v.x, &bits[0], sizeof(float));
+    memcpy(&v.y, &bits[1], sizeof(float));
+    return v;
+}
+
+// bitwise, so -0.0f and 0.0f differ like they would in the simulation
+static bool Vector2Same(Vector2 a, Vector2 b)
+{
+    return memcmp(&a, &b, sizeof(Vector2)) == 0;
+}
+
+static bool InputSame(const SimInput *a, const SimInput *b)
+{
+    return Vector2Same(a->movement, b->movement) && Vector2Same(a->aim, b->aim) &&
+        (a->grabPressed == b->grabPressed) && (a->sprayDown == b->sprayDown) && (a->editing == b->editing);
+}
+
+static void FlushSpan(Replay *replay)
+{
+    if (replay->spanTicks == 0)
+    {
+        return;
+    }
+    if (!ReserveData(replay, 1 + 8 + 8 + 5))
+    {
+        return;
+    }
+
+    const SimInput *in = &replay->spanInput;
+    unsigned char flags = 0;
+    if (in->grabPressed) flags |= SPAN_GRAB;
+    if (in->sprayDown) flags |= SPAN_SPRAY;
+    if (in->editing) flags |= SPAN_EDITING;
+    if (!Vector2Same(in->movement, replay->written.movement)) flags |= SPAN_MOVEMENT;
+    if (!Vector2Same(in->aim, replay->written.aim)) flags |= SPAN_AIM;
+
+    unsigned char *out = replay->data + replay->dataLen;
+    *out++ = flags;
+    if (flags & SPAN_MOVEMENT)
+    {
+        WriteVector2(out, in->movement);
+        out += 8;
+    }
+    if (flags & SPAN_AIM)
+    {
+        WriteVector2(out, in->aim);
+        out += 8;
+    }
+    unsigned int ticks = (unsigned int)replay->spanTicks;
+    while (ticks >= 0x80)
+    {
+        *out++ = (unsigned char)(ticks | 0x80);
+        ticks >>= 7;
+    }
+    *out++ = (unsigned char)ticks;
+
+    replay->dataLen = (int)(out - replay->data);
+    replay->written = *in;
+    replay->spanTicks = 0;
+}
+
+// Decodes the span at offset over input, which holds what the spans before it left. False
+// at the end of the data or on a span that runs past it
+static bool ReadSpan(const Replay *replay, int *offset, SimInput *input, unsigned int *ticks)
+{
+    const unsigned char *data = replay->data;
+    int end = replay->dataLen;
+    int at = *offset;
+    if (at >= end)
+    {
+        return false;
+    }
+
+    unsigned char flags = data[at++];
+    int fieldsLen = ((flags & SPAN_MOVEMENT) ? 8 : 0) + ((flags & SPAN_AIM) ? 8 : 0);
+    if (at + fieldsLen > end)
+    {
+        TraceLog(LOG_WARNING, "REPLAY: Span runs past the end of the recording");
+        return false;
+    }
+    input->grabPressed = (flags & SPAN_GRAB) != 0;
+    input->sprayDown = (flags & SPAN_SPRAY) != 0;
+    input->editing = (flags & SPAN_EDITING) != 0;
+    if (flags & SPAN_MOVEMENT)
+    {
+        input->movement = ReadVector2(data + at);
+        at += 8;
+    }
+    if (flags & SPAN_AIM)
+    {
+        input->aim = ReadVector2(data + at);
+        at += 8;
+    }
+
+    *ticks = 0;
+    int shift = 0;
+    while ((at < end) && (shift < 32))
+    {
+        unsigned char b = data[at++];
+        *ticks |= (unsigned int)(b & 0x7f) << shift;
+        shift += 7;
+        if (!(b & 0x80))
+        {
+            break;
+        }
+    }
+    *offset = at;
+    return true;
+}
+
+// whether the spans decode and add up to the ticks the header says, which is what playback
+// and anything sized from ticks trust
+static bool CheckSpanTicks(const Replay *replay)
+{
+    SimInput input = { 0 };
+    long long total = 0;
+    int offset = 0;
+    while (offset < replay->dataLen)
+    {
+        unsigned int ticks = 0;
+        if (!ReadSpan(replay, &offset, &input, &ticks) || (ticks == 0))
+        {
+            return false;
+        }
+        total += ticks;
+        if (total > replay->ticks)
+        {
+            return false;
+        }
+    }
+    return total == replay->ticks;
+}
+
+//----------------------------------------------------------------------------------
+// Replay Functions Definition
+//----------------------------------------------------------------------------------
+void BeginReplayRecording(Replay *replay, const char *level, unsigned int seed)
+{
+    UnloadReplay(replay);
+    if (level != NULL)
+    {
+        int len = (int)strlen(level);
+        memcpy(replay->level, level, (len < SIM_MAX_LEVEL_PATH - 1) ? len : SIM_MAX_LEVEL_PATH - 1);
+    }
+    replay->seed = seed;
+    RestartSimulation(replay->level, seed);
+}
+
+void RecordReplayTick(Replay *replay, const SimInput *input)
+{
+    SimInput in = *input;
+    if (!in.grabPressed && !in.sprayDown)
+    {
+        // nothing reads the aim this tick, don't break the span over it
+        in.aim = (replay->spanTicks > 0) ? replay->spanInput.aim : replay->written.aim;
+    }
+
+    if ((replay->spanTicks > 0) && !InputSame(&in, &replay->spanInput))
+    {
+        FlushSpan(replay);
+    }
+    replay->spanInput = in;
+    replay->spanTicks += 1;
+    replay->ticks += 1;
+}
+
+void EndReplayRecording(Replay *replay)
+{
+    FlushSpan(replay);
+}
+
+bool SaveReplay(const Replay *replay, const char *path)
+{
+    unsigned int levelLen = (unsigned int)strlen(replay->level);
+    unsigned int size = REPLAY_HEADER_SIZE + levelLen + 4 + (unsigned int)replay->dataLen;
+    unsigned char *file = RL_MALLOC(size);
+    if (file == NULL)
+    {
+        TraceLog(LOG_ERROR, "REPLAY: [%s] Failed to allocate %u bytes to save", path, size);
+        return false;
+    }
+
+    memcpy(file, "FREP", 4);
+    WriteU32(file + 4, REPLAY_VERSION);
+    WriteU32(file + 8, SIM_TICK_RATE);
+    WriteU32(file + 12, replay->seed);
+    WriteU32(file + 16, (unsigned int)replay->ticks);
+    WriteU32(file + 20, levelLen);
+    memcpy(file + REPLAY_HEADER_SIZE, replay->level, levelLen);
+    WriteU32(file + REPLAY_HEADER_SIZE + levelLen, (unsigned int)replay->dataLen);
+    if (replay->dataLen > 0)
+    {
+        memcpy(file + REPLAY_HEADER_SIZE + levelLen + 4, replay->data, replay->dataLen);
+    }
+
+    bool saved = SaveFileData(path, file, size);
+    RL_FREE(file);
+    return saved;
+}
+
+bool LoadReplay(Replay *replay, const char *path)
+{
+    UnloadReplay(replay);
+
+    unsigned int bytesRead = 0;
+    unsigned char *file = LoadFileData(path, &bytesRead);
+    if (file == NULL)
+    {
+        return false;
+    }
+
+    bool valid = false;
+    if ((bytesRead < REPLAY_HEADER_SIZE) || (memcmp(file, "FREP", 4) != 0))
+    {
+        TraceLog(LOG_WARNING, "REPLAY: [%s] Not a replay file", path);
+    }
+    else if (ReadU32(file + 4) != REPLAY_VERSION)
+    {
+        TraceLog(LOG_WARNING, "REPLAY: [%s] Unsupported version %u", path, ReadU32(file + 4));
+    }
+    else if (ReadU32(file + 8) != SIM_TICK_RATE)
+    {
+        TraceLog(LOG_WARNING, "REPLAY: [%s] Recorded at %u ticks per second, the simulation runs at %i", path, ReadU32(file + 8), SIM_TICK_RATE);
+    }
+    else
+    {
+        unsigned int levelLen = ReadU32(file + 20);
+        unsigned int dataLen = (levelLen < SIM_MAX_LEVEL_PATH) && (REPLAY_HEADER_SIZE + levelLen + 4 <= bytesRead) ?
+            ReadU32(file + REPLAY_HEADER_SIZE + levelLen) : 0;
+        if ((levelLen >= SIM_MAX_LEVEL_PATH) || (REPLAY_HEADER_SIZE + levelLen + 4 + dataLen != bytesRead))
+        {
+            TraceLog(LOG_WARNING, "REPLAY: [%s] File is truncated or corrupt", path);
+        }
+        else if (ReserveData(replay, (int)dataLen))
+        {
+            replay->seed = ReadU32(file + 12);
+            replay->ticks = (int)ReadU32(file + 16);
+            memcpy(replay->level, file + REPLAY_HEADER_SIZE, levelLen);
+            replay->level[levelLen] = '\0';
+            memcpy(replay->data, file + REPLAY_HEADER_SIZE + levelLen + 4, dataLen);
+            replay->dataLen = (int)dataLen;
+            valid = (replay->ticks >= 0) && CheckSpanTicks(replay);
+            if (!valid)
+            {
+                TraceLog(LOG_WARNING, "REPLAY: [%s] Spans don't add up to the %i ticks in the header", path, replay->ticks);
+            }
+        }
+    }
+
+    UnloadFileData(file);
+    if (!valid)
+    {
+        UnloadReplay(replay);
+    }
+    return valid;
+}
+
+void UnloadReplay(Replay *replay)
+{
+    RL_FREE(replay->data);
+    *replay = (Replay){ 0 };
+}
+
+ReplayCursor BeginReplayPlayback(const Replay *replay)
+{
+    RestartSimulation(replay->level, replay->seed);
+    return (ReplayCursor){ .replay = replay };
+}
+
+bool NextReplayInput(ReplayCursor *cursor, SimInput *input)
+{
+    if (cursor->spanTicksLeft == 0)
+    {
+        unsigned int ticks = 0;
+        if (!ReadSpan(cursor->replay, &cursor->offset, &cursor->input, &ticks))
+        {
+            return false;
+        }
+        cursor->spanTicksLeft = (int)ticks;
+        if (ticks == 0)
+        {
+            return false;
+        }
+    }
+
+    *input = cursor->input;
+    cursor->spanTicksLeft -= 1;
+    return true;
+}
@@ -0,0 +1,72 @@
+/**********************************************************************************************
+*
+*   Input recording and replay
+*
+*   A replay is the level path, the simulation seed and the SimInput of every tick. Replayed
+*   through RestartSimulation and StepSimulation it plays out bit for bit the same as the
+*   session that was recorded (same build, same level file).
+*
+*   Inputs are stored as spans: an input and how many ticks in a row it was held, and only
+*   the fields that changed since the previous span. Aim only matters on ticks that grab or
+*   spray, so it isn't recorded otherwise. Floats are stored as their little endian bits.
+*
+*   Copyright (c) 2022 creikey
+*
+**********************************************************************************************/
+
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include "raylib.h"
+#include "simulation.h"
+
+//----------------------------------------------------------------------------------
+// Types and Structures Definition
+//----------------------------------------------------------------------------------
+typedef struct Replay
+{
+    char level[SIM_MAX_LEVEL_PATH];
+    unsigned int seed;
+    int ticks;
+
+    unsigned char *data;    // encoded spans
+    int dataLen;
+    int dataCapacity;
+
+    // recording, the span still being extended
+    SimInput spanInput;
+    int spanTicks;
+    SimInput written;       // what the decoder will know after the spans so far
+} Replay;
+
+// Where a playback is in a replay
+typedef struct ReplayCursor
+{
+    const Replay *replay;
+    int offset;
+    int spanTicksLeft;
+    SimInput input;
+} ReplayCursor;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//----------------------------------------------------------------------------------
+// Replay Functions Declaration
+//----------------------------------------------------------------------------------
+void BeginReplayRecording(Replay *replay, const char *level, unsigned int seed);   // also restarts the simulation
+void RecordReplayTick(Replay *replay, const SimInput *input);   // the input exactly as passed to StepSimulation
+void EndReplayRecording(Replay *replay);
+bool SaveReplay(const Replay *replay, const char *path);
+bool LoadReplay(Replay *replay, const char *path);
+void UnloadReplay(Replay *replay);
+
+ReplayCursor BeginReplayPlayback(const Replay *replay);     // restarts the simulation the way the recording did
+bool NextReplayInput(ReplayCursor *cursor, SimInput *input);    // false once the replay is over
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // REPLAY_H
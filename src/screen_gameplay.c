@@ -26,9 +26,19 @@
 #include "raylib.h"
 #include "raymath.h"
 #include "screens.h"
+#include "entities.h"
+#include "simulation.h"
+#include "replay.h"
+#include "asset_loader.h"
+#include "sprite_batch.h"
+#include "particle_renderer.h"
+#include "static_layer.h"
+#include "spatial_grid.h"
+#include "aabb_tree.h"
 #include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <time.h>
 
 // emscripten?? why no max
 #ifndef max 
@@ -36,56 +46,12 @@
 #endif
 
 #define SCREEN_SIZE 900 // screen assumed to be square. Used for camera offset
-const float player_radius = 18.0;
-const float player_grab_radius = 50.0;
+#define HELP_TEXT_SIZE 24
+// furthest a help text can reach from its position, all of it on one line or a character a line
+#define HELP_TEXT_REACH ((float)sizeof(((HelpTextData *)0)->text) * HELP_TEXT_SIZE * 1.5f)
 const char *level_name = "resources/saved.level";
+const char *replay_name = "resources/last.replay";
 
-typedef struct KinematicInfo
-{
-    Vector2 vel;
-    Vector2 pos;
-    bool onGround;
-} KinematicInfo;
-
-// All the entity datas
-typedef struct PlayerData
-{
-    KinematicInfo k;
-    int grabbedEntity;
-    float health;
-} PlayerData;
-typedef Rectangle ObstacleData;
-typedef Rectangle GroundData;
-typedef struct FireData
-{
-    Rectangle rect;
-    float fireLeft;
-    float fireParticleTimer;
-} FireData;
-typedef struct ExtinguisherData
-{
-    KinematicInfo info;
-    float amountUsed;
-} ExtinguisherData;
-typedef struct HelpTextData
-{
-    Vector2 pos;
-    char text[100];
-} HelpTextData;
-
-// Entity types
-enum Type
-{
-    Player,
-    Obstacle,
-    Ground,
-    Extinguisher,
-    Fire,
-    HelpText,
-
-    // UPDATE MAX_TYPE WHEN YOU CHANGE THIS
-};
-#define MAX_TYPE HelpText
 static const char *TypeNames[] = {
     "Player",
     "Obstacle",
@@ -95,169 +61,38 @@ static const char *TypeNames[] = {
     "Help Text",
 };
 
-typedef struct Entity
-{
-    int id;
-    enum Type type;
-    union
-    {
-        PlayerData player;
-        ObstacleData obstacle;
-        GroundData ground;
-        ExtinguisherData extinguisher;
-        FireData fire;
-        HelpTextData help;
-        int empty_data[64]; // so I can add new fields without it breaking
-    };
-} Entity;
-
-enum ParticleType
-{
-    RetardantParticle,
-    FireParticle,
-};
-typedef struct Particle
-{
-    Vector2 pos;
-    Vector2 vel;
-    float lifetime;
-    float max_lifetime; // used to compute color alpha
-    Color color;
-    enum ParticleType type;
-} Particle;
-
 // editor state
 static bool editing = false;
 static int currentType = 0;
-static Entity *currentEntity = NULL;
+static ID currentEntityID = { 0 };
+static Vector2 dragStart = { 0 };   // corner the rect being drawn started from, the store keeps it normalized
 
 // game state
 static int finishScreen = 0;
-static Vector2 spawnPoint = {0};
 static Camera2D camera;
 static int frameID = 0;
 
-// entity stuff
-typedef int ID;
-static Entity entities[1000];
-static int entitiesLen = 0;
-static ID curNextEntityID = 0;
-
-// particles
-#define MAX_PARTICLES 1000
-#define PARTICLE_RADIUS 17.0
-static Particle particles[MAX_PARTICLES];
-static int curParticleIndex = 0;
-
-void SpawnParticle(Particle p)
-{
-    int newParticleIndex = (curParticleIndex + 1) % MAX_PARTICLES;
-    particles[newParticleIndex] = p;
-    curParticleIndex = newParticleIndex;
-}
-
-int GetEntityIndex(ID id)
-{
-    for (int i = 0; i < entitiesLen; i++)
-    {
-        if (entities[i].id == id)
-        {
-            return i;
-        }
-    }
-    return -1;
-}
-
-// null if entity doesn't exist
-Entity *GetEntity(ID id)
-{
-    int index = GetEntityIndex(id);
-    if (index == -1)
-    {
-        return NULL;
-    }
-    return &entities[index];
-}
-
-// null if player not in entities
-Entity *GetPlayerEntity()
-{
-    for (int i = 0; i < entitiesLen; i++)
-    {
-        if (entities[i].type == Player)
-        {
-            return &entities[i];
-        }
-    }
-    return NULL;
-}
-
-void DeleteEntityIndex(int index)
-{
-    for (int i = index; i < entitiesLen - 1; i++)
-    {
-        entities[i] = entities[i + 1];
-    }
-    entitiesLen -= 1;
-}
-
-void DeleteEntity(ID id)
-{
-    int index = GetEntityIndex(id);
-    if (index != -1)
-    {
-        DeleteEntityIndex(index);
-    }
-}
-
-Entity *AddEntity(Entity e)
-{
-    e.id = curNextEntityID;
-    curNextEntityID += 1;
-    entities[entitiesLen] = e;
-    entitiesLen += 1;
-    return &entities[entitiesLen - 1];
-}
-
-void SaveEntities(const char *path)
-{
-    SaveFileData(path, (void *)entities, entitiesLen * sizeof(Entity));
-}
-void LoadEntities(const char *path, bool setSpawnPoint)
-{
-    unsigned int bytesRead;
-    unsigned char *data = LoadFileData(path, &bytesRead);
-    for (int i = 0; i < bytesRead / sizeof(Entity); i++)
-    {
-        entities[i] = ((Entity *)data)[i];
-        curNextEntityID = max(curNextEntityID, entities[i].id);
-    }
-    curNextEntityID = curNextEntityID + 1;
-    entitiesLen = bytesRead / sizeof(Entity);
-    UnloadFileText((char *)data);
-
-    if (setSpawnPoint)
-    {
-        spawnPoint = GetPlayerEntity()->player.k.pos;
-    }
-
-    GetPlayerEntity()->player.k.pos = spawnPoint;
-
-    camera.target = GetPlayerEntity()->player.k.pos;
-
-    // delete stuff that's flying away
-    // for(int i = 0; i < entitiesLen; i++) {
-    //     if(entities[i].type == Extinguisher && fabs(entities[i].extinguisher.info.pos.x) > 20000.0) {
-    //         DeleteEntityIndex(i);
-    //         break;
-    //     }
-    // }
-    // for debugging stuff, also put any programmatic level modifications here
-    // for (int i = 0; i < entitiesLen; i++)
-    // {
-    //     printf("%s %d\n", TypeNames[entities[i].type], entities[i].id);
-    // }
-}
+// Input is sampled once per rendered frame and consumed by the fixed ticks. Presses stay
+// latched until a tick has seen them, so a click is neither handled twice when a frame
+// runs two ticks nor lost when it runs none
+static SimInput input = { 0 };
+static float interpolation = 1.0f; // how far from the previous tick to the latest one to draw
+static int lastDeaths = 0; // to notice the simulation respawning the player
+
+// F5 records from a fresh load of the level until pressed again, F6 plays the last
+// recording back. Anything that changes the world outside the simulation ends both
+static Replay replay = { 0 };
+static ReplayCursor replayCursor = { 0 };
+static bool recording = false;
+static bool playingBack = false;
+
+// what's in view this frame, from the grid and the body tree
+static GridQuery visibleStatics = { 0 };
+static GridQuery visibleHelpTexts = { 0 };
+static ID *visibleExtinguishers = NULL;
+static int visibleExtinguishersLen = 0;
+static int visibleExtinguishersCapacity = 0;
+static int entitiesDrawn = 0;
 
 // returns whichever has greater magnitude
 float absmax(float a, float b)
@@ -269,11 +104,6 @@ float absmax(float a, float b)
     return b;
 }
 
-float RandFloat(float min, float max)
-{
-    return ((max - min) * ((float)rand() / (float)RAND_MAX)) + min;
-}
-
 Color ColorLerp(Color from, Color to, float factor)
 {
     return (Color){
@@ -286,7 +116,8 @@ Color ColorLerp(Color from, Color to, float factor)
 
 void DrawTexCenteredWithCol(Texture t, Vector2 pos, float scale, Color col)
 {
-    DrawTextureEx(t, Vector2Add(pos, Vector2Scale((Vector2){.x = (float)t.width, .y = (float)t.height}, -scale * 0.5f)), 0.0f, scale, col);
+    Vector2 size = Vector2Scale((Vector2){.x = (float)t.width, .y = (float)t.height}, scale);
+    DrawSpriteTexture(t, (Rectangle){pos.x - size.x * 0.5f, pos.y - size.y * 0.5f, size.x, size.y}, col);
 }
 
 void DrawTexCentered(Texture t, Vector2 pos, float scale)
@@ -294,22 +125,44 @@ void DrawTexCentered(Texture t, Vector2 pos, float scale)
     DrawTexCenteredWithCol(t, pos, scale, WHITE);
 }
 
-float clamp(float value, float min, float max)
+Vector2 WorldMousePos()
 {
-    if (value < min)
+    return Vector2Add(GetMousePosition(), Vector2Subtract(camera.target, camera.offset));
+}
+
+static void StopReplay(void)
+{
+    if (recording)
     {
-        return min;
+        EndReplayRecording(&replay);
+        SaveReplay(&replay, replay_name);
+        TraceLog(LOG_INFO, "REPLAY: Recorded %i ticks to %s", replay.ticks, replay_name);
     }
-    if (value > max)
+    recording = false;
+    playingBack = false;
+}
+
+// Playing, R is a quick retry from memory. The editor reloads from the disk
+static void ReloadLevel(void)
+{
+    StopReplay();
+    if (editing)
+    {
+        LoadEntities(level_name, false);
+        StopLevelStreaming();
+    }
+    else
     {
-        return max;
+        ResetLevel();
     }
-    return value;
+    camera.target = GetPlayerEntity()->player.k.pos;
 }
 
-Vector2 WorldMousePos()
+// after the simulation restarted for a replay
+static void SnapToRestart(void)
 {
-    return Vector2Add(GetMousePosition(), Vector2Subtract(camera.target, camera.offset));
+    lastDeaths = 0;
+    camera.target = GetPlayerEntity()->player.k.pos;
 }
 
 // Project a onto b
@@ -327,252 +180,53 @@ static Texture textures[] = {
     {0},
 };
 
-// Gameplay Screen Initialization logic
-void InitGameplayScreen(void)
-{
-    textures[EXTINGUISHER_TEXTURE] = LoadTexture("resources/Extinguisher.png");
-    camera = (Camera2D){
-        .offset = (Vector2){.x = SCREEN_SIZE / 2.0f, .y = SCREEN_SIZE / 2.0f},
-        .target = (Vector2){0},
-        .rotation = 0.0,
-        .zoom = 1.0,
-    };
-    if (FileExists(level_name))
-    {
-        LoadEntities(level_name, true);
-    }
-    else
-    {
-        entities[0] = (Entity){
-            .id = 0,
-            .type = Player,
-            .player = {
-                .k = {
-                    .pos = (Vector2){200, 300},
-                    .vel = (Vector2){0},
-                },
-                .grabbedEntity = -1,
-            },
-        };
-        entities[1] = (Entity){
-            .id = 1,
-            .type = Obstacle,
-            .obstacle = {
-                .x = 100,
-                .y = 400,
-                .width = 100,
-                .height = 200,
-            },
-        };
-        curNextEntityID = 2;
-        entitiesLen = 2;
-        spawnPoint = GetPlayerEntity()->player.k.pos;
-    }
-}
+static const enum Type drawLayers[] = { Ground, Obstacle, Fire, HelpText };
+
+// what PreloadGameplayScreen asked the loader for
+static bool preloading = false;
+static LevelImage preloadedLevel = { 0 };
 
-Rectangle FixNegativeRect(Rectangle rect)
+// Gameplay Screen asset loading, starts reading them in the background
+void PreloadGameplayScreen(void)
 {
-    if (rect.width < 0.0)
+    if (preloading)
     {
-        rect.x += rect.width;
-        rect.width *= -1.0;
+        return;
     }
-    if (rect.height < 0.0)
+    preloading = true;
+    RequestTexture("resources/Extinguisher.png", &textures[EXTINGUISHER_TEXTURE]);
+    if (FileExists(level_name))
     {
-        rect.y += rect.height;
-        rect.height *= -1.0;
+        RequestLevelImage(level_name, &preloadedLevel);
     }
-    return rect;
 }
 
-// unlike the raylib function for this this one works on negative width and height
-bool RectHasPoint(Rectangle rect, Vector2 point)
-{
-    rect = FixNegativeRect(rect);
-    return CheckCollisionPointRec(point, rect);
-}
-
-KinematicInfo GlideAndBounce(KinematicInfo k, float bounceFactor)
-{
-    k.onGround = false;
-    for (int i = 0; i < entitiesLen; i++)
-    {
-        if (entities[i].type == Obstacle)
-        {
-            Rectangle obstacle = FixNegativeRect(entities[i].obstacle);
-            Vector2 normal = {0};
-            bool bounced = false;
-            {
-                Vector2 obstacleCenter = {.x = obstacle.x + obstacle.width / 2.0f, .y = obstacle.y + obstacle.height / 2.0f};
-                Vector2 fromObstacleCenter = Vector2Subtract(k.pos, obstacleCenter);
-                fromObstacleCenter.x = clamp(fromObstacleCenter.x, -obstacle.width / 2.0f, obstacle.width / 2.0f);
-                fromObstacleCenter.y = clamp(fromObstacleCenter.y, -obstacle.height / 2.0f, obstacle.height / 2.0f);
-                Vector2 closestPointOnObstacle = Vector2Add(fromObstacleCenter, obstacleCenter);
-                if (Vector2Distance(closestPointOnObstacle, k.pos) < player_radius)
-                {
-                    bounced = true;
-                    normal = Vector2Normalize(Vector2Subtract(k.pos, closestPointOnObstacle));
-                    k.pos = Vector2Add(closestPointOnObstacle, Vector2Scale(normal, player_radius));
-                }
-            }
-            if (bounced)
-                k.vel = Vector2Scale(Vector2Reflect(k.vel, normal), bounceFactor);
-        }
-        else if (entities[i].type == Ground && RectHasPoint(entities[i].obstacle, k.pos))
-        {
-            k.onGround = true;
-        }
-    }
-    return k;
-}
-
-void ProcessEntity(Entity *e)
+// Gameplay Screen Initialization logic
+void InitGameplayScreen(void)
 {
-    switch (e->type)
-    {
-    case Player:
-    {
-        camera.target = Vector2Lerp(camera.target, e->player.k.pos, GetFrameTime() * 5.0f);
-        float delta = GetFrameTime();
-        Vector2 movement = {
-            .x = (float)IsKeyDown(KEY_D) - (float)IsKeyDown(KEY_A),
-            .y = (float)IsKeyDown(KEY_S) - (float)IsKeyDown(KEY_W),
-        };
-
-        movement = Vector2Normalize(movement);
-        bool onGroundBefore = e->player.k.onGround;
-        e->player.k = GlideAndBounce(e->player.k, 1.0f);
-        if (!onGroundBefore && e->player.k.onGround)
-        {
-            spawnPoint = e->player.k.pos;
-        }
-        if (e->player.k.onGround)
-            e->player.k.vel = Vector2Lerp(e->player.k.vel, Vector2Scale(movement, 400.0f), delta * 9.0f);
-        e->player.k.pos = Vector2Add(e->player.k.pos, Vector2Scale(e->player.k.vel, delta));
-
-        bool inFire = false;
-        float fireLeft = 0.0f;
-        for (int i = 0; i < entitiesLen; i++)
-        {
-            if (entities[i].type == Fire && RectHasPoint(entities[i].fire.rect, e->player.k.pos))
-            {
-                inFire = true;
-                fireLeft = entities[i].fire.fireLeft;
-                break;
-            }
-        }
+    // anything not preloaded yet gets loaded now, all at once
+    PreloadGameplayScreen();
+    FinishAssetLoading();
+    preloading = false;
+    LoadSpriteBatch();
+    LoadParticleRenderer();
 
-        if (inFire)
-        {
-            e->player.health -= Lerp(GetFrameTime() / 0.5f, GetFrameTime() / 2.5f, 1.0f - fireLeft);
-        }
-        else if (!e->player.k.onGround)
-        {
-            e->player.health -= GetFrameTime() / 3.0f;
-        }
-        else
-        {
-            e->player.health += GetFrameTime() / 0.5f;
-        }
-
-        e->player.health = clamp(e->player.health, 0.0f, 1.0f);
-
-        if (e->player.grabbedEntity == -1)
-        {
-            if (IsMouseButtonPressed(MOUSE_RIGHT_BUTTON))
-            {
-                for (int i = 0; i < entitiesLen; i++)
-                {
-                    if (entities[i].type == Extinguisher && Vector2Distance(e->player.k.pos, entities[i].extinguisher.info.pos) < player_grab_radius)
-                    {
-                        e->player.grabbedEntity = entities[i].id;
-                        break;
-                    }
-                }
-            }
-        }
-        else
-        {
-            GetEntity(e->player.grabbedEntity)->extinguisher.info.pos = e->player.k.pos;
-            if (IsMouseButtonPressed(MOUSE_RIGHT_BUTTON))
-            {
-                Vector2 extraVelocity = Vector2Scale(Vector2Normalize(Vector2Subtract(WorldMousePos(), e->player.k.pos)), 250.0);
-                GetEntity(e->player.grabbedEntity)->extinguisher.info.vel = Vector2Add(e->player.k.vel, extraVelocity);
-                e->player.k.vel = Vector2Add(e->player.k.vel, Vector2Scale(extraVelocity, -2.0));
-                e->player.grabbedEntity = -1;
-            }
-        }
-
-        break;
-    }
-    case Extinguisher:
+    camera = (Camera2D){
+        .offset = (Vector2){.x = SCREEN_SIZE / 2.0f, .y = SCREEN_SIZE / 2.0f},
+        .target = (Vector2){0},
+        .rotation = 0.0,
+        .zoom = 1.0,
+    };
+    SetSimulationSeed((unsigned int)time(NULL));
+    if (preloadedLevel.file.data != NULL)
     {
-        // detect flying fire extinguishers
-        // if (fabs(e->extinguisher.info.vel.x) > 10.0)
-        // {
-        //     printf("%f %f\n", e->extinguisher.info.pos.x, e->extinguisher.info.pos.y);
-        // }
-        if (GetPlayerEntity()->player.grabbedEntity != e->id)
-        {
-            e->extinguisher.info = GlideAndBounce(e->extinguisher.info, 0.5f);
-            if (e->extinguisher.info.onGround)
-                e->extinguisher.info.vel = Vector2Lerp(e->extinguisher.info.vel, (Vector2){0}, GetFrameTime() * 4.0f);
-            e->extinguisher.info.pos = Vector2Add(e->extinguisher.info.pos, Vector2Scale(e->extinguisher.info.vel, GetFrameTime()));
-            break;
-        }
-        else
-        {
-            if (IsMouseButtonDown(MOUSE_LEFT_BUTTON))
-            {
-                if (e->extinguisher.amountUsed >= 0.99f)
-                {
-                    break;
-                }
-                Vector2 toMouse = Vector2Subtract(WorldMousePos(), e->extinguisher.info.pos);
-                Vector2 solidVelocity = Vector2Scale(Vector2Normalize(toMouse), 200.0f);
-                e->extinguisher.amountUsed += GetFrameTime() / 2.0f;
-                e->extinguisher.amountUsed = clamp(e->extinguisher.amountUsed, 0.0f, 1.0f);
-                GetPlayerEntity()->player.k.vel = Vector2Add(GetPlayerEntity()->player.k.vel, Vector2Scale(toMouse, -GetFrameTime() * 3.0f));
-                SpawnParticle((Particle){
-                    .pos = e->extinguisher.info.pos,
-                    .vel = Vector2Rotate(solidVelocity, (float)GetRandomValue(-50, 50) / 100.0f),
-                    .color = (Color){255, 255, 255, 255},
-                    .lifetime = 3.0,
-                    .max_lifetime = 3.0,
-                    .type = RetardantParticle,
-                });
-            }
-        }
-        break;
+        LoadOpenedLevel(level_name, &preloadedLevel, true);
     }
-    case Fire:
+    else
     {
-        e->fire.fireParticleTimer += GetFrameTime();
-        e->fire.fireLeft = clamp(e->fire.fireLeft, 0.0, 1.0);
-        // don't generate particles if offscreen
-        if (Vector2Distance((Vector2){.x = e->fire.rect.x, .y = e->fire.rect.y}, GetPlayerEntity()->player.k.pos) < 2000.0)
-        {
-            if (e->fire.fireParticleTimer > Lerp(0.05f, 0.5f, 1.0f - e->fire.fireLeft))
-            {
-                SpawnParticle((Particle){
-                    .pos = (Vector2){
-                        .x = RandFloat(e->fire.rect.x, e->fire.rect.x + e->fire.rect.width),
-                        .y = RandFloat(e->fire.rect.y, e->fire.rect.y + e->fire.rect.height),
-                    },
-                    .vel = Vector2Rotate((Vector2){.x = 20.0, .y = 0.0}, RandFloat(-2.0 * PI, 2.0 * PI)),
-                    .color = (Color){255, 0, 0, 255},
-                    .lifetime = 4.0,
-                    .max_lifetime = 10.0,
-                    .type = FireParticle,
-                });
-                e->fire.fireParticleTimer = 0.0;
-            }
-        }
-        break;
-    }
-    default:
-        break;
+        LoadDefaultLevel();
     }
+    camera.target = GetPlayerEntity()->player.k.pos;
 }
 
 void DrawEntity(Entity e)
@@ -581,61 +235,157 @@ void DrawEntity(Entity e)
     {
     case Player:
     {
-        DrawCircleV(e.player.k.pos, player_radius, PINK);
+        DrawSpriteCircle(Vector2Lerp(e.player.prevPos, e.player.k.pos, interpolation), player_radius, PINK);
         break;
     }
     case Obstacle:
     {
-        DrawRectanglePro(FixNegativeRect(e.obstacle), (Vector2){0}, 0.0, (Color){0, 40, 70, 255});
+        DrawSpriteRect(e.obstacle, (Color){0, 40, 70, 255});
         break;
     }
     case Ground:
     {
-        DrawRectanglePro(FixNegativeRect(e.ground), (Vector2){0}, 0.0, DARKGREEN);
+        DrawSpriteRect(e.ground, DARKGREEN);
         break;
     }
     case Fire:
     {
-        DrawRectanglePro(FixNegativeRect(e.fire.rect), (Vector2){0}, 0.0, ColorLerp((Color){230, 41, 55, 50}, (Color){50, 41, 255, 80}, 1.0f - e.fire.fireLeft));
+        DrawSpriteRect(e.fire.rect, ColorLerp((Color){230, 41, 55, 50}, (Color){50, 41, 255, 80}, 1.0f - e.fire.fireLeft));
         break;
     }
     case Extinguisher:
     {
-        DrawTexCenteredWithCol(textures[EXTINGUISHER_TEXTURE], e.extinguisher.info.pos, 0.35f, ColorLerp((Color){255, 255, 255, 255}, (Color){0, 255, 255, 255}, e.extinguisher.amountUsed));
+        DrawTexCenteredWithCol(textures[EXTINGUISHER_TEXTURE], Vector2Lerp(e.extinguisher.prevPos, e.extinguisher.info.pos, interpolation), 0.35f, ColorLerp((Color){255, 255, 255, 255}, (Color){0, 255, 255, 255}, e.extinguisher.amountUsed));
         break;
     }
     case HelpText:
     {
-        DrawText(e.help.text, (int)e.help.pos.x, (int)e.help.pos.y, 24, RED);
+        FlushSpriteBatch(); // text isn't batched, it has to go on top of what came before
+        DrawText(e.help.text, (int)e.help.pos.x, (int)e.help.pos.y, HELP_TEXT_SIZE, RED);
+        break;
+    }
+    default:
         break;
     }
+}
+
+// world rect the camera sees, it never rotates
+static Rectangle GetCameraView(void)
+{
+    Vector2 topLeft = GetScreenToWorld2D((Vector2){0}, camera);
+    Vector2 bottomRight = GetScreenToWorld2D((Vector2){(float)GetScreenWidth(), (float)GetScreenHeight()}, camera);
+    return (Rectangle){topLeft.x, topLeft.y, bottomRight.x - topLeft.x, bottomRight.y - topLeft.y};
+}
+
+static void DrawStaticEntity(const Entity *e)
+{
+    DrawEntity(*e);
+}
+
+static int DrawLayer(enum Type type)
+{
+    for (int layer = 0; layer < (int)(sizeof(drawLayers)/sizeof(drawLayers[0])); layer++)
+    {
+        if (drawLayers[layer] == type)
+            return layer;
     }
+    return 0;
 }
 
+// a layer at a time, in entity order within it like before culling
+static int CompareDrawOrder(const void *a, const void *b)
+{
+    const GridItem *itemA = (const GridItem *)a;
+    const GridItem *itemB = (const GridItem *)b;
+    int layerA = DrawLayer(itemA->type);
+    int layerB = DrawLayer(itemB->type);
+    if (layerA != layerB)
+        return (layerA < layerB) ? -1 : 1;
+    int indexA = GetEntityIndex(itemA->id);
+    int indexB = GetEntityIndex(itemB->id);
+    return (indexA > indexB) - (indexA < indexB);
+}
+
+static int CompareEntityOrder(const void *a, const void *b)
+{
+    int indexA = GetEntityIndex(*(const ID *)a);
+    int indexB = GetEntityIndex(*(const ID *)b);
+    return (indexA > indexB) - (indexA < indexB);
+}
+
+static bool AddVisibleExtinguisher(int proxy, void *context)
+{
+    (void)context;
+    if (visibleExtinguishersLen == visibleExtinguishersCapacity)
+    {
+        int newCapacity = (visibleExtinguishersCapacity < 16) ? 16 : visibleExtinguishersCapacity * 2;
+        ID *newIDs = RL_REALLOC(visibleExtinguishers, newCapacity * sizeof(ID));
+        if (newIDs == NULL)
+            return false;
+        visibleExtinguishers = newIDs;
+        visibleExtinguishersCapacity = newCapacity;
+    }
+    visibleExtinguishers[visibleExtinguishersLen++] = GetAABBProxyID(GetBodyTree(), proxy);
+    return true;
+}
+
+static bool IsHelpTextVisible(const HelpTextData *help, Rectangle view)
+{
+    Vector2 size = MeasureTextEx(GetFontDefault(), help->text, (float)HELP_TEXT_SIZE, (float)(HELP_TEXT_SIZE / 10));
+    return CheckCollisionRecs((Rectangle){help->pos.x, help->pos.y, size.x, size.y}, view);
+}
+
+// Per rendered frame: input sampling and the editor. The simulation itself runs in
+// FixedUpdateGameplayScreen
 void UpdateGameplayScreen(void)
 {
     frameID += 1;
     if (IsKeyPressed(KEY_TAB))
+    {
         editing = !editing;
+        StopReplay();
+        if (editing)
+        {
+            StopLevelStreaming();   // before anything gets edited, so journal keys line up
+        }
+    }
 
     if ((editing && IsKeyPressed(KEY_F2)) || (!editing && IsKeyPressed(KEY_R)))
-        LoadEntities(level_name, false);
-
-    for (int i = 0; i < entitiesLen; i++)
-    {
-        ProcessEntity(&entities[i]);
+        ReloadLevel();
+
+    input.movement = Vector2Normalize((Vector2){
+        .x = (float)IsKeyDown(KEY_D) - (float)IsKeyDown(KEY_A),
+        .y = (float)IsKeyDown(KEY_S) - (float)IsKeyDown(KEY_W),
+    });
+    input.aim = WorldMousePos();
+    input.grabPressed = input.grabPressed || IsMouseButtonPressed(MOUSE_RIGHT_BUTTON);
+    input.sprayDown = IsMouseButtonDown(MOUSE_LEFT_BUTTON);
+    input.editing = editing;
+
+    if (!editing && IsKeyPressed(KEY_F5))
+    {
+        bool wasRecording = recording;
+        StopReplay();
+        if (!wasRecording)
+        {
+            BeginReplayRecording(&replay, level_name, (unsigned int)time(NULL));
+            recording = true;
+            SnapToRestart();
+        }
     }
-
-    // worried about calling load entities from within the entity processing loop
-    // so I put it here
-    if (GetPlayerEntity()->player.health <= 0.0 && !editing)
+    if (!editing && IsKeyPressed(KEY_F6))
     {
-        LoadEntities(level_name, false);
-        GetPlayerEntity()->player.health = 1.0;
+        StopReplay();
+        if (LoadReplay(&replay, replay_name))
+        {
+            replayCursor = BeginReplayPlayback(&replay);
+            playingBack = true;
+            SnapToRestart();
+        }
     }
 
-    // separate loops for gameplay and editing so editing can break early (deleting
-    // multiple entities per loop I can't be bothered to implement)
+    // separate loops for gameplay and editing. Deleting only leaves tombstones, the
+    // editor compacts once after it's done deleting for the frame
     if (editing)
     {
         currentType += (int)GetMouseWheelMove();
@@ -645,11 +395,14 @@ void UpdateGameplayScreen(void)
 
         if (IsKeyPressed(KEY_F1))
         {
-            SaveEntities(level_name);
-            LoadEntities(level_name, false);
+            SaveLevelEdits(level_name);
         }
         if (IsMouseButtonDown(MOUSE_BUTTON_MIDDLE))
+        {
             GetPlayerEntity()->player.k.pos = WorldMousePos();
+            GetPlayerEntity()->player.prevPos = GetPlayerEntity()->player.k.pos;
+            NoteLevelEdit(GetPlayerEntity()->id);
+        }
         if (IsMouseButtonPressed(MOUSE_BUTTON_LEFT))
         {
             if (currentType == Player)
@@ -667,16 +420,24 @@ void UpdateGameplayScreen(void)
                 {
                     toAdd.ground.x = WorldMousePos().x;
                     toAdd.ground.y = WorldMousePos().y;
+                    dragStart = WorldMousePos();
                 }
                 else
                 {
                     toAdd.extinguisher.info.pos = WorldMousePos();
+                    toAdd.extinguisher.prevPos = toAdd.extinguisher.info.pos;
                     toAdd.extinguisher.info.vel = (Vector2){0};
                 }
-                currentEntity = AddEntity(toAdd);
+                Entity *added = AddEntity(toAdd);
+                if (added != NULL)
+                {
+                    currentEntityID = added->id;
+                    NoteLevelEdit(added->id);
+                }
             }
         }
 
+        Entity *currentEntity = GetEntity(currentEntityID);
         if (currentEntity != NULL && currentEntity->type == HelpText)
         {
             char charPressed = GetCharPressed();
@@ -686,24 +447,29 @@ void UpdateGameplayScreen(void)
                 currentEntity->help.text[len] = charPressed;
                 currentEntity->help.text[len + 1] = '\0';
                 charPressed = GetCharPressed();
+                NoteLevelEdit(currentEntity->id);
             }
             if (IsKeyPressed(KEY_ENTER))
             {
-                currentEntity = NULL;
+                currentEntityID = NULL_ID;
             }
         }
         else
         {
             if (currentEntity != NULL && (currentEntity->type == Ground || currentEntity->type == Obstacle || currentEntity->type == Fire))
             {
-                currentEntity->ground.width = WorldMousePos().x - currentEntity->ground.x;
-                currentEntity->ground.height = WorldMousePos().y - currentEntity->ground.y;
-                currentEntity->ground.width = absmax(3.0, currentEntity->ground.width);
-                currentEntity->ground.height = absmax(3.0, currentEntity->ground.height);
+                Rectangle rect = {
+                    .x = dragStart.x,
+                    .y = dragStart.y,
+                    .width = absmax(3.0, WorldMousePos().x - dragStart.x),
+                    .height = absmax(3.0, WorldMousePos().y - dragStart.y),
+                };
+                SetEntityRect(currentEntity->id, rect);
+                NoteLevelEdit(currentEntity->id);
             }
             if (IsMouseButtonReleased(MOUSE_BUTTON_LEFT))
             {
-                currentEntity = NULL;
+                currentEntityID = NULL_ID;
             }
         }
 
@@ -714,6 +480,7 @@ void UpdateGameplayScreen(void)
                 if (entities[i].type == Extinguisher && Vector2Distance(entities[i].extinguisher.info.pos, WorldMousePos()) < 15.0f)
                 {
                     entities[i].extinguisher.amountUsed = 1.0f - entities[i].extinguisher.amountUsed;
+                    NoteLevelEdit(entities[i].id);
                 }
             }
         }
@@ -729,6 +496,7 @@ void UpdateGameplayScreen(void)
                 {
                     if (RectHasPoint(entities[i].ground, WorldMousePos()))
                     {
+                        NoteLevelEdit(entities[i].id);
                         DeleteEntityIndex(i);
                         break;
                     }
@@ -738,6 +506,7 @@ void UpdateGameplayScreen(void)
                 {
                     if (Vector2Distance(entities[i].help.pos, WorldMousePos()) < 30.0f)
                     {
+                        NoteLevelEdit(entities[i].id);
                         DeleteEntityIndex(i);
                         break;
                     }
@@ -747,6 +516,7 @@ void UpdateGameplayScreen(void)
                 {
                     if (Vector2Distance(entities[i].extinguisher.info.pos, WorldMousePos()) < 15.0f)
                     {
+                        NoteLevelEdit(entities[i].id);
                         DeleteEntityIndex(i);
                         break;
                     }
@@ -756,80 +526,132 @@ void UpdateGameplayScreen(void)
                     break;
                 }
             }
+            CompactEntities();
         }
     }
+}
 
-    // process particles
-    for (int i = 0; i < MAX_PARTICLES; i++)
+// One simulation step of delta seconds
+void FixedUpdateGameplayScreen(float delta)
+{
+    SimInput tickInput = input;
+    if (playingBack && !NextReplayInput(&replayCursor, &tickInput))
     {
-        if (particles[i].lifetime <= 0.0)
-        {
-            continue;
-        }
-        for (int ii = 0; ii < entitiesLen; ii++)
-        {
-            if (entities[ii].type == Obstacle && RectHasPoint(entities[ii].obstacle, particles[i].pos))
-            {
-                particles[i].vel = (Vector2){0};
-                break;
-            }
-            else if (particles[i].type == RetardantParticle && entities[ii].type == Fire && RectHasPoint(entities[ii].fire.rect, particles[i].pos))
-            {
-                particles[i].vel = (Vector2){0};
-                particles[i].lifetime /= 2.0;
-                entities[ii].fire.fireLeft -= 0.001f;
-                entities[ii].fire.fireLeft = clamp(entities[ii].fire.fireLeft, 0.0, 1.0);
-            }
-        }
-        particles[i].lifetime -= GetFrameTime();
-        particles[i].pos = Vector2Add(particles[i].pos, Vector2Scale(particles[i].vel, GetFrameTime()));
+        playingBack = false;
+        tickInput = input;
+    }
+    if (recording)
+    {
+        RecordReplayTick(&replay, &tickInput);
     }
+    StepSimulation(&tickInput, delta);
+    input.grabPressed = false;
+
+    if (GetSimulationStats().deaths != lastDeaths)
+    {
+        lastDeaths = GetSimulationStats().deaths;
+        camera.target = GetPlayerEntity()->player.k.pos;
+    }
+}
+
+void SetGameplayInterpolation(float alpha)
+{
+    interpolation = alpha;
+}
+
+void SnapGameplayCamera(void)
+{
+    camera.target = GetPlayerEntity()->player.k.pos;
 }
 
 // Gameplay Screen Draw logic
 void DrawGameplayScreen(void)
 {
+    // follow where the player is drawn, not where the last tick left it
+    Vector2 playerDrawPos = Vector2Lerp(GetPlayerEntity()->player.prevPos, GetPlayerEntity()->player.k.pos, interpolation);
+    camera.target = Vector2Lerp(camera.target, playerDrawPos, GetFrameTime() * 5.0f);
+    Rectangle view = GetCameraView();
+
+    // ground and obstacles come from tiles baked ahead of time, only rebaked when the editor
+    // changes them. Baking switches render targets so it has to happen outside BeginMode2D
+    bool staticBaked = UpdateStaticLayer(view, DrawStaticEntity);
+
     // background color not moved by camera
     Color bg = ColorLerp((Color){17, 17, 17, 255}, (Color){205, 50, 75, 255}, 1.0f - GetPlayerEntity()->player.health);
     DrawRectangle(0, 0, GetScreenWidth(), GetScreenHeight(), bg);
 
     BeginMode2D(camera);
+    entitiesDrawn = 0;
+    int drawTypes = GRID_TYPE_MASK(Fire);
+    if (staticBaked)
+        DrawStaticLayer(view);
+    else
+        drawTypes |= STATIC_LAYER_TYPES;
+
+    // only what's in view gets drawn, the grid finds it without looking at the rest of the
+    // level
+    QuerySpatialGridRect(GetEntityGrid(), view, drawTypes, &visibleStatics);
+    if (visibleStatics.len > 1)
+        qsort(visibleStatics.items, (size_t)visibleStatics.len, sizeof(GridItem), CompareDrawOrder);
+    for (int i = 0; i < visibleStatics.len; i++)
+    {
+        if (CheckCollisionRecs(visibleStatics.items[i].rect, view))
+        {
+            DrawEntity(*GetEntity(visibleStatics.items[i].id));
+            entitiesDrawn += 1;
+        }
+    }
 
-    // draw entities
-    for (int i = 0; i < entitiesLen; i++)
+    // Help text is filed under where it starts, so look far enough up and left for one that
+    // starts off screen and runs onto it. It's the top layer, drawing it after keeps the order
+    Rectangle helpArea = {view.x - HELP_TEXT_REACH, view.y - HELP_TEXT_REACH, view.width + HELP_TEXT_REACH, view.height + HELP_TEXT_REACH};
+    QuerySpatialGridRect(GetEntityGrid(), helpArea, GRID_TYPE_MASK(HelpText), &visibleHelpTexts);
+    if (visibleHelpTexts.len > 1)
+        qsort(visibleHelpTexts.items, (size_t)visibleHelpTexts.len, sizeof(GridItem), CompareDrawOrder);
+    for (int i = 0; i < visibleHelpTexts.len; i++)
     {
-        // other stuff on top
-        if (entities[i].type == Player)
-            continue;
-        if (entities[i].type == Extinguisher)
-            continue;
-        DrawEntity(entities[i]);
+        const Entity *e = GetEntity(visibleHelpTexts.items[i].id);
+        if (IsHelpTextVisible(&e->help, view))
+        {
+            DrawEntity(*e);
+            entitiesDrawn += 1;
+        }
     }
-    for (int i = 0; i < entitiesLen; i++)
+
+    // extinguishers and the player on top. The body tree only has the bodies, the sprite is bigger
+    float spriteReach = (float)max(textures[EXTINGUISHER_TEXTURE].width, textures[EXTINGUISHER_TEXTURE].height) * 0.35f * 0.5f;
+    visibleExtinguishersLen = 0;
+    QueryAABBTree(GetBodyTree(), (AABB){{view.x - spriteReach, view.y - spriteReach}, {view.x + view.width + spriteReach, view.y + view.height + spriteReach}}, AddVisibleExtinguisher, NULL);
+    if (visibleExtinguishersLen > 1)
+        qsort(visibleExtinguishers, (size_t)visibleExtinguishersLen, sizeof(ID), CompareEntityOrder);
+    for (int i = 0; i < visibleExtinguishersLen; i++)
     {
-        if (entities[i].type != Extinguisher)
-            continue;
-        DrawEntity(entities[i]);
+        DrawEntity(*GetEntity(visibleExtinguishers[i]));
     }
+    entitiesDrawn += visibleExtinguishersLen;
 
     DrawEntity(*GetPlayerEntity());
+    entitiesDrawn += 1;
 
-    // particles
-    for (int i = 0; i < MAX_PARTICLES; i++)
-    {
-        if (particles[i].lifetime <= 0.0)
-            continue;
-        Color toDraw = particles[i].color;
-        toDraw.a = (unsigned char)((particles[i].lifetime / particles[i].max_lifetime) * 255);
-        DrawCircleV(particles[i].pos, PARTICLE_RADIUS, toDraw);
-    }
+    // particles, in one instanced draw or as sprites
+    DrawParticles(GetParticles(), view);
 
+    // everything above is quads in a few runs, one draw call each
+    FlushSpriteBatch();
     EndMode2D();
 
+    if (recording)
+        DrawText("REC", GetScreenWidth() - 60, 10, 20, RED);
+    else if (playingBack)
+        DrawText("REPLAY", GetScreenWidth() - 100, 10, 20, RED);
+
     if (editing)
     {
         DrawText("Editing Mode\nScroll to change target\nClick to place\nRight click to delete\nMiddle click to teleport\nIt saves in browser storage or something idk I made the levels with a desktop build", 0, 0, 16, RED);
         DrawText(TypeNames[currentType], 200, 0, 16, RED);
+        EntityStoreUsage usage = GetEntityStoreUsage();
+        DrawText(TextFormat("%i entities, room for %i before growing (max %i)", usage.count, usage.capacity - usage.count, usage.maxEntities), 200, 20, 16, RED);
+        DrawText(TextFormat("%i in view", entitiesDrawn), 200, 40, 16, RED);
     }
 }
 
@@ -837,6 +659,21 @@ void DrawGameplayScreen(void)
 void UnloadGameplayScreen(void)
 {
     // TODO: Unload GAMEPLAY screen variables here!
+    StopReplay();
+    UnloadReplay(&replay);
+    UnloadSimulation();
+    UnloadTexture(textures[EXTINGUISHER_TEXTURE]);
+    textures[EXTINGUISHER_TEXTURE] = (Texture){ 0 };
+    UnloadSpriteBatch();
+    UnloadParticleRenderer();
+    UnloadStaticLayer();
+    UnloadGridQuery(&visibleStatics);
+    UnloadGridQuery(&visibleHelpTexts);
+    RL_FREE(visibleExtinguishers);
+    visibleExtinguishers = NULL;
+    visibleExtinguishersLen = 0;
+    visibleExtinguishersCapacity = 0;
+    lastDeaths = 0;
 }
 
 // Gameplay Screen should finish?
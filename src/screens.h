@@ -73,8 +73,12 @@ int FinishOptionsScreen(void);
 //----------------------------------------------------------------------------------
 // Gameplay Screen Functions Declaration
 //----------------------------------------------------------------------------------
+void PreloadGameplayScreen(void);               // starts loading its assets, InitGameplayScreen waits for what's left
 void InitGameplayScreen(void);
 void UpdateGameplayScreen(void);
+void FixedUpdateGameplayScreen(float delta);    // one simulation tick
+void SetGameplayInterpolation(float alpha);     // where between the last two ticks to draw
+void SnapGameplayCamera(void);                  // onto the player now instead of easing there
 void DrawGameplayScreen(void);
 void UnloadGameplayScreen(void);
 int FinishGameplayScreen(void);
@@ -0,0 +1,947 @@
+/**********************************************************************************************
+*
+*   Simulation core: player, extinguishers, fire and particles, stepped at a fixed rate
+*
+*   Copyright (c) 2022 creikey
+*
+**********************************************************************************************/
+
+#include "simulation.h"
+#include "raymath.h"
+#include "spatial_grid.h"
+#include "occupancy_map.h"
+#include "aabb_tree.h"
+#include "level_file.h"
+#include "level_snapshot.h"
+#include "level_journal.h"
+#include "level_stream.h"
+#include "worker_thread.h"
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define WAKE_REGIONS 2  // regions either side of the player's where fires and extinguishers are stepped
+#define PARTICLES_PER_JOB 1024  // fewer than this many live particles are updated on the calling thread
+#define MAX_PARTICLE_JOBS 64
+
+const float player_radius = BODY_RADIUS;
+const float player_grab_radius = 50.0;
+
+//----------------------------------------------------------------------------------
+// Types and Structures Definition
+//----------------------------------------------------------------------------------
+// retardant particles that hit one fire in a step
+typedef struct FireHits
+{
+    ID fire;
+    int count;
+} FireHits;
+
+// a range of the live particles, updated on whichever thread takes it. Fires are only read,
+// the hits are applied after every job is done
+typedef struct ParticleJob
+{
+    int first;
+    int last;
+    GridQuery query;
+    FireHits *hits;
+    int hitsLen;
+    int hitsCapacity;
+} ParticleJob;
+
+typedef struct ParticleStep
+{
+    const SpatialGrid *grid;
+    const OccupancyMap *occupancy;  // NULL when it couldn't be built
+    float delta;
+} ParticleStep;
+
+//----------------------------------------------------------------------------------
+// Module Variables Definition (local)
+//----------------------------------------------------------------------------------
+static SimInput input = { 0 };  // for the step being run
+static SimStats stats = { 0 };
+static Vector2 spawnPoint = { 0 };
+static char levelPath[SIM_MAX_LEVEL_PATH] = { 0 };    // empty for the default level
+static LevelImage level = { 0 };    // levelPath kept mapped for reloading it without a read
+static LevelSnapshot snapshot = { 0 };  // what moves or burns, as loaded. Respawning restores it
+static LevelJournal journal = { 0 };    // editor saves appended to levelPath
+static bool levelEdited = false;    // the editor ran since the level was loaded, so it has to be reloaded whole
+static LevelStream stream = { 0 };  // the static geometry around the player, when level has regions
+static float sprayTimer = 0.0f;
+static unsigned int randomState = 0x2545f491; // xorshift32, never 0
+
+static ParticleArrays particles = { 0 };
+static int particleCapacity = DEFAULT_PARTICLE_CAPACITY;
+static ParticleEviction particleEviction = EVICT_MOST_FADED;   // fresh retardant outlasts old smoke
+static ParticleJob particleJobs[MAX_PARTICLE_JOBS] = { 0 };
+static int particleThreads = -1;    // for the job pool, -1 for one per core besides the caller
+static bool particlePoolStarted = false;
+static OccupancyMap occupancy = { 0 };  // what particles hit, rebuilt when the level changes
+
+// scratch results for the collision queries, reused so they don't allocate per query
+static GridQuery gridQuery = { 0 };
+
+// the player and the fires and extinguishers near it, in entity order. Everything else sleeps
+static ID *awake = NULL;
+static int awakeLen = 0;
+static int awakeCapacity = 0;
+static int awakeX = 0;      // region the player was in when it was found
+static int awakeY = 0;
+static unsigned int awakeVersion = 0;   // of the entity store when it was found
+static bool awakeFound = false;
+
+//----------------------------------------------------------------------------------
+// Module Functions Definition
+//----------------------------------------------------------------------------------
+static void SpawnParticle(Particle p)
+{
+    if ((particles.capacity == 0) && !LoadParticleArrays(&particles, particleCapacity, particleEviction))
+    {
+        return;
+    }
+    if (AddParticle(&particles, p))
+    {
+        if (stats.particlesEvicted == 0)
+        {
+            TraceLog(LOG_WARNING, "SIM: All %i particles in use, replacing live ones", particles.capacity);
+        }
+        stats.particlesEvicted += 1;
+    }
+}
+
+static void AddFireHit(ParticleJob *job, ID fire)
+{
+    // a burst tends to land on one fire, so runs of it are common
+    if ((job->hitsLen > 0) && IDEquals(job->hits[job->hitsLen - 1].fire, fire))
+    {
+        job->hits[job->hitsLen - 1].count += 1;
+        return;
+    }
+    if (job->hitsLen == job->hitsCapacity)
+    {
+        int newCapacity = (job->hitsCapacity < 16) ? 16 : job->hitsCapacity*2;
+        FireHits *newHits = RL_REALLOC(job->hits, (size_t)newCapacity*sizeof(FireHits));
+        if (newHits == NULL)
+        {
+            TraceLog(LOG_ERROR, "SIM: Failed to grow the fire hits to %i", newCapacity);
+            return;
+        }
+        job->hits = newHits;
+        job->hitsCapacity = newCapacity;
+    }
+    job->hits[job->hitsLen++] = (FireHits){ .fire = fire, .count = 1 };
+}
+
+static void HitFire(ParticleJob *job, int i, ID fire, float delta)
+{
+    particles.velX[i] = 0.0f;
+    particles.velY[i] = 0.0f;
+    particles.lifetime[i] *= powf(0.5f, delta * REFERENCE_FPS); // halved every reference frame
+    AddFireHit(job, fire);
+}
+
+// what the job's particles hit, one at a time, then they all move at once. Most of them are
+// answered by the occupancy map, only the ones near an edge test rects from the grid
+static void UpdateParticleJob(void *context, int index)
+{
+    const ParticleStep *step = (const ParticleStep *)context;
+    ParticleJob *job = &particleJobs[index];
+    for (int i = job->first; i < job->last; i++)
+    {
+        Vector2 pos = { particles.posX[i], particles.posY[i] };
+        int cell = (step->occupancy != NULL) ? GetOccupancy(step->occupancy, pos) : OCCUPANCY_MIXED;
+        if (cell == OCCUPANCY_EMPTY)
+        {
+            continue;
+        }
+        if (cell == OCCUPANCY_SOLID)
+        {
+            particles.velX[i] = 0.0f;
+            particles.velY[i] = 0.0f;
+            continue;
+        }
+        if (cell > 0)
+        {
+            if (particles.type[i] == RetardantParticle)
+            {
+                HitFire(job, i, step->occupancy->fires[cell - 1], step->delta);
+            }
+            continue;
+        }
+
+        QuerySpatialGridPoint(step->grid, pos, GRID_TYPE_MASK(Obstacle) | GRID_TYPE_MASK(Fire), &job->query);
+        bool hitObstacle = false;
+        for (int ii = 0; ii < job->query.len; ii++)
+        {
+            if (job->query.items[ii].type == Obstacle && RectHasPoint(job->query.items[ii].rect, pos))
+            {
+                particles.velX[i] = 0.0f;
+                particles.velY[i] = 0.0f;
+                hitObstacle = true;
+                break;
+            }
+        }
+        for (int ii = 0; !hitObstacle && particles.type[i] == RetardantParticle && ii < job->query.len; ii++)
+        {
+            if (job->query.items[ii].type == Fire && RectHasPoint(job->query.items[ii].rect, pos))
+            {
+                HitFire(job, i, job->query.items[ii].id, step->delta);
+            }
+        }
+    }
+    IntegrateParticles(&particles, job->first, job->last, step->delta);
+}
+
+// The player back at the spawn point after the level was (re)made, with nothing to
+// interpolate from after the teleport
+static void PlaceAtSpawnPoint(bool setSpawnPoint)
+{
+    if (setSpawnPoint)
+    {
+        spawnPoint = GetPlayerEntity()->player.k.pos;
+    }
+
+    GetPlayerEntity()->player.k.pos = spawnPoint;
+    GetPlayerEntity()->player.prevPos = spawnPoint;
+    for (int i = 0; i < entitiesLen; i++)
+    {
+        if (entities[i].type == Extinguisher)
+        {
+            entities[i].extinguisher.prevPos = entities[i].extinguisher.info.pos;
+        }
+    }
+    awakeFound = false;
+    UpdateLevelStream(&stream, spawnPoint);
+}
+
+// Entities for the open level and journal. A level with regions and nothing journaled on
+// top only gets the static geometry near the player, the rest streams in as it moves
+static bool BuildLevel(void)
+{
+    EndLevelStream(&stream);
+    if (!LevelJournalHasEdits(&journal) && (level.regions != NULL))
+    {
+        return LoadLevelImageWithoutRegions(&level) && BeginLevelStream(&stream, &level);
+    }
+    return LoadLevelImage(&level) && ApplyLevelJournal(&journal);
+}
+
+void StopLevelStreaming(void)
+{
+    if (IsLevelStreaming(&stream))
+    {
+        FinishLevelStream(&stream);
+        ApplyLevelJournal(&journal);    // nothing to replay, but the keys need everything there
+    }
+}
+
+bool SaveEntities(const char *path)
+{
+    StopLevelStreaming();
+    unsigned int size = 0;
+    unsigned char *data = ExportLevel(&size);
+    bool saved = false;
+    if (data != NULL)
+    {
+        // writing over a mapped file truncates it under the mapping
+        if (strcmp(path, levelPath) == 0)
+        {
+            CloseLevelImage(&level);
+            CloseLevelJournal(&journal);
+        }
+        saved = SaveFileData(path, data, size);
+        if (saved)
+        {
+            RemoveLevelJournal(path);   // it's all in the level now
+        }
+        RL_FREE(data);
+    }
+    return saved;
+}
+
+static void NoteSnapshotChange(ID id, void *context)
+{
+    (void)context;
+    NoteLevelJournalEdit(&journal, id);
+}
+
+void NoteLevelEdit(ID id)
+{
+    NoteLevelJournalEdit(&journal, id);
+}
+
+void SaveLevelEdits(const char *path)
+{
+    StopLevelStreaming();
+    // the journal is compacted into the level once it's as big as the level itself
+    if (journal.open && (strcmp(path, levelPath) == 0) && ((unsigned int)journal.dataLen < level.file.size))
+    {
+        // the editor notes what it does, but fires and extinguishers also change by playing
+        FindSnapshotChanges(&snapshot, NoteSnapshotChange, NULL);
+        if (SaveLevelJournal(&journal) >= 0)
+        {
+            CaptureLevelSnapshot(&snapshot);
+            levelEdited = false;
+            return;
+        }
+    }
+    SaveEntities(path);
+    LoadEntities(path, false);
+}
+bool LoadEntities(const char *path, bool setSpawnPoint)
+{
+    LevelImage image = { 0 };
+    if (!OpenLevelImage(path, &image))
+    {
+        TraceLog(LOG_WARNING, "LEVEL: [%s] Failed to load, using the default level", path);
+        LoadDefaultLevel();
+        return false;
+    }
+    return LoadOpenedLevel(path, &image, setSpawnPoint);
+}
+
+bool LoadOpenedLevel(const char *path, LevelImage *image, bool setSpawnPoint)
+{
+    EndLevelStream(&stream);
+    CloseLevelImage(&level);
+    level = *image;
+    *image = (LevelImage){ 0 };
+    levelEdited = false;
+    if (path != levelPath)
+    {
+        int len = (int)strlen(path);
+        len = (len < SIM_MAX_LEVEL_PATH - 1) ? len : SIM_MAX_LEVEL_PATH - 1;
+        memcpy(levelPath, path, len);
+        levelPath[len] = '\0';
+    }
+    OpenLevelJournal(&journal, levelPath, level.checksum);
+    if (!BuildLevel())
+    {
+        TraceLog(LOG_WARNING, "LEVEL: [%s] Failed to load, using the default level", path);
+        LoadDefaultLevel();
+        return false;
+    }
+    CaptureLevelSnapshot(&snapshot);
+
+    PlaceAtSpawnPoint(setSpawnPoint);
+
+    // delete stuff that's flying away
+    // for(int i = 0; i < entitiesLen; i++) {
+    //     if(entities[i].type == Extinguisher && fabs(entities[i].extinguisher.info.pos.x) > 20000.0) {
+    //         DeleteEntityIndex(i);
+    //         break;
+    //     }
+    // }
+    // for debugging stuff, also put any programmatic level modifications here
+    // for (int i = 0; i < entitiesLen; i++)
+    // {
+    //     printf("%s %d\n", TypeNames[entities[i].type], entities[i].id);
+    // }
+    return true;
+}
+
+void LoadDefaultLevel(void)
+{
+    ClearEntities();
+    AddEntity((Entity){
+        .type = Player,
+        .player = {
+            .k = {
+                .pos = (Vector2){200, 300},
+                .vel = (Vector2){0},
+            },
+            .grabbedEntity = NULL_ID,
+            .prevPos = (Vector2){200, 300},
+        },
+    });
+    AddEntity((Entity){
+        .type = Obstacle,
+        .obstacle = {
+            .x = 100,
+            .y = 400,
+            .width = 100,
+            .height = 200,
+        },
+    });
+    spawnPoint = GetPlayerEntity()->player.k.pos;
+    EndLevelStream(&stream);
+    CloseLevelImage(&level);
+    CloseLevelJournal(&journal);
+    levelPath[0] = '\0';
+    levelEdited = false;
+    awakeFound = false;
+}
+
+// Unless the level was edited only what moves or burns can have changed since it loaded, so
+// that's all that gets put back. An edited level is rebuilt from the mapped file instead
+void ResetLevel(void)
+{
+    if (levelPath[0] == '\0')
+    {
+        LoadDefaultLevel();
+        return;
+    }
+    if (!levelEdited && (RestoreLevelSnapshot(&snapshot) >= 0))
+    {
+        PlaceAtSpawnPoint(false);
+    }
+    else if (BuildLevel())
+    {
+        levelEdited = false;
+        CaptureLevelSnapshot(&snapshot);
+        PlaceAtSpawnPoint(false);
+    }
+    else
+    {
+        LoadEntities(levelPath, false);
+    }
+}
+
+// Everything random in the simulation comes from here, so a seed and the inputs are
+// enough to play a session out again exactly
+static unsigned int NextRandom(void)
+{
+    randomState ^= randomState << 13;
+    randomState ^= randomState >> 17;
+    randomState ^= randomState << 5;
+    return randomState;
+}
+
+void SetSimulationSeed(unsigned int seed)
+{
+    randomState = (seed == 0) ? 0x2545f491 : seed;
+}
+
+int SimRandomValue(int min, int max)
+{
+    return min + (int)(NextRandom() % (unsigned int)(max - min + 1));
+}
+
+float RandFloat(float min, float max)
+{
+    return ((max - min) * ((float)(NextRandom() >> 8) / 16777216.0f)) + min;
+}
+
+float clamp(float value, float min, float max)
+{
+    if (value < min)
+    {
+        return min;
+    }
+    if (value > max)
+    {
+        return max;
+    }
+    return value;
+}
+
+bool RectHasPoint(Rectangle rect, Vector2 point)
+{
+    return (point.x >= rect.x) && (point.x <= (rect.x + rect.width)) && (point.y >= rect.y) && (point.y <= (rect.y + rect.height));
+}
+
+static KinematicInfo GlideAndBounce(KinematicInfo k, float bounceFactor)
+{
+    k.onGround = false;
+    QuerySpatialGridCircle(GetEntityGrid(), k.pos, player_radius, GRID_TYPE_MASK(Obstacle) | GRID_TYPE_MASK(Ground), &gridQuery);
+    for (int i = 0; i < gridQuery.len; i++)
+    {
+        if (gridQuery.items[i].type == Ground)
+        {
+            if (RectHasPoint(gridQuery.items[i].rect, k.pos))
+            {
+                k.onGround = true;
+            }
+            continue;
+        }
+        Rectangle obstacle = gridQuery.items[i].rect;
+        Vector2 normal = {0};
+        bool bounced = false;
+        {
+            Vector2 obstacleCenter = {.x = obstacle.x + obstacle.width / 2.0f, .y = obstacle.y + obstacle.height / 2.0f};
+            Vector2 fromObstacleCenter = Vector2Subtract(k.pos, obstacleCenter);
+            fromObstacleCenter.x = clamp(fromObstacleCenter.x, -obstacle.width / 2.0f, obstacle.width / 2.0f);
+            fromObstacleCenter.y = clamp(fromObstacleCenter.y, -obstacle.height / 2.0f, obstacle.height / 2.0f);
+            Vector2 closestPointOnObstacle = Vector2Add(fromObstacleCenter, obstacleCenter);
+            if (Vector2Distance(closestPointOnObstacle, k.pos) < player_radius)
+            {
+                bounced = true;
+                normal = Vector2Normalize(Vector2Subtract(k.pos, closestPointOnObstacle));
+                k.pos = Vector2Add(closestPointOnObstacle, Vector2Scale(normal, player_radius));
+            }
+        }
+        if (bounced)
+            k.vel = Vector2Scale(Vector2Reflect(k.vel, normal), bounceFactor);
+    }
+    return k;
+}
+
+// closest extinguisher in reach, filled in by ConsiderGrab
+typedef struct GrabSearch
+{
+    Vector2 from;
+    ID closest;
+    float closestDistance;
+} GrabSearch;
+
+static bool ConsiderGrab(int proxy, void *context)
+{
+    GrabSearch *search = (GrabSearch *)context;
+    Entity *e = GetEntity(GetAABBProxyID(GetBodyTree(), proxy));
+    float distance = Vector2Distance(search->from, e->extinguisher.info.pos);
+    if (distance < search->closestDistance)
+    {
+        search->closest = e->id;
+        search->closestDistance = distance;
+    }
+    return true;
+}
+
+// extinguishers bounce off each other like they do off obstacles. The held one doesn't
+// budge, it's stuck to the player
+static void CollideExtinguishers(int proxyA, int proxyB, void *context)
+{
+    (void)context;
+    Entity *a = GetEntity(GetAABBProxyID(GetBodyTree(), proxyA));
+    Entity *b = GetEntity(GetAABBProxyID(GetBodyTree(), proxyB));
+    ID held = GetPlayerEntity()->player.grabbedEntity;
+    float invMassA = IDEquals(a->id, held) ? 0.0f : 1.0f;
+    float invMassB = IDEquals(b->id, held) ? 0.0f : 1.0f;
+    if (invMassA + invMassB == 0.0f)
+    {
+        return;
+    }
+
+    KinematicInfo *ka = &a->extinguisher.info;
+    KinematicInfo *kb = &b->extinguisher.info;
+    Vector2 delta = Vector2Subtract(kb->pos, ka->pos);
+    float distance = Vector2Length(delta);
+    if (distance >= player_radius * 2.0f || distance == 0.0f)
+    {
+        return;
+    }
+    Vector2 normal = Vector2Scale(delta, 1.0f / distance);
+    float push = (player_radius * 2.0f - distance) / (invMassA + invMassB);
+    ka->pos = Vector2Subtract(ka->pos, Vector2Scale(normal, push * invMassA));
+    kb->pos = Vector2Add(kb->pos, Vector2Scale(normal, push * invMassB));
+
+    float approach = Vector2DotProduct(Vector2Subtract(kb->vel, ka->vel), normal);
+    if (approach < 0.0f)
+    {
+        float impulse = -1.5f * approach / (invMassA + invMassB); // same 0.5 bounce as off obstacles
+        ka->vel = Vector2Subtract(ka->vel, Vector2Scale(normal, impulse * invMassA));
+        kb->vel = Vector2Add(kb->vel, Vector2Scale(normal, impulse * invMassB));
+    }
+}
+
+static void AddAwake(ID id)
+{
+    if (awakeLen == awakeCapacity)
+    {
+        int newCapacity = (awakeCapacity < 64) ? 64 : awakeCapacity*2;
+        ID *newAwake = RL_REALLOC(awake, (size_t)newCapacity*sizeof(ID));
+        if (newAwake == NULL)
+        {
+            TraceLog(LOG_ERROR, "SIM: Failed to grow the awake list to %i", newCapacity);
+            return;
+        }
+        awake = newAwake;
+        awakeCapacity = newCapacity;
+    }
+    awake[awakeLen++] = id;
+}
+
+static bool WakeExtinguisher(int proxy, void *context)
+{
+    (void)context;
+    AddAwake(GetAABBProxyID(GetBodyTree(), proxy));
+    return true;
+}
+
+static int CompareEntityOrder(const void *a, const void *b)
+{
+    return GetEntityIndex(*(const ID *)a) - GetEntityIndex(*(const ID *)b);
+}
+
+// Fires and extinguishers more than WAKE_REGIONS regions from the player's sleep, they aren't
+// stepped until it comes back, so a step costs what's near the player however big the level
+// is. The list is only found again when the player changes region or entities come or go.
+// While editing everything is awake, the editor can put things anywhere
+static void FindAwakeEntities(void)
+{
+    Entity *player = GetPlayerEntity();
+    int x = LevelRegionCoord(player->player.k.pos.x, LEVEL_REGION_SIZE);
+    int y = LevelRegionCoord(player->player.k.pos.y, LEVEL_REGION_SIZE);
+    if (!input.editing && awakeFound && (x == awakeX) && (y == awakeY) && (awakeVersion == GetEntityStoreVersion()))
+    {
+        return;
+    }
+
+    // what falls asleep stays where it is, with nothing to interpolate from
+    for (int i = 0; i < awakeLen; i++)
+    {
+        Entity *e = GetEntity(awake[i]);
+        if ((e != NULL) && (e->type == Extinguisher))
+        {
+            e->extinguisher.prevPos = e->extinguisher.info.pos;
+        }
+    }
+
+    awakeLen = 0;
+    awakeFound = !input.editing;
+    if (input.editing)
+    {
+        for (int i = 0; i < entitiesLen; i++)
+        {
+            if ((entities[i].type == Player) || (entities[i].type == Fire) || (entities[i].type == Extinguisher))
+            {
+                AddAwake(entities[i].id);
+            }
+        }
+        return;
+    }
+
+    float side = (float)(2*WAKE_REGIONS + 1)*LEVEL_REGION_SIZE;
+    Rectangle area = { (float)(x - WAKE_REGIONS)*LEVEL_REGION_SIZE, (float)(y - WAKE_REGIONS)*LEVEL_REGION_SIZE, side, side };
+    AddAwake(player->id);
+    QuerySpatialGridRect(GetEntityGrid(), area, GRID_TYPE_MASK(Fire), &gridQuery);
+    for (int i = 0; i < gridQuery.len; i++)
+    {
+        AddAwake(gridQuery.items[i].id);
+    }
+    QueryAABBTree(GetBodyTree(), (AABB){ { area.x, area.y }, { area.x + side, area.y + side } }, WakeExtinguisher, NULL);
+    // stepped in the same order as when everything was
+    qsort(awake, (size_t)awakeLen, sizeof(ID), CompareEntityOrder);
+    awakeX = x;
+    awakeY = y;
+    awakeVersion = GetEntityStoreVersion();
+}
+
+static void ProcessEntity(Entity *e, float delta)
+{
+    switch (e->type)
+    {
+    case Player:
+    {
+        Vector2 movement = input.movement;
+        bool onGroundBefore = e->player.k.onGround;
+        e->player.k = GlideAndBounce(e->player.k, 1.0f);
+        if (!onGroundBefore && e->player.k.onGround)
+        {
+            spawnPoint = e->player.k.pos;
+        }
+        if (e->player.k.onGround)
+            e->player.k.vel = Vector2Lerp(e->player.k.vel, Vector2Scale(movement, 400.0f), delta * 9.0f);
+        e->player.k.pos = Vector2Add(e->player.k.pos, Vector2Scale(e->player.k.vel, delta));
+
+        bool inFire = false;
+        float fireLeft = 0.0f;
+        QuerySpatialGridPoint(GetEntityGrid(), e->player.k.pos, GRID_TYPE_MASK(Fire), &gridQuery);
+        for (int i = 0; i < gridQuery.len; i++)
+        {
+            if (RectHasPoint(gridQuery.items[i].rect, e->player.k.pos))
+            {
+                inFire = true;
+                fireLeft = GetEntity(gridQuery.items[i].id)->fire.fireLeft;
+                break;
+            }
+        }
+
+        if (inFire)
+        {
+            e->player.health -= Lerp(delta / 0.5f, delta / 2.5f, 1.0f - fireLeft);
+        }
+        else if (!e->player.k.onGround)
+        {
+            e->player.health -= delta / 3.0f;
+        }
+        else
+        {
+            e->player.health += delta / 0.5f;
+        }
+
+        e->player.health = clamp(e->player.health, 0.0f, 1.0f);
+
+        Entity *grabbed = GetEntity(e->player.grabbedEntity);
+        if (grabbed == NULL)
+        {
+            // also covers the grabbed extinguisher being deleted out from under us
+            e->player.grabbedEntity = NULL_ID;
+            if (input.grabPressed)
+            {
+                GrabSearch search = { .from = e->player.k.pos, .closest = NULL_ID, .closestDistance = player_grab_radius };
+                QueryAABBTree(GetBodyTree(), AABBFromCircle(e->player.k.pos, player_grab_radius), ConsiderGrab, &search);
+                e->player.grabbedEntity = search.closest;
+            }
+        }
+        else
+        {
+            grabbed->extinguisher.info.pos = e->player.k.pos;
+            if (input.grabPressed)
+            {
+                Vector2 extraVelocity = Vector2Scale(Vector2Normalize(Vector2Subtract(input.aim, e->player.k.pos)), 250.0);
+                grabbed->extinguisher.info.vel = Vector2Add(e->player.k.vel, extraVelocity);
+                e->player.k.vel = Vector2Add(e->player.k.vel, Vector2Scale(extraVelocity, -2.0));
+                e->player.grabbedEntity = NULL_ID;
+            }
+        }
+
+        break;
+    }
+    case Extinguisher:
+    {
+        // detect flying fire extinguishers
+        // if (fabs(e->extinguisher.info.vel.x) > 10.0)
+        // {
+        //     printf("%f %f\n", e->extinguisher.info.pos.x, e->extinguisher.info.pos.y);
+        // }
+        if (!IDEquals(GetPlayerEntity()->player.grabbedEntity, e->id))
+        {
+            e->extinguisher.info = GlideAndBounce(e->extinguisher.info, 0.5f);
+            if (e->extinguisher.info.onGround)
+                e->extinguisher.info.vel = Vector2Lerp(e->extinguisher.info.vel, (Vector2){0}, delta * 4.0f);
+            e->extinguisher.info.pos = Vector2Add(e->extinguisher.info.pos, Vector2Scale(e->extinguisher.info.vel, delta));
+            break;
+        }
+        else
+        {
+            if (input.sprayDown)
+            {
+                if (e->extinguisher.amountUsed >= 0.99f)
+                {
+                    break;
+                }
+                Vector2 toMouse = Vector2Subtract(input.aim, e->extinguisher.info.pos);
+                Vector2 solidVelocity = Vector2Scale(Vector2Normalize(toMouse), 200.0f);
+                e->extinguisher.amountUsed += delta / 2.0f;
+                e->extinguisher.amountUsed = clamp(e->extinguisher.amountUsed, 0.0f, 1.0f);
+                GetPlayerEntity()->player.k.vel = Vector2Add(GetPlayerEntity()->player.k.vel, Vector2Scale(toMouse, -delta * 3.0f));
+                // same stream density as one particle per frame at REFERENCE_FPS
+                for (sprayTimer += delta; sprayTimer >= 1.0f / REFERENCE_FPS; sprayTimer -= 1.0f / REFERENCE_FPS)
+                {
+                    SpawnParticle((Particle){
+                        .pos = e->extinguisher.info.pos,
+                        .vel = Vector2Rotate(solidVelocity, (float)SimRandomValue(-50, 50) / 100.0f),
+                        .color = (Color){255, 255, 255, 255},
+                        .lifetime = 3.0,
+                        .max_lifetime = 3.0,
+                        .type = RetardantParticle,
+                    });
+                }
+            }
+        }
+        break;
+    }
+    case Fire:
+    {
+        e->fire.fireParticleTimer += delta;
+        e->fire.fireLeft = clamp(e->fire.fireLeft, 0.0, 1.0);
+        // don't generate particles if offscreen
+        if (Vector2Distance((Vector2){.x = e->fire.rect.x, .y = e->fire.rect.y}, GetPlayerEntity()->player.k.pos) < 2000.0)
+        {
+            if (e->fire.fireParticleTimer > Lerp(0.05f, 0.5f, 1.0f - e->fire.fireLeft))
+            {
+                SpawnParticle((Particle){
+                    .pos = (Vector2){
+                        .x = RandFloat(e->fire.rect.x, e->fire.rect.x + e->fire.rect.width),
+                        .y = RandFloat(e->fire.rect.y, e->fire.rect.y + e->fire.rect.height),
+                    },
+                    .vel = Vector2Rotate((Vector2){.x = 20.0, .y = 0.0}, RandFloat(-2.0 * PI, 2.0 * PI)),
+                    .color = (Color){255, 0, 0, 255},
+                    .lifetime = 4.0,
+                    .max_lifetime = 10.0,
+                    .type = FireParticle,
+                });
+                e->fire.fireParticleTimer = 0.0;
+            }
+        }
+        break;
+    }
+    default:
+        break;
+    }
+}
+
+void UpdateSimulationEntities(const SimInput *tickInput, float delta)
+{
+    input = *tickInput;
+    stats.ticks += 1;
+    levelEdited |= input.editing;
+
+    // the editor works on the whole level, playing only needs what's around the player
+    if (input.editing)
+    {
+        StopLevelStreaming();
+    }
+    UpdateLevelStream(&stream, GetPlayerEntity()->player.k.pos);
+    FindAwakeEntities();
+
+    for (int i = 0; i < awakeLen; i++)
+    {
+        Entity *e = GetEntity(awake[i]);
+        if (e->type == Player)
+        {
+            e->player.prevPos = e->player.k.pos;
+        }
+        else if (e->type == Extinguisher)
+        {
+            e->extinguisher.prevPos = e->extinguisher.info.pos;
+        }
+    }
+
+    for (int i = 0; i < awakeLen; i++)
+    {
+        ProcessEntity(GetEntity(awake[i]), delta);
+    }
+
+    // refit the extinguishers that left their fat boxes, then let overlapping ones bump
+    for (int i = 0; i < awakeLen; i++)
+    {
+        Entity *e = GetEntity(awake[i]);
+        if (e->type == Extinguisher)
+        {
+            UpdateEntityBody(e, Vector2Scale(e->extinguisher.info.vel, delta));
+        }
+    }
+    QueryAABBTreePairs(GetBodyTree(), CollideExtinguishers, NULL);
+
+    // worried about calling load entities from within the entity processing loop
+    // so I put it here
+    if (GetPlayerEntity()->player.health <= 0.0 && !input.editing)
+    {
+        if (levelPath[0] != '\0')
+        {
+            ResetLevel();
+        }
+        else
+        {
+            GetPlayerEntity()->player.k = (KinematicInfo){ .pos = spawnPoint };
+            GetPlayerEntity()->player.prevPos = spawnPoint;
+        }
+        GetPlayerEntity()->player.health = 1.0;
+        stats.deaths += 1;
+    }
+}
+
+void UpdateSimulationParticles(float delta)
+{
+    // whole SIMD registers per job, and no more jobs than there's work for
+    int jobs = (particles.count + PARTICLES_PER_JOB - 1)/PARTICLES_PER_JOB;
+    if (jobs > MAX_PARTICLE_JOBS)
+    {
+        jobs = MAX_PARTICLE_JOBS;
+    }
+    int perJob = (jobs > 0) ? (particles.count + jobs - 1)/jobs : 0;
+    perJob = (perJob + PARTICLE_LANES - 1)/PARTICLE_LANES*PARTICLE_LANES;
+    for (int j = 0; j < jobs; j++)
+    {
+        particleJobs[j].first = (j*perJob < particles.count) ? j*perJob : particles.count;
+        particleJobs[j].last = (particleJobs[j].first + perJob < particles.count) ? particleJobs[j].first + perJob : particles.count;
+        particleJobs[j].hitsLen = 0;
+    }
+    if ((jobs > 1) && !particlePoolStarted)
+    {
+        StartJobPool((particleThreads < 0) ? GetProcessorCount() - 1 : particleThreads);
+        particlePoolStarted = true;
+    }
+    ParticleStep step = { .grid = GetEntityGrid(), .delta = delta };
+    if ((jobs > 0) && UpdateOccupancyMap(&occupancy))
+    {
+        step.occupancy = &occupancy;
+    }
+    RunJobs(UpdateParticleJob, &step, jobs);
+
+    // every hit takes off the same amount and clamps, so going job by job ends up where going
+    // particle by particle did
+    float extinguish = 0.001f * delta * REFERENCE_FPS;
+    for (int j = 0; j < jobs; j++)
+    {
+        for (int h = 0; h < particleJobs[j].hitsLen; h++)
+        {
+            Entity *fire = GetEntity(particleJobs[j].hits[h].fire);
+            for (int n = 0; (fire != NULL) && (n < particleJobs[j].hits[h].count); n++)
+            {
+                fire->fire.fireLeft -= extinguish;
+                fire->fire.fireLeft = clamp(fire->fire.fireLeft, 0.0, 1.0);
+            }
+        }
+    }
+    RemoveDeadParticles(&particles);
+}
+
+void StepSimulation(const SimInput *tickInput, float delta)
+{
+    UpdateSimulationEntities(tickInput, delta);
+    UpdateSimulationParticles(delta);
+}
+
+void SetParticleLimits(int capacity, ParticleEviction eviction)
+{
+    UnloadParticleArrays(&particles);
+    particleCapacity = (capacity > 0) ? capacity : DEFAULT_PARTICLE_CAPACITY;
+    particleEviction = eviction;
+}
+
+void SetParticleThreads(int threads)
+{
+    StopJobPool();
+    particlePoolStarted = false;
+    particleThreads = threads;
+}
+
+const ParticleArrays *GetParticles(void)
+{
+    return &particles;
+}
+
+SimStats GetSimulationStats(void)
+{
+    return stats;
+}
+
+void RestartSimulation(const char *level, unsigned int seed)
+{
+    ClearParticleArrays(&particles);
+    sprayTimer = 0.0f;
+    stats = (SimStats){ 0 };
+    SetSimulationSeed(seed);
+
+    if ((level != NULL) && FileExists(level))
+    {
+        LoadEntities(level, true);
+    }
+    else
+    {
+        LoadDefaultLevel();
+    }
+}
+
+void UnloadSimulation(void)
+{
+    UnloadEntities();
+    UnloadGridQuery(&gridQuery);
+    UnloadParticleArrays(&particles);
+    UnloadOccupancyMap(&occupancy);
+    StopJobPool();
+    particlePoolStarted = false;
+    for (int j = 0; j < MAX_PARTICLE_JOBS; j++)
+    {
+        UnloadGridQuery(&particleJobs[j].query);
+        RL_FREE(particleJobs[j].hits);
+        particleJobs[j] = (ParticleJob){ 0 };
+    }
+    stats = (SimStats){ 0 };
+    EndLevelStream(&stream);
+    CloseLevelImage(&level);
+    CloseLevelJournal(&journal);
+    UnloadLevelSnapshot(&snapshot);
+    RL_FREE(awake);
+    awake = NULL;
+    awakeLen = 0;
+    awakeCapacity = 0;
+    awakeFound = false;
+    levelPath[0] = '\0';
+    levelEdited = false;
+    sprayTimer = 0.0f;
+}
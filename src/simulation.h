@@ -0,0 +1,92 @@
+/**********************************************************************************************
+*
+*   Simulation core: player, extinguishers, fire and particles, stepped at a fixed rate
+*
+*   Nothing in here opens a window, reads devices or draws. The caller says what the player
+*   is doing with a SimInput and how much time a step covers, so the same code runs under
+*   the gameplay screen and headless. From raylib it only uses the types, raymath and the
+*   file/log utilities, which headless_platform.c provides when raylib isn't linked.
+*
+*   Randomness comes from a seeded generator rather than rand(), so the same level, seed and
+*   inputs always play out the same way (see replay.h).
+*
+*   Copyright (c) 2022 creikey
+*
+**********************************************************************************************/
+
+#ifndef SIMULATION_H
+#define SIMULATION_H
+
+#include "raylib.h"
+#include "entities.h"
+#include "level_file.h"
+#include "particle_system.h"
+
+#define SIM_TICK_RATE 120       // steps per simulated second
+#define REFERENCE_FPS 60.0f     // the spray and retardant numbers were tuned per frame at this rate
+
+#define SIM_MAX_LEVEL_PATH LEVEL_MAX_PATH
+
+#define PARTICLE_RADIUS 17.0f
+
+//----------------------------------------------------------------------------------
+// Types and Structures Definition
+//----------------------------------------------------------------------------------
+// What the player is doing during a step
+typedef struct SimInput
+{
+    Vector2 movement;   // normalized
+    Vector2 aim;        // world position thrown and sprayed towards
+    bool grabPressed;   // grab or throw, once
+    bool sprayDown;
+    bool editing;       // editor is open, the player can't die
+} SimInput;
+
+typedef struct SimStats
+{
+    int ticks;          // since the simulation was last unloaded
+    int deaths;
+    int particlesEvicted;   // live ones replaced because there was no room
+} SimStats;
+
+extern const float player_radius;
+extern const float player_grab_radius;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//----------------------------------------------------------------------------------
+// Simulation Functions Declaration
+//----------------------------------------------------------------------------------
+bool LoadEntities(const char *path, bool setSpawnPoint);    // keeps the file mapped and snapshots what can change. False if it fell back to the default level
+bool LoadOpenedLevel(const char *path, LevelImage *image, bool setSpawnPoint);  // LoadEntities after OpenLevelImage, takes the image
+bool SaveEntities(const char *path);                        // the whole level, folding in any journal. False if nothing was written
+void SaveLevelEdits(const char *path);                      // the editor's save, appends the edits to the journal
+void NoteLevelEdit(ID id);                                  // the editor added, changed or is about to delete this
+void LoadDefaultLevel(void);    // a player and a single obstacle, for when there's no level file
+void ResetLevel(void);          // back to how the level loaded, what dying does. From memory, not the disk
+void StopLevelStreaming(void);  // the whole level resident, before the editor touches it. The next load streams again
+void RestartSimulation(const char *level, unsigned int seed);  // fresh load with no particles, the start of a replay
+void StepSimulation(const SimInput *input, float delta);
+void UpdateSimulationEntities(const SimInput *input, float delta);  // the two halves of a step, StepSimulation
+void UpdateSimulationParticles(float delta);                        // runs them in this order
+void UnloadSimulation(void);
+
+void SetParticleLimits(int capacity, ParticleEviction eviction);   // DEFAULT_PARTICLE_CAPACITY and EVICT_MOST_FADED until set. Drops the live ones
+void SetParticleThreads(int threads);  // threads helping with big particle updates besides the caller, -1 (the default) for one per core
+const ParticleArrays *GetParticles(void);   // the live ones, capacity 0 until the first one spawns
+SimStats GetSimulationStats(void);
+
+bool RectHasPoint(Rectangle rect, Vector2 point);  // edges included. Width and height not negative, like every rect in the store
+float clamp(float value, float min, float max);
+
+void SetSimulationSeed(unsigned int seed);
+int SimRandomValue(int min, int max);   // min and max included
+float RandFloat(float min, float max);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // SIMULATION_H
@@ -0,0 +1,205 @@
+/**********************************************************************************************
+*
+*   Uniform hash grid over static entity rectangles
+*
+*   Copyright (c) 2022 creikey
+*
+**********************************************************************************************/
+
+#include "spatial_grid.h"
+#include <math.h>
+#include <stdlib.h>
+
+#define GRID_BUCKETS 4096 // power of two
+#define MIN_ARRAY_CAPACITY 8
+
+//----------------------------------------------------------------------------------
+// Module Functions Definition (local)
+//----------------------------------------------------------------------------------
+static int CellCoord(const SpatialGrid *grid, float v)
+{
+    return (int)floorf(v / grid->cellSize);
+}
+
+static GridBucket *GetBucket(const SpatialGrid *grid, int cellX, int cellY)
+{
+    unsigned int hash = ((unsigned int)cellX * 73856093u) ^ ((unsigned int)cellY * 19349663u);
+    return &grid->buckets[hash & (GRID_BUCKETS - 1)];
+}
+
+static bool Reserve(void **array, int *capacity, int wanted, int elementSize)
+{
+    if (wanted <= *capacity)
+    {
+        return true;
+    }
+    int newCapacity = (*capacity < MIN_ARRAY_CAPACITY) ? MIN_ARRAY_CAPACITY : *capacity * 2;
+    while (newCapacity < wanted)
+    {
+        newCapacity *= 2;
+    }
+    void *newArray = RL_REALLOC(*array, (size_t)newCapacity * elementSize);
+    if (newArray == NULL)
+    {
+        TraceLog(LOG_ERROR, "GRID: Failed to grow array to %i elements", newCapacity);
+        return false;
+    }
+    *array = newArray;
+    *capacity = newCapacity;
+    return true;
+}
+
+static void PushResult(GridQuery *query, GridItem item)
+{
+    if (Reserve((void **)&query->items, &query->capacity, query->len + 1, sizeof(GridItem)))
+    {
+        query->items[query->len++] = item;
+    }
+}
+
+//----------------------------------------------------------------------------------
+// Spatial Grid Functions Definition
+//----------------------------------------------------------------------------------
+void InitSpatialGrid(SpatialGrid *grid, float cellSize)
+{
+    grid->cellSize = cellSize;
+    grid->buckets = RL_CALLOC(GRID_BUCKETS, sizeof(GridBucket));
+    grid->itemsLen = 0;
+}
+
+void UnloadSpatialGrid(SpatialGrid *grid)
+{
+    if (grid->buckets != NULL)
+    {
+        for (int i = 0; i < GRID_BUCKETS; i++)
+        {
+            RL_FREE(grid->buckets[i].entries);
+        }
+        RL_FREE(grid->buckets);
+    }
+    *grid = (SpatialGrid){ 0 };
+}
+
+void ClearSpatialGrid(SpatialGrid *grid)
+{
+    for (int i = 0; i < GRID_BUCKETS; i++)
+    {
+        grid->buckets[i].len = 0;
+    }
+    grid->itemsLen = 0;
+}
+
+void InsertSpatialGrid(SpatialGrid *grid, ID id, enum Type type, Rectangle rect)
+{
+    GridItem item = { .rect = rect, .id = id, .type = type };
+    int minX = CellCoord(grid, rect.x);
+    int minY = CellCoord(grid, rect.y);
+    int maxX = CellCoord(grid, rect.x + rect.width);
+    int maxY = CellCoord(grid, rect.y + rect.height);
+    for (int y = minY; y <= maxY; y++)
+    {
+        for (int x = minX; x <= maxX; x++)
+        {
+            GridBucket *bucket = GetBucket(grid, x, y);
+            if (Reserve((void **)&bucket->entries, &bucket->capacity, bucket->len + 1, sizeof(GridEntry)))
+            {
+                bucket->entries[bucket->len++] = (GridEntry){ .cellX = x, .cellY = y, .item = item };
+            }
+        }
+    }
+    grid->itemsLen += 1;
+}
+
+void RemoveSpatialGrid(SpatialGrid *grid, ID id, Rectangle rect)
+{
+    int minX = CellCoord(grid, rect.x);
+    int minY = CellCoord(grid, rect.y);
+    int maxX = CellCoord(grid, rect.x + rect.width);
+    int maxY = CellCoord(grid, rect.y + rect.height);
+    bool removed = false;
+    for (int y = minY; y <= maxY; y++)
+    {
+        for (int x = minX; x <= maxX; x++)
+        {
+            GridBucket *bucket = GetBucket(grid, x, y);
+            for (int i = 0; i < bucket->len; i++)
+            {
+                GridEntry *entry = &bucket->entries[i];
+                if (entry->cellX == x && entry->cellY == y && IDEquals(entry->item.id, id))
+                {
+                    // order inside a bucket doesn't matter
+                    *entry = bucket->entries[bucket->len - 1];
+                    bucket->len -= 1;
+                    removed = true;
+                    break;
+                }
+            }
+        }
+    }
+    if (removed)
+    {
+        grid->itemsLen -= 1;
+    }
+}
+
+void QuerySpatialGridPoint(const SpatialGrid *grid, Vector2 point, int typeMask, GridQuery *query)
+{
+    query->len = 0;
+    int x = CellCoord(grid, point.x);
+    int y = CellCoord(grid, point.y);
+    const GridBucket *bucket = GetBucket(grid, x, y);
+    for (int i = 0; i < bucket->len; i++)
+    {
+        const GridEntry *entry = &bucket->entries[i];
+        if (entry->cellX == x && entry->cellY == y && (typeMask & GRID_TYPE_MASK(entry->item.type)))
+        {
+            PushResult(query, entry->item);
+        }
+    }
+}
+
+void QuerySpatialGridCircle(const SpatialGrid *grid, Vector2 center, float radius, int typeMask, GridQuery *query)
+{
+    QuerySpatialGridRect(grid, (Rectangle){ center.x - radius, center.y - radius, radius * 2.0f, radius * 2.0f }, typeMask, query);
+}
+
+void QuerySpatialGridRect(const SpatialGrid *grid, Rectangle rect, int typeMask, GridQuery *query)
+{
+    query->len = 0;
+    rect = FixNegativeRect(rect);
+    int minX = CellCoord(grid, rect.x);
+    int minY = CellCoord(grid, rect.y);
+    int maxX = CellCoord(grid, rect.x + rect.width);
+    int maxY = CellCoord(grid, rect.y + rect.height);
+    for (int y = minY; y <= maxY; y++)
+    {
+        for (int x = minX; x <= maxX; x++)
+        {
+            const GridBucket *bucket = GetBucket(grid, x, y);
+            for (int i = 0; i < bucket->len; i++)
+            {
+                const GridEntry *entry = &bucket->entries[i];
+                if (entry->cellX != x || entry->cellY != y || !(typeMask & GRID_TYPE_MASK(entry->item.type)))
+                {
+                    continue;
+                }
+                // an item spanning several of the queried cells is only reported from the
+                // first one both it and the query cover
+                int itemMinX = CellCoord(grid, entry->item.rect.x);
+                int itemMinY = CellCoord(grid, entry->item.rect.y);
+                int reportX = (itemMinX > minX) ? itemMinX : minX;
+                int reportY = (itemMinY > minY) ? itemMinY : minY;
+                if (x == reportX && y == reportY)
+                {
+                    PushResult(query, entry->item);
+                }
+            }
+        }
+    }
+}
+
+void UnloadGridQuery(GridQuery *query)
+{
+    RL_FREE(query->items);
+    *query = (GridQuery){ 0 };
+}
@@ -0,0 +1,85 @@
+/**********************************************************************************************
+*
+*   Uniform hash grid over static entity rectangles (obstacles, grounds, fires, help text)
+*
+*   The world is cut into square cells and every rect is filed under each cell it touches,
+*   hashed into a fixed number of buckets so the grid doesn't care how big the level is.
+*   Queries only look at the cells under the point/circle/rect, and report each item once
+*   even when it spans several of those cells.
+*
+*   Copyright (c) 2022 creikey
+*
+**********************************************************************************************/
+
+#ifndef SPATIAL_GRID_H
+#define SPATIAL_GRID_H
+
+#include "raylib.h"
+#include "entities.h"
+
+//----------------------------------------------------------------------------------
+// Types and Structures Definition
+//----------------------------------------------------------------------------------
+typedef struct GridItem
+{
+    Rectangle rect; // normalized, width and height are never negative
+    ID id;
+    enum Type type;
+} GridItem;
+
+typedef struct GridEntry
+{
+    int cellX;
+    int cellY;
+    GridItem item;
+} GridEntry;
+
+typedef struct GridBucket
+{
+    GridEntry *entries;
+    int len;
+    int capacity;
+} GridBucket;
+
+typedef struct SpatialGrid
+{
+    float cellSize;
+    GridBucket *buckets;
+    int itemsLen;
+} SpatialGrid;
+
+// Caller owned query results, grown as needed and reused between queries
+typedef struct GridQuery
+{
+    GridItem *items;
+    int len;
+    int capacity;
+} GridQuery;
+
+#define GRID_TYPE_MASK(type) (1 << (type))
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//----------------------------------------------------------------------------------
+// Spatial Grid Functions Declaration
+//----------------------------------------------------------------------------------
+void InitSpatialGrid(SpatialGrid *grid, float cellSize);
+void UnloadSpatialGrid(SpatialGrid *grid);
+void ClearSpatialGrid(SpatialGrid *grid);   // removes every item, keeps the memory
+void InsertSpatialGrid(SpatialGrid *grid, ID id, enum Type type, Rectangle rect);   // rect must be normalized, the entity store's always are
+void RemoveSpatialGrid(SpatialGrid *grid, ID id, Rectangle rect);   // rect must be the one it was inserted with
+
+// Candidates whose type is in typeMask (see GRID_TYPE_MASK) and whose rect might overlap.
+// The results replace whatever was in query
+void QuerySpatialGridPoint(const SpatialGrid *grid, Vector2 point, int typeMask, GridQuery *query);
+void QuerySpatialGridCircle(const SpatialGrid *grid, Vector2 center, float radius, int typeMask, GridQuery *query);
+void QuerySpatialGridRect(const SpatialGrid *grid, Rectangle rect, int typeMask, GridQuery *query);
+void UnloadGridQuery(GridQuery *query);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // SPATIAL_GRID_H
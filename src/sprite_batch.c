@@ -0,0 +1,210 @@
+/**********************************************************************************************
+*
+*   Sprite batch: rectangles, textures and circles queued as quads and drawn a run at a time
+*
+*   Copyright (c) 2022 creikey
+*
+**********************************************************************************************/
+
+#include "sprite_batch.h"
+#include "rlgl.h"
+#include <stddef.h>
+
+#define MIN_QUAD_CAPACITY 256
+#define MIN_RUN_CAPACITY 16
+
+//----------------------------------------------------------------------------------
+// Types and Structures Definition
+//----------------------------------------------------------------------------------
+typedef struct SpriteQuad
+{
+    float x0, y0, x1, y1;   // corners
+    float u0, v0, u1, v1;
+    Color color;
+} SpriteQuad;
+
+// quads in a row that use the same texture
+typedef struct SpriteRun
+{
+    unsigned int texture;
+    int first;
+    int count;
+} SpriteRun;
+
+//----------------------------------------------------------------------------------
+// Global Variables Definition
+//----------------------------------------------------------------------------------
+static SpriteQuad *quads = NULL;
+static int quadsLen = 0;
+static int quadsCapacity = 0;
+static SpriteRun *runs = NULL;
+static int runsLen = 0;
+static int runsCapacity = 0;
+
+static Texture circleTexture = { 0 };
+static unsigned int shapesTexture = 0;  // a white texel somewhere in it, for plain rectangles
+static Rectangle shapesUV = { 0 };
+
+//----------------------------------------------------------------------------------
+// Module Functions Definition (local)
+//----------------------------------------------------------------------------------
+static bool Grow(void **items, int *capacity, int minCapacity, size_t itemSize)
+{
+    int newCapacity = (*capacity < minCapacity) ? minCapacity : *capacity*2;
+    void *newItems = RL_REALLOC(*items, (size_t)newCapacity*itemSize);
+    if (newItems == NULL)
+    {
+        return false;
+    }
+    *items = newItems;
+    *capacity = newCapacity;
+    return true;
+}
+
+// a quad on the end of the texture's run, a new run if the last one was another texture.
+// If there's no more memory what's queued is drawn now to make room
+static SpriteQuad *PushQuad(unsigned int texture)
+{
+    bool newRun = (runsLen == 0) || (runs[runsLen - 1].texture != texture);
+    if (((quadsLen == quadsCapacity) && !Grow((void **)&quads, &quadsCapacity, MIN_QUAD_CAPACITY, sizeof(SpriteQuad))) ||
+        (newRun && (runsLen == runsCapacity) && !Grow((void **)&runs, &runsCapacity, MIN_RUN_CAPACITY, sizeof(SpriteRun))))
+    {
+        FlushSpriteBatch();
+        if ((quadsCapacity == 0) || (runsCapacity == 0))
+        {
+            return NULL;
+        }
+        newRun = true;
+    }
+
+    if (newRun)
+    {
+        runs[runsLen++] = (SpriteRun){ .texture = texture, .first = quadsLen, .count = 0 };
+    }
+    runs[runsLen - 1].count += 1;
+    return &quads[quadsLen++];
+}
+
+static void PushTextured(unsigned int texture, Rectangle dest, Rectangle uv, Color color)
+{
+    SpriteQuad *quad = PushQuad(texture);
+    if (quad == NULL)
+    {
+        return;
+    }
+    *quad = (SpriteQuad){
+        .x0 = dest.x, .y0 = dest.y, .x1 = dest.x + dest.width, .y1 = dest.y + dest.height,
+        .u0 = uv.x, .v0 = uv.y, .u1 = uv.x + uv.width, .v1 = uv.y + uv.height,
+        .color = color,
+    };
+}
+
+//----------------------------------------------------------------------------------
+// Sprite Batch Functions Definition
+//----------------------------------------------------------------------------------
+void LoadSpriteBatch(void)
+{
+    Image circle = GenImageColor(SPRITE_CIRCLE_SIZE, SPRITE_CIRCLE_SIZE, BLANK);
+    ImageDrawCircle(&circle, SPRITE_CIRCLE_SIZE/2, SPRITE_CIRCLE_SIZE/2, SPRITE_CIRCLE_SIZE/2 - 1, WHITE);
+    circleTexture = LoadTextureFromImage(circle);
+    SetTextureFilter(circleTexture, TEXTURE_FILTER_BILINEAR);
+    UnloadImage(circle);
+
+    // the same texture text is drawn from, so a rectangle after text doesn't start a new run
+    Texture shapes = GetShapesTexture();
+    Rectangle rec = GetShapesTextureRec();
+    if ((shapes.id != 0) && (shapes.width > 0) && (shapes.height > 0))
+    {
+        shapesTexture = shapes.id;
+        shapesUV = (Rectangle){
+            rec.x/(float)shapes.width, rec.y/(float)shapes.height,
+            rec.width/(float)shapes.width, rec.height/(float)shapes.height,
+        };
+    }
+    else
+    {
+        shapesTexture = rlGetTextureIdDefault();
+        shapesUV = (Rectangle){ 0.0f, 0.0f, 1.0f, 1.0f };
+    }
+}
+
+void UnloadSpriteBatch(void)
+{
+    UnloadTexture(circleTexture);
+    circleTexture = (Texture){ 0 };
+    RL_FREE(quads);
+    RL_FREE(runs);
+    quads = NULL;
+    runs = NULL;
+    quadsLen = quadsCapacity = 0;
+    runsLen = runsCapacity = 0;
+}
+
+void DrawSpriteRect(Rectangle rect, Color color)
+{
+    PushTextured(shapesTexture, rect, shapesUV, color);
+}
+
+void DrawSpriteTexture(Texture texture, Rectangle dest, Color color)
+{
+    PushTextured(texture.id, dest, (Rectangle){ 0.0f, 0.0f, 1.0f, 1.0f }, color);
+}
+
+void DrawSpriteTextureRec(Texture texture, Rectangle source, Rectangle dest, Color color)
+{
+    if ((texture.width <= 0) || (texture.height <= 0))
+    {
+        return;
+    }
+    Rectangle uv = {
+        source.x/(float)texture.width, source.y/(float)texture.height,
+        source.width/(float)texture.width, source.height/(float)texture.height,
+    };
+    // a negative size runs the coordinates backwards from the other edge
+    if (uv.width < 0.0f)
+    {
+        uv.x -= uv.width;
+    }
+    if (uv.height < 0.0f)
+    {
+        uv.y -= uv.height;
+    }
+    PushTextured(texture.id, dest, uv, color);
+}
+
+void DrawSpriteCircle(Vector2 center, float radius, Color color)
+{
+    // the circle stops a texel short of the texture's edge
+    float half = radius*(float)SPRITE_CIRCLE_SIZE/(float)(SPRITE_CIRCLE_SIZE - 2);
+    PushTextured(circleTexture.id, (Rectangle){ center.x - half, center.y - half, 2.0f*half, 2.0f*half },
+        (Rectangle){ 0.0f, 0.0f, 1.0f, 1.0f }, color);
+}
+
+void FlushSpriteBatch(void)
+{
+    for (int r = 0; r < runsLen; r++)
+    {
+        rlSetTexture(runs[r].texture);
+        rlBegin(RL_QUADS);
+        for (int q = runs[r].first; q < runs[r].first + runs[r].count; q++)
+        {
+            // rlgl draws what it has and carries on when its own buffer fills up
+            rlCheckRenderBatchLimit(4);
+
+            const SpriteQuad *quad = &quads[q];
+            rlColor4ub(quad->color.r, quad->color.g, quad->color.b, quad->color.a);
+            rlTexCoord2f(quad->u0, quad->v0);
+            rlVertex2f(quad->x0, quad->y0);
+            rlTexCoord2f(quad->u0, quad->v1);
+            rlVertex2f(quad->x0, quad->y1);
+            rlTexCoord2f(quad->u1, quad->v1);
+            rlVertex2f(quad->x1, quad->y1);
+            rlTexCoord2f(quad->u1, quad->v0);
+            rlVertex2f(quad->x1, quad->y0);
+        }
+        rlEnd();
+    }
+    rlSetTexture(0);
+    quadsLen = 0;
+    runsLen = 0;
+}
@@ -0,0 +1,47 @@
+/**********************************************************************************************
+*
+*   Sprite batch: rectangles, textures and circles queued as quads and drawn a run at a time
+*
+*   raylib's shape functions each go through rlgl on their own and DrawCircleV tessellates
+*   every circle on the CPU, dozens of vertices for what's a particle. Here everything is a
+*   quad with a texture: plain rectangles use the shapes texture, circles a circle drawn into
+*   a texture once at load. Quads go into one buffer in the order they're drawn, and a run of
+*   quads on the same texture is handed to rlgl between a single rlBegin/rlEnd, so the number
+*   of draw calls is the number of times the texture changes, not the number of things drawn.
+*
+*   Drawing order is kept, nothing is sorted, so layers still come out right as long as
+*   everything on one layer uses the same texture. Flush before drawing anything that
+*   doesn't go through here (text, raylib shapes), or it ends up underneath.
+*
+*   Copyright (c) 2022 creikey
+*
+**********************************************************************************************/
+
+#ifndef SPRITE_BATCH_H
+#define SPRITE_BATCH_H
+
+#include "raylib.h"
+
+#define SPRITE_CIRCLE_SIZE 64   // pixels across the circle texture
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//----------------------------------------------------------------------------------
+// Sprite Batch Functions Declaration
+//----------------------------------------------------------------------------------
+void LoadSpriteBatch(void);     // makes the circle texture, needs the window
+void UnloadSpriteBatch(void);
+
+void DrawSpriteRect(Rectangle rect, Color color);                   // width and height positive
+void DrawSpriteTexture(Texture texture, Rectangle dest, Color color);  // the whole texture stretched over dest
+void DrawSpriteTextureRec(Texture texture, Rectangle source, Rectangle dest, Color color);  // source in pixels, negative size flips like DrawTexturePro
+void DrawSpriteCircle(Vector2 center, float radius, Color color);
+void FlushSpriteBatch(void);    // draws everything queued
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // SPRITE_BATCH_H
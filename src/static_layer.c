@@ -0,0 +1,251 @@
+/**********************************************************************************************
+*
+*   Static layer: ground and obstacles baked into render texture tiles
+*
+*   Copyright (c) 2022 creikey
+*
+**********************************************************************************************/
+
+#include "static_layer.h"
+#include "sprite_batch.h"
+#include <math.h>
+#include <stdlib.h>
+
+#define MAX_TILE_COORD (1 << 20)    // past this it's far enough out to share the last tile
+
+//----------------------------------------------------------------------------------
+// Types and Structures Definition
+//----------------------------------------------------------------------------------
+typedef struct StaticTile
+{
+    int x, y;                       // in tiles
+    RenderTexture2D target;         // id 0 when there's nothing in the tile
+    unsigned int hash;              // of the ground and obstacles it was baked with
+    unsigned int checkedVersion;    // entity store version when hash was last compared
+    int lastUsed;                   // frame it was last in view
+    bool baked;                     // the slot holds tile x, y
+} StaticTile;
+
+//----------------------------------------------------------------------------------
+// Global Variables Definition
+//----------------------------------------------------------------------------------
+static StaticTile tiles[STATIC_MAX_TILES] = { 0 };
+static GridQuery tileQuery = { 0 };
+static int frame = 0;
+
+//----------------------------------------------------------------------------------
+// Module Functions Definition (local)
+//----------------------------------------------------------------------------------
+static int TileCoord(float coord)
+{
+    float tile = floorf(coord/(float)STATIC_TILE_SIZE);
+    if (!(tile > (float)-MAX_TILE_COORD))
+    {
+        return -MAX_TILE_COORD;
+    }
+    return (tile < (float)MAX_TILE_COORD) ? (int)tile : MAX_TILE_COORD;
+}
+
+static Rectangle TileRect(int x, int y)
+{
+    return (Rectangle){ (float)x*STATIC_TILE_SIZE, (float)y*STATIC_TILE_SIZE, STATIC_TILE_SIZE, STATIC_TILE_SIZE };
+}
+
+static unsigned int HashBytes(unsigned int hash, const void *data, size_t size)
+{
+    const unsigned char *bytes = (const unsigned char *)data;
+    for (size_t i = 0; i < size; i++)
+    {
+        hash = (hash ^ bytes[i])*16777619u;    // FNV-1a
+    }
+    return hash;
+}
+
+// the grid's candidates under the tile cut down to the ones actually on it, and a hash of
+// them that doesn't depend on the order the grid gave them in
+static unsigned int QueryTile(int x, int y)
+{
+    Rectangle rect = TileRect(x, y);
+    QuerySpatialGridRect(GetEntityGrid(), rect, STATIC_LAYER_TYPES, &tileQuery);
+
+    unsigned int hash = 0;
+    int kept = 0;
+    for (int i = 0; i < tileQuery.len; i++)
+    {
+        GridItem item = tileQuery.items[i];
+        if (!CheckCollisionRecs(item.rect, rect))
+        {
+            continue;
+        }
+        tileQuery.items[kept++] = item;
+
+        unsigned int itemHash = HashBytes(2166136261u, &item.id, sizeof(item.id));
+        itemHash = HashBytes(itemHash, &item.type, sizeof(item.type));
+        itemHash = HashBytes(itemHash, &item.rect, sizeof(item.rect));
+        hash += itemHash;
+    }
+    tileQuery.len = kept;
+    return hash + (unsigned int)kept*0x9e3779b9u;
+}
+
+// ground under obstacles, each in entity order like when they're drawn directly
+static int CompareBakeOrder(const void *a, const void *b)
+{
+    const GridItem *itemA = (const GridItem *)a;
+    const GridItem *itemB = (const GridItem *)b;
+    int layerA = (itemA->type == Ground) ? 0 : 1;
+    int layerB = (itemB->type == Ground) ? 0 : 1;
+    if (layerA != layerB)
+    {
+        return layerA - layerB;
+    }
+    int indexA = GetEntityIndex(itemA->id);
+    int indexB = GetEntityIndex(itemB->id);
+    return (indexA > indexB) - (indexA < indexB);
+}
+
+// draws what QueryTile found into the tile's texture
+static bool BakeTile(StaticTile *tile, StaticLayerDrawFunc draw)
+{
+    if (tileQuery.len == 0)
+    {
+        UnloadRenderTexture(tile->target);
+        tile->target = (RenderTexture2D){ 0 };
+        return true;
+    }
+    if (tile->target.id == 0)
+    {
+        tile->target = LoadRenderTexture(STATIC_TILE_SIZE, STATIC_TILE_SIZE);
+        if (tile->target.id == 0)
+        {
+            return false;
+        }
+    }
+
+    if (tileQuery.len > 1)
+    {
+        qsort(tileQuery.items, (size_t)tileQuery.len, sizeof(GridItem), CompareBakeOrder);
+    }
+    Rectangle rect = TileRect(tile->x, tile->y);
+    BeginTextureMode(tile->target);
+    ClearBackground(BLANK);
+    BeginMode2D((Camera2D){ .target = { rect.x, rect.y }, .zoom = 1.0f });
+    for (int i = 0; i < tileQuery.len; i++)
+    {
+        draw(GetEntity(tileQuery.items[i].id));
+    }
+    FlushSpriteBatch();
+    EndMode2D();
+    EndTextureMode();
+    return true;
+}
+
+static StaticTile *FindTile(int x, int y)
+{
+    for (int i = 0; i < STATIC_MAX_TILES; i++)
+    {
+        if (tiles[i].baked && (tiles[i].x == x) && (tiles[i].y == y))
+        {
+            return &tiles[i];
+        }
+    }
+    return NULL;
+}
+
+// the slot that's gone longest without being in view. Never one in view this frame
+static StaticTile *ClaimTile(int x, int y)
+{
+    StaticTile *oldest = NULL;
+    for (int i = 0; i < STATIC_MAX_TILES; i++)
+    {
+        if (!tiles[i].baked)
+        {
+            oldest = &tiles[i];
+            break;
+        }
+        if ((tiles[i].lastUsed != frame) && ((oldest == NULL) || (tiles[i].lastUsed < oldest->lastUsed)))
+        {
+            oldest = &tiles[i];
+        }
+    }
+    if (oldest != NULL)
+    {
+        // the texture stays for the next tile to bake into
+        *oldest = (StaticTile){ .x = x, .y = y, .target = oldest->target };
+    }
+    return oldest;
+}
+
+//----------------------------------------------------------------------------------
+// Static Layer Functions Definition
+//----------------------------------------------------------------------------------
+bool UpdateStaticLayer(Rectangle view, StaticLayerDrawFunc draw)
+{
+    frame += 1;
+    unsigned int version = GetEntityStoreVersion();
+    bool complete = true;
+
+    int lastX = TileCoord(view.x + view.width);
+    int lastY = TileCoord(view.y + view.height);
+    for (int y = TileCoord(view.y); y <= lastY; y++)
+    {
+        for (int x = TileCoord(view.x); x <= lastX; x++)
+        {
+            StaticTile *tile = FindTile(x, y);
+            if (tile == NULL)
+            {
+                tile = ClaimTile(x, y);
+            }
+            if (tile == NULL)
+            {
+                complete = false;
+                continue;
+            }
+            tile->lastUsed = frame;
+            if (tile->baked && (tile->checkedVersion == version))
+            {
+                continue;
+            }
+
+            unsigned int hash = QueryTile(x, y);
+            if (!tile->baked || (hash != tile->hash))
+            {
+                if (!BakeTile(tile, draw))
+                {
+                    complete = false;
+                    continue;
+                }
+                tile->hash = hash;
+                tile->baked = true;
+            }
+            tile->checkedVersion = version;
+        }
+    }
+    return complete;
+}
+
+void DrawStaticLayer(Rectangle view)
+{
+    for (int i = 0; i < STATIC_MAX_TILES; i++)
+    {
+        const StaticTile *tile = &tiles[i];
+        Rectangle rect = TileRect(tile->x, tile->y);
+        if (!tile->baked || (tile->target.id == 0) || !CheckCollisionRecs(rect, view))
+        {
+            continue;
+        }
+        // render textures are upside down
+        DrawSpriteTextureRec(tile->target.texture, (Rectangle){ 0.0f, 0.0f, STATIC_TILE_SIZE, -STATIC_TILE_SIZE }, rect, WHITE);
+    }
+}
+
+void UnloadStaticLayer(void)
+{
+    for (int i = 0; i < STATIC_MAX_TILES; i++)
+    {
+        UnloadRenderTexture(tiles[i].target);
+        tiles[i] = (StaticTile){ 0 };
+    }
+    UnloadGridQuery(&tileQuery);
+    frame = 0;
+}
@@ -0,0 +1,54 @@
+/**********************************************************************************************
+*
+*   Static layer: ground and obstacles baked into render texture tiles
+*
+*   Ground and obstacles only change in the editor (or when streaming brings a region in), so
+*   instead of drawing every one of them every frame they're drawn once into square tiles
+*   of STATIC_TILE_SIZE world units, and each frame just the few tiles in view are drawn as
+*   textured quads. How many rects a tile holds doesn't matter after that.
+*
+*   A tile is baked the first time it comes into view. Whenever the entity store changed
+*   since a tile was last checked, the ground and obstacles under it are hashed again, and
+*   only a tile whose hash changed is baked again. Dragging out a rect in the editor rebakes
+*   the tile under it, a fire going out or a far region streaming in rebakes nothing.
+*
+*   Tiles are 1:1 with world units, the camera doesn't zoom. Tiles that went out of view are
+*   kept in case they come back until their slot is needed.
+*
+*   Copyright (c) 2022 creikey
+*
+**********************************************************************************************/
+
+#ifndef STATIC_LAYER_H
+#define STATIC_LAYER_H
+
+#include "raylib.h"
+#include "entities.h"
+#include "spatial_grid.h"
+
+#define STATIC_TILE_SIZE 512    // world units, and pixels, across a tile
+#define STATIC_MAX_TILES 16     // baked tiles kept at once, a 900x900 view needs up to 9
+
+#define STATIC_LAYER_TYPES (GRID_TYPE_MASK(Ground) | GRID_TYPE_MASK(Obstacle))
+
+//----------------------------------------------------------------------------------
+// Types and Structures Definition
+//----------------------------------------------------------------------------------
+typedef void (*StaticLayerDrawFunc)(const Entity *e);  // draws one ground or obstacle, in world coordinates
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//----------------------------------------------------------------------------------
+// Static Layer Functions Declaration
+//----------------------------------------------------------------------------------
+bool UpdateStaticLayer(Rectangle view, StaticLayerDrawFunc draw);  // bakes what the view needs, outside BeginMode2D. False if it couldn't, draw them directly then
+void DrawStaticLayer(Rectangle view);   // in BeginMode2D, through the sprite batch
+void UnloadStaticLayer(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // STATIC_LAYER_H
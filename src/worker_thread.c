@@ -0,0 +1,357 @@
+/**********************************************************************************************
+*
+*   Worker threads, for work that shouldn't hold up the frame
+*
+*   Copyright (c) 2022 creikey
+*
+**********************************************************************************************/
+
+#include "worker_thread.h"
+#include <stddef.h>
+
+#if defined(_WIN32)
+    // windows.h clashes with raylib.h, same as in mapped_file.c
+    #define WIN32_LEAN_AND_MEAN
+    #define NOGDI
+    #define NOUSER
+    #include <windows.h>
+#elif defined(__EMSCRIPTEN__) && !defined(__EMSCRIPTEN_PTHREADS__)
+    #define WORKER_INLINE   // no threads to start, the work runs on the caller
+#else
+    #include <pthread.h>
+    #include <stdlib.h>
+    #include <unistd.h>
+#endif
+
+//----------------------------------------------------------------------------------
+// Types and Structures Definition
+//----------------------------------------------------------------------------------
+#if defined(_WIN32)
+typedef SRWLOCK PoolMutex;
+typedef CONDITION_VARIABLE PoolCondition;
+#elif !defined(WORKER_INLINE)
+typedef pthread_mutex_t PoolMutex;
+typedef pthread_cond_t PoolCondition;
+#endif
+
+#if !defined(WORKER_INLINE)
+typedef struct JobPool
+{
+    WorkerThread threads[MAX_JOB_THREADS];
+    int threadCount;
+    PoolMutex mutex;        // guards everything below but nextJob
+    PoolCondition start;    // generation moved or stopping
+    PoolCondition done;     // running got to 0
+    JobFunc func;
+    void *context;
+    int jobs;
+    int nextJob;            // taken with FetchAdd
+    int generation;         // RunJobs calls since the pool started, a worker joins each once
+    int running;            // workers that haven't finished the current generation
+    bool stopping;
+} JobPool;
+
+//----------------------------------------------------------------------------------
+// Global Variables Definition
+//----------------------------------------------------------------------------------
+static JobPool pool = { 0 };
+#endif
+
+//----------------------------------------------------------------------------------
+// Module Functions Definition (local)
+//----------------------------------------------------------------------------------
+#if defined(_WIN32)
+static DWORD WINAPI RunWorker(LPVOID parameter)
+{
+    WorkerThread *thread = (WorkerThread *)parameter;
+    thread->func(thread->context);
+    return 0;
+}
+#elif !defined(WORKER_INLINE)
+static void *RunWorker(void *parameter)
+{
+    WorkerThread *thread = (WorkerThread *)parameter;
+    thread->func(thread->context);
+    return NULL;
+}
+#endif
+
+#if !defined(WORKER_INLINE)
+static void InitPoolSync(void)
+{
+#if defined(_WIN32)
+    InitializeSRWLock(&pool.mutex);
+    InitializeConditionVariable(&pool.start);
+    InitializeConditionVariable(&pool.done);
+#else
+    pthread_mutex_init(&pool.mutex, NULL);
+    pthread_cond_init(&pool.start, NULL);
+    pthread_cond_init(&pool.done, NULL);
+#endif
+}
+
+static void FreePoolSync(void)
+{
+#if !defined(_WIN32)
+    pthread_mutex_destroy(&pool.mutex);
+    pthread_cond_destroy(&pool.start);
+    pthread_cond_destroy(&pool.done);
+#endif
+}
+
+static void LockPool(void)
+{
+#if defined(_WIN32)
+    AcquireSRWLockExclusive(&pool.mutex);
+#else
+    pthread_mutex_lock(&pool.mutex);
+#endif
+}
+
+static void UnlockPool(void)
+{
+#if defined(_WIN32)
+    ReleaseSRWLockExclusive(&pool.mutex);
+#else
+    pthread_mutex_unlock(&pool.mutex);
+#endif
+}
+
+// with the pool locked, unlocks it while waiting
+static void WaitPool(PoolCondition *condition)
+{
+#if defined(_WIN32)
+    SleepConditionVariableSRW(condition, &pool.mutex, INFINITE, 0);
+#else
+    pthread_cond_wait(condition, &pool.mutex);
+#endif
+}
+
+static void WakePool(PoolCondition *condition)
+{
+#if defined(_WIN32)
+    WakeAllConditionVariable(condition);
+#else
+    pthread_cond_broadcast(condition);
+#endif
+}
+
+// whatever jobs nobody has taken yet
+static void RunPendingJobs(void)
+{
+    for (int job = FetchAdd(&pool.nextJob, 1); job < pool.jobs; job = FetchAdd(&pool.nextJob, 1))
+    {
+        pool.func(pool.context, job);
+    }
+}
+
+static void RunPoolWorker(void *context)
+{
+    (void)context;
+    // the pool starts at generation 0, so a worker that's slow to start still joins the first RunJobs
+    int seen = 0;
+    LockPool();
+    for (;;)
+    {
+        while ((pool.generation == seen) && !pool.stopping)
+        {
+            WaitPool(&pool.start);
+        }
+        if (pool.stopping)
+        {
+            break;
+        }
+        seen = pool.generation;
+        UnlockPool();
+
+        RunPendingJobs();
+
+        LockPool();
+        pool.running -= 1;
+        if (pool.running == 0)
+        {
+            WakePool(&pool.done);
+        }
+    }
+    UnlockPool();
+}
+#endif
+
+//----------------------------------------------------------------------------------
+// Worker Thread Functions Definition
+//----------------------------------------------------------------------------------
+bool StartWorkerThread(WorkerThread *thread, WorkerFunc func, void *context)
+{
+    *thread = (WorkerThread){ .func = func, .context = context };
+
+#if defined(_WIN32)
+    thread->handle = CreateThread(NULL, 0, RunWorker, thread, 0, NULL);
+    return thread->handle != NULL;
+#elif defined(WORKER_INLINE)
+    func(context);
+    return true;
+#else
+    pthread_t *handle = malloc(sizeof(pthread_t));
+    if ((handle == NULL) || (pthread_create(handle, NULL, RunWorker, thread) != 0))
+    {
+        free(handle);
+        return false;
+    }
+    thread->handle = handle;
+    return true;
+#endif
+}
+
+void JoinWorkerThread(WorkerThread *thread)
+{
+    if (thread->handle == NULL)
+    {
+        return;
+    }
+
+#if defined(_WIN32)
+    WaitForSingleObject(thread->handle, INFINITE);
+    CloseHandle(thread->handle);
+#elif !defined(WORKER_INLINE)
+    pthread_join(*(pthread_t *)thread->handle, NULL);
+    free(thread->handle);
+#endif
+
+    thread->handle = NULL;
+}
+
+bool StartJobPool(int threads)
+{
+    StopJobPool();
+#if defined(WORKER_INLINE)
+    return false;
+#else
+    if (threads <= 0)
+    {
+        return false;
+    }
+    if (threads > MAX_JOB_THREADS)
+    {
+        threads = MAX_JOB_THREADS;
+    }
+
+    InitPoolSync();
+    for (int i = 0; i < threads; i++)
+    {
+        if (!StartWorkerThread(&pool.threads[i], RunPoolWorker, NULL))
+        {
+            break;
+        }
+        pool.threadCount += 1;
+    }
+    if (pool.threadCount == 0)
+    {
+        FreePoolSync();
+        return false;
+    }
+    return true;
+#endif
+}
+
+void StopJobPool(void)
+{
+#if !defined(WORKER_INLINE)
+    if (pool.threadCount == 0)
+    {
+        return;
+    }
+
+    LockPool();
+    pool.stopping = true;
+    WakePool(&pool.start);
+    UnlockPool();
+    for (int i = 0; i < pool.threadCount; i++)
+    {
+        JoinWorkerThread(&pool.threads[i]);
+    }
+    FreePoolSync();
+    pool = (JobPool){ 0 };
+#endif
+}
+
+void RunJobs(JobFunc func, void *context, int jobs)
+{
+#if !defined(WORKER_INLINE)
+    if ((pool.threadCount > 0) && (jobs > 1))
+    {
+        LockPool();
+        pool.func = func;
+        pool.context = context;
+        pool.jobs = jobs;
+        pool.nextJob = 0;
+        pool.running = pool.threadCount;
+        pool.generation += 1;
+        WakePool(&pool.start);
+        UnlockPool();
+
+        RunPendingJobs();
+
+        LockPool();
+        while (pool.running > 0)
+        {
+            WaitPool(&pool.done);
+        }
+        UnlockPool();
+        return;
+    }
+#endif
+    for (int job = 0; job < jobs; job++)
+    {
+        func(context, job);
+    }
+}
+
+int GetJobPoolThreads(void)
+{
+#if defined(WORKER_INLINE)
+    return 0;
+#else
+    return pool.threadCount;
+#endif
+}
+
+int GetProcessorCount(void)
+{
+#if defined(_WIN32)
+    SYSTEM_INFO info = { 0 };
+    GetSystemInfo(&info);
+    return (int)info.dwNumberOfProcessors;
+#elif defined(WORKER_INLINE)
+    return 1;
+#else
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return (count > 0) ? (int)count : 1;
+#endif
+}
+
+int LoadAcquire(const int *value)
+{
+#if defined(_MSC_VER)
+    return (int)InterlockedCompareExchange((volatile LONG *)value, 0, 0);
+#else
+    return __atomic_load_n(value, __ATOMIC_ACQUIRE);
+#endif
+}
+
+void StoreRelease(int *value, int newValue)
+{
+#if defined(_MSC_VER)
+    InterlockedExchange((volatile LONG *)value, (LONG)newValue);
+#else
+    __atomic_store_n(value, newValue, __ATOMIC_RELEASE);
+#endif
+}
+
+int FetchAdd(int *value, int amount)
+{
+#if defined(_MSC_VER)
+    return (int)InterlockedExchangeAdd((volatile LONG *)value, (LONG)amount);
+#else
+    return __atomic_fetch_add(value, amount, __ATOMIC_ACQ_REL);
+#endif
+}
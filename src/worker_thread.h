@@ -0,0 +1,65 @@
+/**********************************************************************************************
+*
+*   Worker threads, for work that shouldn't hold up the frame
+*
+*   raylib has no threads, so this is the little that's needed over Win32 and pthreads. The
+*   web build without pthreads runs the work right away in StartWorkerThread instead, which
+*   is slower to start but finishes the same way.
+*
+*   What a worker and the main thread both touch goes through LoadAcquire/StoreRelease: the
+*   writer fills in its data and then stores a count or flag, the reader loads the flag and
+*   can then read everything written before it.
+*
+*   For work that has to be done before the frame goes on, split into jobs, there's a pool of
+*   threads that stay parked between uses. RunJobs hands out the jobs, the calling thread
+*   takes some too, and it returns once they're all done. Without threads it just runs them.
+*
+*   Copyright (c) 2022 creikey
+*
+**********************************************************************************************/
+
+#ifndef WORKER_THREAD_H
+#define WORKER_THREAD_H
+
+#include <stdbool.h>
+
+#define MAX_JOB_THREADS 31  // pool threads besides the one calling RunJobs
+
+//----------------------------------------------------------------------------------
+// Types and Structures Definition
+//----------------------------------------------------------------------------------
+typedef void (*WorkerFunc)(void *context);
+typedef void (*JobFunc)(void *context, int job);
+
+typedef struct WorkerThread
+{
+    void *handle;       // NULL when there's nothing to join
+    WorkerFunc func;
+    void *context;
+} WorkerThread;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//----------------------------------------------------------------------------------
+// Worker Thread Functions Declaration
+//----------------------------------------------------------------------------------
+bool StartWorkerThread(WorkerThread *thread, WorkerFunc func, void *context);  // false if it couldn't start, func didn't run
+void JoinWorkerThread(WorkerThread *thread);    // waits for func to return, fine on one that never started
+
+bool StartJobPool(int threads);     // threads besides the caller. False if none started, RunJobs runs everything itself then
+void StopJobPool(void);
+void RunJobs(JobFunc func, void *context, int jobs);   // func for each of [0, jobs), in any order on any thread. Returns when all are done
+int GetJobPoolThreads(void);        // 0 when it isn't running
+int GetProcessorCount(void);
+
+int LoadAcquire(const int *value);
+void StoreRelease(int *value, int newValue);
+int FetchAdd(int *value, int amount);   // returns what it was before
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // WORKER_THREAD_H